@@ -21,7 +21,12 @@
 #include "on_calculate.h"
 #include "on_info.h"
 #include "on_websocket.h"
+#include "on_remote.h"
+#include "on_responsecache.h"
+#include "on_api.h"
 #include "on_screen_io.h"
+#include "on_threadpool.h"
+#include "on_volsurface.h"
 
 #include <signal.h>
 #include <string.h>
@@ -67,6 +72,9 @@ int main(void)
     CURLcode curlGlobal = curl_global_init(CURL_GLOBAL_ALL);
     if (curlGlobal != 0)
         mvwprintw(screen.statusWindow, 0, 1, "Internet unavailable. Some functions will not work.\n");
+    else
+        remoteSessionInit();
+    loadApiTokens();
     wrefresh(screen.statusWindow);
 
     FunctionValue argument = FV_OK;
@@ -134,6 +142,13 @@ int main(void)
 
     wssCleanup();
 
+    freeVolSurface(screen.volSurface);
+    free(screen.volSurface);
+
+    threadPoolFreeShared();
+
+    remoteSessionCleanup();
+    responseCacheFree();
     curl_global_cleanup();
 
     writeDownThingsToRemember(&userInput);
@@ -18,16 +18,119 @@
 #include "on_status.h"
 #include "on_config.h"
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
+// Tokens are read from disk once into a page-locked region that is kept out of
+// core dumps and zeroed when the program exits
+typedef struct {
+    char name[API_TOKEN_NAME_LENGTH];
+    char token[API_TOKEN_LENGTH];
+} ApiTokenSlot;
+
+static ApiTokenSlot *tokenStore = NULL;
+static size_t tokenStoreSize = 0;
+static pthread_mutex_t tokenStoreMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void secureZero(void *p, size_t n)
+{
+    volatile unsigned char *c = p;
+    while (n--)
+        *c++ = 0;
+
+    return;
+}
+
+// With tokenStoreMutex held
+static bool openTokenStore(void)
+{
+    if (tokenStore != NULL)
+        return true;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t size = API_TOKEN_SLOTS * sizeof(ApiTokenSlot);
+    if (pageSize > 0)
+        size = (size + (size_t)pageSize - 1) / (size_t)pageSize * (size_t)pageSize;
+    void *region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return false;
+    // Not fatal: RLIMIT_MEMLOCK may be small
+    (void)mlock(region, size);
+#ifdef MADV_DONTDUMP
+    (void)madvise(region, size, MADV_DONTDUMP);
+#endif
+
+    tokenStore = region;
+    tokenStoreSize = size;
+    atexit(forgetApiTokens);
+
+    return true;
+}
+
+// With tokenStoreMutex held
+static ApiTokenSlot *findTokenSlot(const char *name, bool add)
+{
+    ApiTokenSlot *empty = NULL;
+    for (int i = 0; i < API_TOKEN_SLOTS; i++)
+    {
+        if (tokenStore[i].name[0] == '\0')
+        {
+            if (empty == NULL)
+                empty = &tokenStore[i];
+        }
+        else if (strcmp(tokenStore[i].name, name) == 0)
+            return &tokenStore[i];
+    }
+    if (!add || empty == NULL)
+        return NULL;
+
+    snprintf(empty->name, API_TOKEN_NAME_LENGTH, "%s", name);
+
+    return empty;
+}
+
+// Reads the token file into slot->token; false if there is none
+static bool readApiTokenFile(const char *name, ApiTokenSlot *slot)
+{
+    char *homeDir = getenv("HOME");
+    if (homeDir == NULL || access(homeDir, F_OK) != 0)
+        return false;
+
+    char configFile[FILENAME_MAX];
+    snprintf(configFile, FILENAME_MAX, "%s/%s/%s/%s", homeDir, ON_OPTIONS_DIR, ON_API_TOKENS_DIR, name);
+    FILE *f = fopen(configFile, "r");
+    if (f == NULL)
+        return false;
+
+    char format[16] = {0};
+    snprintf(format, sizeof format, "%%%ds", API_TOKEN_LENGTH - 1);
+    bool found = fscanf(f, format, slot->token) == 1;
+    fclose(f);
+
+    return found;
+}
+
 int saveApiToken(char *name, char* token)
 {
     if (name == NULL || token == NULL)
         return ON_MISSING_ARG_POINTER;
 
+    // Usable this session even if it cannot be written to disk
+    if (strlen(name) < API_TOKEN_NAME_LENGTH)
+    {
+        pthread_mutex_lock(&tokenStoreMutex);
+        ApiTokenSlot *slot = openTokenStore() ? findTokenSlot(name, true) : NULL;
+        if (slot != NULL)
+            snprintf(slot->token, API_TOKEN_LENGTH, "%s", token);
+        pthread_mutex_unlock(&tokenStoreMutex);
+    }
+
     char *homeDir = getenv("HOME");
     if (access(homeDir, F_OK) != 0)
         return ON_FILE_READ_ERROR;
@@ -59,29 +162,56 @@ int saveApiToken(char *name, char* token)
 
 }
 
-char * loadApiToken(char *name)
+const char *apiToken(const char *name)
 {
-    if (name == NULL)
-        return NULL;
-        
-    char *homeDir = getenv("HOME");
-    if (access(homeDir, F_OK) != 0)
-        return NULL;
-
-    char configFile[FILENAME_MAX];
-    snprintf(configFile, FILENAME_MAX, "%s/%s/%s/%s", homeDir, ON_OPTIONS_DIR, ON_API_TOKENS_DIR, name);
-    if (access(configFile, F_OK) != 0)
+    if (name == NULL || strlen(name) >= API_TOKEN_NAME_LENGTH)
         return NULL;
 
-    char *token = calloc(1024, 1);
-    if (token == NULL)
-        return NULL;
+    const char *token = NULL;
+    pthread_mutex_lock(&tokenStoreMutex);
+    if (openTokenStore())
+    {
+        ApiTokenSlot *slot = findTokenSlot(name, false);
+        if (slot == NULL)
+        {
+            slot = findTokenSlot(name, true);
+            if (slot != NULL && !readApiTokenFile(name, slot))
+            {
+                secureZero(slot, sizeof *slot);
+                slot = NULL;
+            }
+        }
+        if (slot != NULL)
+            token = slot->token;
+    }
+    pthread_mutex_unlock(&tokenStoreMutex);
 
-    FILE *f = fopen(configFile, "r");
+    return token;
+}
 
-    fscanf(f, "%s", token);
+int loadApiTokens(void)
+{
+    const char *names[] = {"PIO.apitoken", "FRED.apitoken", "QUESTRADE.apitoken", "QUESTRADE.accountnumber"};
+    int nLoaded = 0;
+    for (size_t i = 0; i < sizeof names / sizeof names[0]; i++)
+        if (apiToken(names[i]) != NULL)
+            nLoaded++;
 
-    fclose(f);
+    return nLoaded;
+}
 
-    return token;
+void forgetApiTokens(void)
+{
+    pthread_mutex_lock(&tokenStoreMutex);
+    if (tokenStore != NULL)
+    {
+        secureZero(tokenStore, tokenStoreSize);
+        munlock(tokenStore, tokenStoreSize);
+        munmap(tokenStore, tokenStoreSize);
+        tokenStore = NULL;
+        tokenStoreSize = 0;
+    }
+    pthread_mutex_unlock(&tokenStoreMutex);
+
+    return;
 }
@@ -17,8 +17,19 @@
 #ifndef _ON_API_H
 #define _ON_API_H
 
+#define API_TOKEN_NAME_LENGTH 64
+#define API_TOKEN_LENGTH 1024
+#define API_TOKEN_SLOTS 8
+
+// Writes the token file and keeps the token for apiToken()
 int saveApiToken(char *name, char* token);
-char *loadApiToken(char *name);
+// Token from memory, read from its file on first use. The pointer is borrowed:
+// do not modify or free it. NULL if there is no token.
+const char *apiToken(const char *name);
+// Reads the known providers' tokens at startup; returns the number found
+int loadApiTokens(void);
+// Zeroes and releases the tokens; also runs at exit
+void forgetApiTokens(void);
 
 
 #endif // _ON_API_H
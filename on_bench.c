@@ -0,0 +1,545 @@
+/*
+    Options Numerics: on_bench.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Micro-benchmarks of the pricing models over a fixed grid of options.
+// Prints a table on stderr and JSON on stdout:
+//     on_bench [minimum-seconds-per-benchmark] > bench.json
+
+#include "on_optionsmodels.h"
+#include "on_optionstiming.h"
+#include "on_statistics.h"
+#include "on_simd.h"
+#include "on_threadpool.h"
+#include "on_status.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_MAX_RESULTS 64
+#define BENCH_N_CLOSES 251
+// Ten years of daily closes for the forecast model fits
+#define BENCH_N_FIT_CLOSES 2511
+#define BENCH_SPOT 100.0
+#define BENCH_RATE 0.04
+#define BENCH_DIVIDEND_YIELD 0.01
+
+// Allocations made by the models, counted through the linker's
+// --wrap=malloc,calloc,realloc where available
+#ifdef ON_BENCH_COUNT_ALLOCATIONS
+static atomic_long nAllocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&nAllocations, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    atomic_fetch_add_explicit(&nAllocations, 1, memory_order_relaxed);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    atomic_fetch_add_explicit(&nAllocations, 1, memory_order_relaxed);
+    return __real_realloc(p, size);
+}
+
+static long allocations(void)
+{
+    return atomic_load(&nAllocations);
+}
+#else
+static long allocations(void)
+{
+    return -1;
+}
+#endif
+
+// Reproducible grid of strikes (moneyness), maturities, volatilities and types,
+// with market prices from the models at those volatilities
+typedef struct {
+    size_t n;
+    Option *options;
+    OptionType *types;
+    double *europeanPrices;
+    double *americanPrices;
+    // Structure-of-arrays copy for the batch functions
+    double *S;
+    double *K;
+    double *r;
+    double *q;
+    double *v;
+    double *T;
+    double *values;
+    double closes[BENCH_N_CLOSES];
+    double fitCloses[BENCH_N_FIT_CLOSES];
+    Date expiries[64];
+} BenchGrid;
+
+typedef struct {
+    const char *name;
+    const char *simd;
+    int threads;
+    int steps;
+    long operations;
+    double seconds;
+    double nsPerOp;
+    double opsPerSecond;
+    double allocationsPerOp;
+} BenchResult;
+
+// Runs one operation (one option, one series, ...) of a benchmark for grid entry i
+typedef double (*BenchFunction)(BenchGrid *grid, size_t i, int steps);
+
+static volatile double sink = 0.0;
+
+static double seconds(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static int gridInit(BenchGrid *grid)
+{
+    static const double moneyness[] = {0.8, 0.9, 0.95, 1.0, 1.05, 1.1, 1.25};
+    static const int tradingDays[] = {5, 21, 63, 126, 251, 502};
+    static const double volatilities[] = {0.1, 0.2, 0.4, 0.8};
+    const size_t nM = sizeof moneyness / sizeof moneyness[0];
+    const size_t nT = sizeof tradingDays / sizeof tradingDays[0];
+    const size_t nV = sizeof volatilities / sizeof volatilities[0];
+
+    memset(grid, 0, sizeof *grid);
+    grid->n = nM * nT * nV * 2;
+    grid->options = calloc(grid->n, sizeof *grid->options);
+    grid->types = calloc(grid->n, sizeof *grid->types);
+    grid->europeanPrices = calloc(grid->n, sizeof *grid->europeanPrices);
+    grid->americanPrices = calloc(grid->n, sizeof *grid->americanPrices);
+    double *soa = calloc(7 * grid->n, sizeof *soa);
+    if (grid->options == NULL || grid->types == NULL || grid->europeanPrices == NULL || grid->americanPrices == NULL || soa == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    grid->S = soa;
+    grid->K = soa + grid->n;
+    grid->r = soa + 2 * grid->n;
+    grid->q = soa + 3 * grid->n;
+    grid->v = soa + 4 * grid->n;
+    grid->T = soa + 5 * grid->n;
+    grid->values = soa + 6 * grid->n;
+
+    size_t i = 0;
+    for (size_t m = 0; m < nM; m++)
+        for (size_t t = 0; t < nT; t++)
+            for (size_t v = 0; v < nV; v++)
+                for (int type = 0; type < 2; type++)
+                {
+                    Option opt = {BENCH_SPOT, BENCH_SPOT * moneyness[m], BENCH_RATE, BENCH_DIVIDEND_YIELD, volatilities[v], (double)tradingDays[t] / OPTIONS_TRADING_DAYS_PER_YEAR};
+                    grid->options[i] = opt;
+                    grid->types[i] = type == 0 ? CALL : PUT;
+                    grid->europeanPrices[i] = blackscholes_option_value(opt, grid->types[i]);
+                    grid->americanPrices[i] = binomial_option_value(opt, grid->types[i]);
+                    grid->S[i] = opt.S;
+                    grid->K[i] = opt.K;
+                    grid->r[i] = opt.r;
+                    grid->q[i] = opt.q;
+                    grid->v[i] = opt.v;
+                    grid->T[i] = opt.T;
+                    i++;
+                }
+
+    // Geometric random walk from a fixed-seed linear congruential generator
+    unsigned long long state = 20230115ULL;
+    grid->closes[0] = BENCH_SPOT;
+    for (int c = 1; c < BENCH_N_CLOSES; c++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double u = (double)(state >> 11) / 9007199254740992.0;
+        grid->closes[c] = grid->closes[c - 1] * exp(0.02 * (u - 0.5));
+    }
+
+    // GARCH(1,1) returns (omega 2e-6, alpha 0.08, beta 0.90) with the same generator;
+    // the sum of twelve uniforms stands in for a normal deviate
+    double variance = 1e-4;
+    double r = 0.0;
+    grid->fitCloses[0] = BENCH_SPOT;
+    for (int c = 1; c < BENCH_N_FIT_CLOSES; c++)
+    {
+        variance = 2e-6 + 0.08 * r * r + 0.90 * variance;
+        double z = -6.0;
+        for (int k = 0; k < 12; k++)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            z += (double)(state >> 11) / 9007199254740992.0;
+        }
+        r = sqrt(variance) * z;
+        grid->fitCloses[c] = grid->fitCloses[c - 1] * exp(r);
+    }
+
+    // Expiries from one week to about two years out
+    time_t now = time(NULL);
+    for (int e = 0; e < 64; e++)
+    {
+        time_t expiry = now + (time_t)(7 + 11 * e) * 86400;
+        struct tm *tm = localtime(&expiry);
+        grid->expiries[e].year = tm->tm_year + 1900;
+        grid->expiries[e].month = tm->tm_mon + 1;
+        grid->expiries[e].day = tm->tm_mday;
+    }
+
+    return ON_OK;
+}
+
+static void gridFree(BenchGrid *grid)
+{
+    free(grid->options);
+    free(grid->types);
+    free(grid->europeanPrices);
+    free(grid->americanPrices);
+    free(grid->S);
+
+    return;
+}
+
+static double benchBlackScholes(BenchGrid *grid, size_t i, int steps)
+{
+    (void)steps;
+    return blackscholes_option_value(grid->options[i], grid->types[i]);
+}
+
+// One call prices the whole grid; reported per option
+static double benchBlackScholesBatch(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    OptionBatch batch = {grid->n, grid->S, grid->K, grid->r, grid->q, grid->v, grid->T, grid->types};
+    blackscholes_option_value_batch(&batch, grid->values);
+
+    return grid->values[0];
+}
+
+static double benchBinomial(BenchGrid *grid, size_t i, int steps)
+{
+    return binomial_option_value_steps(grid->options[i], grid->types[i], steps, NULL);
+}
+
+static double benchBlackScholesImpliedVolatility(BenchGrid *grid, size_t i, int steps)
+{
+    (void)steps;
+    double impliedVolatility = 0.0;
+    blackscholes_option_implied_volatility(grid->options[i], grid->types[i], grid->europeanPrices[i], &impliedVolatility);
+
+    return impliedVolatility;
+}
+
+static double benchBinomialImpliedVolatility(BenchGrid *grid, size_t i, int steps)
+{
+    (void)steps;
+    double impliedVolatility = 0.0;
+    binomial_option_implied_volatility(grid->options[i], grid->types[i], grid->americanPrices[i], &impliedVolatility);
+
+    return impliedVolatility;
+}
+
+static double benchBinomialImpliedPrice(BenchGrid *grid, size_t i, int steps)
+{
+    (void)steps;
+    double impliedPrice = 0.0;
+    binomial_option_implied_price_of_underlying(grid->options[i], grid->types[i], grid->americanPrices[i], &impliedPrice);
+
+    return impliedPrice;
+}
+
+static double benchBlackScholesGeeks(BenchGrid *grid, size_t i, int steps)
+{
+    (void)steps;
+    return option_geeks(grid->options[i], grid->types[i], "d$dP", blackscholes_option_value);
+}
+
+static double benchBinomialGeeks(BenchGrid *grid, size_t i, int steps)
+{
+    (void)steps;
+    return option_geeks(grid->options[i], grid->types[i], "d$dP", binomial_option_value);
+}
+
+static double benchVolatility(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    return calculate_volatility(grid->closes, BENCH_N_CLOSES);
+}
+
+static double benchEwmaFit(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    EwmaModel model = {0};
+    ewmaFit(grid->fitCloses, BENCH_N_FIT_CLOSES, &model);
+    return model.lambda;
+}
+
+static double benchGarchFit(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    GarchModel model = {0};
+    garchFit(grid->fitCloses, BENCH_N_FIT_CLOSES, &model);
+    return model.alpha + model.beta;
+}
+
+// Cycles through the expiries, one per call
+static double benchTradingDays(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    static size_t e = 0;
+    e = (e + 1) % 64;
+
+    return (double)tradingDaysToExpiry(grid->expiries[e]);
+}
+
+static double benchTradingYears(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    static size_t e = 0;
+    e = (e + 1) % 64;
+
+    return tradingYearsToExpiry(grid->expiries[e]);
+}
+
+static double benchTradingDaysBetween(BenchGrid *grid, size_t i, int steps)
+{
+    (void)i;
+    (void)steps;
+    static size_t e = 0;
+    e = (e + 1) % 64;
+
+    return (double)tradingDaysBetween(grid->expiries[0], grid->expiries[e]);
+}
+
+// Repeats passes over the grid (or single operations if perGrid is false)
+// until at least minSeconds have passed
+static BenchResult runBenchmark(BenchGrid *grid, const char *name, BenchFunction function, int steps, bool perGrid, bool wholeGridPerCall, double minSeconds)
+{
+    BenchResult result = {.name = name, .simd = simdLevelName(simdLevel()), .threads = 1, .steps = steps};
+    size_t nPerPass = perGrid ? grid->n : 1;
+
+    // Warm up caches and per-thread scratch space
+    for (size_t i = 0; i < nPerPass; i++)
+        sink += function(grid, i, steps);
+
+    long allocationsStart = allocations();
+    double start = seconds();
+    double elapsed = 0.0;
+    long passes = 0;
+    do
+    {
+        for (size_t i = 0; i < nPerPass; i++)
+            sink += function(grid, i, steps);
+        passes++;
+        elapsed = seconds() - start;
+    } while (elapsed < minSeconds);
+    long allocationsEnd = allocations();
+
+    result.operations = passes * (long)(wholeGridPerCall ? grid->n : nPerPass);
+    result.seconds = elapsed;
+    result.nsPerOp = 1e9 * elapsed / (double)result.operations;
+    result.opsPerSecond = (double)result.operations / elapsed;
+    result.allocationsPerOp = allocationsStart < 0 ? -1.0 : (double)(allocationsEnd - allocationsStart) / (double)result.operations;
+
+    return result;
+}
+
+static void chainJob(void *context, size_t index)
+{
+    BenchGrid *grid = context;
+    grid->values[index] = binomial_option_value(grid->options[index], grid->types[index]);
+
+    return;
+}
+
+// Binomial values of the whole grid on a pool of nThreads threads
+static BenchResult runThreadScaling(BenchGrid *grid, int nThreads, double minSeconds)
+{
+    BenchResult result = {.name = "binomial_option_value (thread pool)", .simd = simdLevelName(simdLevel()), .threads = nThreads, .steps = BINOMIAL_N_STEPS};
+    ThreadPool *pool = threadPoolCreate(nThreads);
+    if (pool == NULL)
+    {
+        result.operations = 0;
+        return result;
+    }
+
+    threadPoolParallelFor(pool, grid->n, chainJob, grid);
+
+    long allocationsStart = allocations();
+    double start = seconds();
+    double elapsed = 0.0;
+    long passes = 0;
+    do
+    {
+        threadPoolParallelFor(pool, grid->n, chainJob, grid);
+        passes++;
+        elapsed = seconds() - start;
+    } while (elapsed < minSeconds);
+    long allocationsEnd = allocations();
+    threadPoolFree(pool);
+
+    result.operations = passes * (long)grid->n;
+    result.seconds = elapsed;
+    result.nsPerOp = 1e9 * elapsed / (double)result.operations;
+    result.opsPerSecond = (double)result.operations / elapsed;
+    result.allocationsPerOp = allocationsStart < 0 ? -1.0 : (double)(allocationsEnd - allocationsStart) / (double)result.operations;
+
+    return result;
+}
+
+static void printJson(FILE *f, const BenchGrid *grid, const BenchResult *results, int nResults, double minSeconds)
+{
+    char timestamp[32] = {0};
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof timestamp, "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"on_bench\",\n");
+    fprintf(f, "  \"timestamp\": \"%s\",\n", timestamp);
+    fprintf(f, "  \"simd_detected\": \"%s\",\n", simdLevelName(simdDetectedLevel()));
+    fprintf(f, "  \"cores\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(f, "  \"min_seconds\": %g,\n", minSeconds);
+    fprintf(f, "  \"grid_options\": %zu,\n", grid->n);
+    fprintf(f, "  \"results\": [\n");
+    for (int i = 0; i < nResults; i++)
+    {
+        const BenchResult *r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"simd\": \"%s\", \"threads\": %d, \"steps\": %d, \"operations\": %ld, \"seconds\": %.6f, \"ns_per_op\": %.3f, \"ops_per_second\": %.1f, \"allocations_per_op\": ", r->name, r->simd, r->threads, r->steps, r->operations, r->seconds, r->nsPerOp, r->opsPerSecond);
+        if (r->allocationsPerOp < 0.0)
+            fprintf(f, "null");
+        else
+            fprintf(f, "%.4f", r->allocationsPerOp);
+        fprintf(f, "}%s\n", i < nResults - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+
+    return;
+}
+
+static void printResult(const BenchResult *r)
+{
+    char allocationsPerOp[32] = "n/a";
+    if (r->allocationsPerOp >= 0.0)
+        snprintf(allocationsPerOp, sizeof allocationsPerOp, "%.3f", r->allocationsPerOp);
+    fprintf(stderr, "%-44s %-7s %3d %5d %14.1f %14.0f %10s\n", r->name, r->simd, r->threads, r->steps, r->nsPerOp, r->opsPerSecond, allocationsPerOp);
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    double minSeconds = BENCH_MIN_SECONDS;
+    if (argc > 1)
+        minSeconds = atof(argv[1]);
+    if (argc > 2 || !(minSeconds > 0.0))
+    {
+        fprintf(stderr, "usage: %s [minimum-seconds-per-benchmark] > bench.json\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BenchGrid grid = {0};
+    if (gridInit(&grid) != ON_OK)
+    {
+        fprintf(stderr, "Unable to allocate the benchmark grid\n");
+        gridFree(&grid);
+        return EXIT_FAILURE;
+    }
+
+    BenchResult results[BENCH_MAX_RESULTS] = {0};
+    int n = 0;
+    SimdLevel detected = simdDetectedLevel();
+
+    fprintf(stderr, "%zu options; at least %g s per benchmark\n", grid.n, minSeconds);
+    fprintf(stderr, "%-44s %-7s %3s %5s %14s %14s %10s\n", "benchmark", "simd", "thr", "steps", "ns/op", "ops/s", "allocs/op");
+
+    // Models that use the SIMD kernels, at each instruction set available
+    static const int steps[] = {50, 100, 250, 500, 1000};
+    for (int level = SIMD_SCALAR; level <= (int)detected; level++)
+    {
+        simdSetLevel((SimdLevel)level);
+        results[n] = runBenchmark(&grid, "blackscholes_option_value_batch", benchBlackScholesBatch, 0, false, true, minSeconds);
+        printResult(&results[n++]);
+        for (size_t s = 0; s < sizeof steps / sizeof steps[0]; s++)
+        {
+            results[n] = runBenchmark(&grid, "binomial_option_value_steps", benchBinomial, steps[s], true, false, minSeconds);
+            printResult(&results[n++]);
+        }
+    }
+    simdSetLevel(detected);
+
+    results[n] = runBenchmark(&grid, "blackscholes_option_value", benchBlackScholes, 0, true, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "blackscholes_option_implied_volatility", benchBlackScholesImpliedVolatility, 0, true, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "binomial_option_implied_volatility", benchBinomialImpliedVolatility, BINOMIAL_N_STEPS, true, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "binomial_option_implied_price_of_underlying", benchBinomialImpliedPrice, BINOMIAL_N_STEPS, true, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "option_geeks (blackscholes, d$dP)", benchBlackScholesGeeks, 0, true, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "option_geeks (binomial, d$dP)", benchBinomialGeeks, BINOMIAL_N_STEPS, true, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "calculate_volatility (251 closes)", benchVolatility, 0, false, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "ewmaFit (2511 closes)", benchEwmaFit, 0, false, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "garchFit (2511 closes)", benchGarchFit, 0, false, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "tradingDaysToExpiry", benchTradingDays, 0, false, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "tradingDaysBetween", benchTradingDaysBetween, 0, false, false, minSeconds);
+    printResult(&results[n++]);
+    results[n] = runBenchmark(&grid, "tradingYearsToExpiry", benchTradingYears, 0, false, false, minSeconds);
+    printResult(&results[n++]);
+
+    // Thread scaling of chain pricing, doubling up to the number of cores
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int threads = 1; n < BENCH_MAX_RESULTS; threads *= 2)
+    {
+        if (threads > cores)
+            threads = (int)cores;
+        results[n] = runThreadScaling(&grid, threads, minSeconds);
+        if (results[n].operations > 0)
+            printResult(&results[n++]);
+        if (threads >= cores)
+            break;
+    }
+
+    printJson(stdout, &grid, results, n, minSeconds);
+    gridFree(&grid);
+
+    return EXIT_SUCCESS;
+}
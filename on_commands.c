@@ -42,15 +42,15 @@ int initCommands(Command **commands)
         {"Info", "example", "ex", "an example is added to the command history and run", "example <command> (or ex <command>)", examplesFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, noExample, false},
 
         // Calculator
-        {"Calculator", "european_option", "eo", "prints European option value for specified parameters; uses Black-Scholes equation (no dividend)", "european_option T:<C or P>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-\%>,R:<risk-free-rate-\%>,P:<underlying-share-price>", blackScholesOptionPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"European option price:", "T:C,S:16,E:%d-%02d-%02d,V:90,R:4.3,P:20", "+12f", true}, false},
+        {"Calculator", "european_option", "eo", "prints European option value for specified parameters; uses Black-Scholes equation (no dividend)", "european_option T:<C or P>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-\% or s(urface)>,R:<risk-free-rate-\%>,P:<underlying-share-price>", blackScholesOptionPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"European option price:", "T:C,S:16,E:%d-%02d-%02d,V:90,R:4.3,P:20", "+12f", true}, false},
 
-        {"Calculator", "american_option", "ao", "prints American option value for specified parameters, including dividend yield; uses binomial model", "american_option T:<C or P>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-%%>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-share-price>", binomialOptionPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"American option price:", "T:C,S:16,E:%d-%02d-%02d,V:79.3,R:4.3,Q:0,P:20", "+12f", true}, false},
+        {"Calculator", "american_option", "ao", "prints American option value for specified parameters, including dividend yield; uses binomial model", "american_option T:<C or P>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-%% or s(urface)>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-share-price>", binomialOptionPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"American option price:", "T:C,S:16,E:%d-%02d-%02d,V:79.3,R:4.3,Q:0,P:20", "+12f", true}, false},
 
         {"Calculator", "time_decay", "td", "prints option price for each remaining trading day given specified parameters", "time_decay X:<A(merican) or E(european)>,T:<C or P>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-%%>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-share-price>", optionsTimeDecayFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"American-style exercise option price versus time:", "X:A,T:C,S:16,E:%d-%02d-%02d,V:79.3,R:4.3,Q:0,P:20", "+4f", true}, false},
 
-        {"Calculator", "greeks", "gx", "prints greeks using binomial option model", "greeks G:<t(theta), v(ega), d(elta), g(amma), or a(ll)>,T:<C(all) or P(ut)>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-\%>,R:<risk-free-rate>,Q:<dividend-yield-\%>,P:<underlying-share-price>", geeksFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"All greeks:", "G:a,T:C,S:16,E:%d-%02d-%02d,V:80,R:4.31,Q:0,P:20", "+12f", true}, false},
+        {"Calculator", "greeks", "gx", "prints greeks using closed-form Black-Scholes or binomial option model", "greeks G:<t(theta), v(ega), d(elta), g(amma), or a(ll)>,[X:<A(merican) or E(uropean)>,]T:<C(all) or P(ut)>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-\%>,R:<risk-free-rate>,Q:<dividend-yield-\%>,P:<underlying-share-price>", geeksFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"All greeks:", "G:a,T:C,S:16,E:%d-%02d-%02d,V:80,R:4.31,Q:0,P:20", "+12f", true}, false},
 
-        {"Calculator", "implied_volatility", "iv", "prints implied volatility using binomial option model", "implied_volatility T:<C(all) or P(ut)>,S:<strike-price>,E:<expiry-date>, R:<risk-free-rate>,Q:<dividend-yield-\%>,P:<underlying-share-price>,B:<underlying-share-bid>,A:<underlying-share-ask>", impliedVolatilityFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Bid and ask implied volatilities for an American option:", "T:C,S:16,E:%d-%02d-%02d,R:4.31,Q:0,P:20,B:5.70,A:6.30", "+12f", true}, false},
+        {"Calculator", "implied_volatility", "iv", "prints implied volatility using closed-form Black-Scholes or binomial option model", "implied_volatility [X:<A(merican) or E(uropean)>,]T:<C(all) or P(ut)>,S:<strike-price>,E:<expiry-date>, R:<risk-free-rate>,Q:<dividend-yield-\%>,P:<underlying-share-price>,B:<underlying-share-bid>,A:<underlying-share-ask>", impliedVolatilityFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Bid and ask implied volatilities for an American option:", "T:C,S:16,E:%d-%02d-%02d,R:4.31,Q:0,P:20,B:5.70,A:6.30", "+12f", true}, false},
 
         {"Calculator", "implied_price", "ip", "prints implied price using binomial option model", "implied_price T:<C(all) or P(ut)>,S:<strike-price>,E:<expiry-date>,V:<underlying-share-volatility-\%>,R:<risk-free-rate>,Q:<dividend-yield-\%>,O:<option-price>", impliedPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Implied price of underlying asset for an American option:", "T:C,S:16,E:%d-%02d-%02d,V:80,R:4.31,Q:0,O:6", "+12f", true}, false},
 
@@ -66,11 +66,16 @@ int initCommands(Command **commands)
 
         {"Polygon.IO", "options_chain", "oc", "searches a stock's current options chain", "options_chain <ticker>,T:<C(all) or P(ut),s:<min-strike>,S:<max-strike>,e:<earliest-expiry>,E:<latest-expiry>,v:<min-value>", pioOptionsChainFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Options chain search at Polygon-IO:", "GME,T:C,s:20,S:25,e:+2f,E:+12f,v:0", NULL, true}, false},
 
+        {"Polygon.IO", "chain_analytics", "ca", "prices every contract of a stock's current options chain and solves for its implied volatility, using all cores", "chain_analytics <ticker>,T:<C(all) or P(ut),s:<min-strike>,S:<max-strike>,e:<earliest-expiry>,E:<latest-expiry>,V:<underlying-share-volatility-%%>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-share-price or 0 for latest>", chainAnalyticsFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Binomial value and implied volatility of each contract in an options chain:", "GME,T:C,s:20,S:25,e:+2f,E:+12f,V:80,R:4.3,Q:0,P:0", NULL, true}, false},
+
+        {"Polygon.IO", "vol_surface", "vs", "solves the implied volatility of every call and put in a stock's current options chain and fits a volatility surface for pricing with V:s; run again to update only the quotes that changed", "vol_surface <ticker>,s:<min-strike>,S:<max-strike>,e:<earliest-expiry>,E:<latest-expiry>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-share-price or 0 for latest>", volSurfaceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Implied volatility surface from an options chain:", "SPY,s:400,S:600,e:+1f,E:+12f,R:4.3,Q:1.3,P:0", NULL, true}, false},
+
         {"Polygon.IO", "price_history", "ph", "prints a stock's or option's daily price history", "price_history <ticker>,<firstDate>,<lastDate>", pioPriceHistoryFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Print the price history for a ticker:", "GME,-1y,today", NULL, true}, false},
 
         {"Polygon.IO", "price_volatility", "pv", "prints a stock's or option's volatility", "price_volatility <ticker>,<firstDate>,<lastDate>", pioVolatilityFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Print the annualized price volatility for a ticker:", "GME,-1m,today", NULL, true}, false},
+        {"Polygon.IO", "volatility_forecast", "vf", "prints EWMA and GARCH(1,1) volatility forecasts fitted to a stock's daily closes", "volatility_forecast <ticker>,<firstDate>,<lastDate>", pioVolatilityForecastFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Forecast volatility term structure from ten years of closes:", "SPY,-10y,today", NULL, true}, false},
 
-        {"Polygon.IO", "latest_price", "lp", "prints a stock's or option's latest price information", "latest_price <ticker>", pioLatestPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Latest price information for a stock:", "GME", NULL, true}, false},
+        {"Polygon.IO", "latest_price", "lp", "prints a stock's or option's latest price information", "latest_price <ticker>[,<ticker>...]", pioLatestPriceFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Latest price information for a few stocks at once:", "GME,AMC,SPY", NULL, true}, false},
 
         {"Polygon.IO", "previous_close", "pc", "prints a stock's or option's previous close", "previous_close <ticker>", pioPreviousCloseFunction, FUNCTION_CHARSTAR, FUNCTION_STATUS_CODE, {"Previous close data for a stock:", "GME", NULL, true}, false},
 
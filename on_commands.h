@@ -23,7 +23,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
-#define NCOMMANDS 31
+#define NCOMMANDS 34
 
 typedef struct commandExample
 {
@@ -25,6 +25,18 @@
 
 #define ON_SESSIONS_LOG "on_sessions_log.txt"
 #define ON_STREAMS_LOG "on_streams.txt"
+#define ON_HOLIDAYS_FILENAME "on_holidays.txt"
+#define ON_PRICE_CACHE_DIR "cache"
+
+// Concurrent REST requests, and Polygon.IO requests started per second
+// (0 for no limit; the free plan allows 5 per minute)
+#define ON_REST_MAX_CONCURRENT 8
+#define ON_PIO_REQUESTS_PER_SECOND 0.0
+
+// Seconds that slow-moving reference data is reused before it is requested again
+#define ON_FRED_SOFR_TTL (6 * 3600)
+#define ON_PIO_CONTRACTS_TTL (24 * 3600)
+#define ON_PIO_PREVIOUS_CLOSE_TTL 3600
 
 #define ON_CMD_LENGTH 1000
 
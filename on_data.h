@@ -19,6 +19,9 @@
 
 #include "on_optionstiming.h"
 
+#include <stddef.h>
+#include <time.h>
+
 typedef enum optionType
 {
     CALL = 1 << 0,
@@ -26,6 +29,22 @@ typedef enum optionType
     OTHER = 1 << 2
 } OptionType;
 
+// Daily bars, oldest first
+typedef struct {
+    size_t nPrices;
+    time_t *times;
+    double *opens;
+    double *highs;
+    double *lows;
+    double *closes;
+    double *volumes;
+    double *vwaps;
+    long *nTransactions;
+    // Set when the columns point into a read-only mapping of a price cache file
+    void *mapping;
+    size_t mappingSize;
+} PriceData;
+
 typedef struct tickerQuote
 {
     char *ticker;
@@ -77,6 +96,8 @@ typedef struct optionsData
     TickerQuote quote;
     long openInterest;
     double impliedVolatility;
+    // Shares delivered per contract, 0 if not known
+    double sharesPerContract;
 
 } OptionsData;
 
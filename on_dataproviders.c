@@ -25,6 +25,9 @@
 #include "on_optionstiming.h"
 #include "on_optionsmodels.h"
 #include "on_utilities.h"
+#include "on_config.h"
+#include "on_responsecache.h"
+#include "on_jsonstream.h"
 
 #include <string.h>
 #include <curl/curl.h>
@@ -45,43 +48,33 @@ int updateQuestradeAccessToken(ScreenState *screen)
     CURL *curl;
     CURLcode res;
 
-    char *accountNumber = loadApiToken("QUESTRADE.accountnumber");
+    const char *accountNumber = apiToken("QUESTRADE.accountnumber");
     if (accountNumber == NULL)
     {
         char *tmpAccountNumber = getpass("  Questrade account number: ");
         saveApiToken("QUESTRADE.accountnumber", tmpAccountNumber);
-        accountNumber = strdup(tmpAccountNumber);
         bzero(tmpAccountNumber, strlen(tmpAccountNumber));
+        accountNumber = apiToken("QUESTRADE.accountnumber");
+        if (accountNumber == NULL)
+            return ON_QUESTRADE_INVALID_ACCOUNT;
     }
 
     char url[URL_BUFFER_SIZE] = {0};
     snprintf(url, URL_BUFFER_SIZE, "https://api.questrade.com/v1/accounts/%s", accountNumber);
-    bzero(accountNumber, strlen(accountNumber));
-    free(accountNumber);
 
     char authorizationHeader[AUTH_HEADER_BUFFER_SIZE] = {0};
 
     int status = 0;
 
-    char *token = loadApiToken("QUESTRADE.apitoken");
+    const char *token = providerApiToken(screen, "QUESTRADE.apitoken", "  Questrade personal API token: ");
     if (token == NULL)
-    {
-        token = readInput(screen, screen->mainWindow, "  Questrade personal API token: ", ON_READINPUT_HIDDEN);
-        if (token == NULL || strlen(token) == 0)
-        {
-            free(token);
-            return ON_INVALID_TOKEN;
-        }
-        saveApiToken("QUESTRADE.apitoken", token);
-    }
+        return ON_INVALID_TOKEN;
 
     snprintf(authorizationHeader, 512, "Authorization: Bearer %s", token);
-    bzero(token, strlen(token));
-    free(token);
 
     long httpCode = 0;
 
-    curl = curl_easy_init();
+    curl = remoteSessionHandle();
     if (curl)
     {
         curl_easy_setopt(curl, CURLOPT_URL, url);
@@ -123,8 +116,8 @@ int updateQuestradeAccessToken(ScreenState *screen)
             }
         }
         /* always cleanup */
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
         curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
     }
 
     bzero(url, URL_BUFFER_SIZE);
@@ -138,26 +131,8 @@ double questradeStockQuote(ScreenState *screen, char *ticker)
     return 0.0;
 }
 
-// From libcurl c example
-size_t restCallback(char *data, size_t size, size_t nmemb, void *userdata)
-{
-    if (data == NULL || userdata == NULL)
-        return 0;
-
-    size_t realsize = size *nmemb;
-    CurlData *mem = (CurlData *)userdata;
-
-    char *ptr = realloc(mem->response, mem->size + realsize + 1);
-    if (ptr == NULL)
-        return 0;
-
-    mem->response = ptr;
-    memcpy(&(mem->response[mem->size]), data, realsize);
-    mem->size += realsize;
-    mem->response[mem->size] = 0;
-
-    return realsize;
-}
+// The request holds the API token, so the cache is keyed by name
+#define FRED_SOFR_CACHE_KEY "FRED SOFR latest observation"
 
 int fredSOFR(ScreenState *screen, double *sofr)
 {
@@ -165,26 +140,12 @@ int fredSOFR(ScreenState *screen, double *sofr)
     CURLcode res;
     char url[URL_BUFFER_SIZE] = {0};
 
-    char authorizationHeader[AUTH_HEADER_BUFFER_SIZE] = {0};
     int status = ON_OK;
+    const char *token = NULL;
 
-    char *token = loadApiToken("FRED.apitoken");
-    if (token == NULL)
-    {
-        token = readInput(screen, screen->mainWindow, "  Federal Reserve Economic Data (FRED) personal API token: ", ON_READINPUT_HIDDEN);
-        if (token == NULL || strlen(token) == 0)
-        {
-            status = ON_INVALID_TOKEN;
-            goto cleanup;
-        }
-        saveApiToken("FRED.apitoken", token);
-    }
-
-    long httpCode = 0;
-
-    curl = curl_easy_init();
-
-    CurlData data = {0};
+    // The cached body, or the session's buffer
+    char *cachedBody = NULL;
+    const char *body = NULL;
 
     json_t *root = NULL;
     json_t *entry = NULL;
@@ -193,14 +154,30 @@ int fredSOFR(ScreenState *screen, double *sofr)
     const char *rateStr = NULL;
     double rate = 0;
 
-    if (curl)
+    // The rate is published once a business day
+    cachedBody = responseCacheGet(FRED_SOFR_CACHE_KEY, ON_FRED_SOFR_TTL);
+    body = cachedBody;
+    if (cachedBody == NULL)
     {
+        token = providerApiToken(screen, "FRED.apitoken", "  Federal Reserve Economic Data (FRED) personal API token: ");
+        if (token == NULL)
+        {
+            status = ON_INVALID_TOKEN;
+            goto cleanup;
+        }
+
+        curl = remoteSessionHandle();
+        CurlData *data = remoteSessionBuffer();
+        if (curl == NULL || data == NULL)
+        {
+            status = ON_REST_LIBCURL_ERROR;
+            goto cleanup;
+        }
+
         sprintf(url, "https://api.stlouisfed.org/fred/series/observations?series_id=SOFR&limit=1&sort_order=desc&file_type=json&api_key=%s", token);
-        bzero(token, strlen(token));
 
         curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, restCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+        remoteReceiveInto(curl, data);
         bzero(url, strlen(url));
         /* Perform the request */
         res = curl_easy_perform(curl);
@@ -212,64 +189,134 @@ int fredSOFR(ScreenState *screen, double *sofr)
             status = ON_REST_LIBCURL_ERROR;
             goto cleanup;
         }
+        body = data->response;
+    }
+
+    if (body != NULL)
+    {
+        json_error_t error = {0};
+        root = json_loads(body, 0, &error);
+        if (!root)
+        {
+            if (screen != NULL)
+                print(screen, screen->mainWindow, "Could not parse FRED JSON response: line %d: text: %s\n", error.line, error.text);
+            status = ON_FRED_INVALID_JSON;
+            goto cleanup;
+        }
 
-        if (data.response != NULL)
+        json_t *observations = json_object_get(root, "observations");
+        if (!json_is_array(observations))
         {
-            json_error_t error = {0};
-            root = json_loads(data.response, 0, &error);
-            if (!root)
+            status = ON_FRED_INVALID_JSON;
+            goto cleanup;
+        }
+        for (int i = 0; i < json_array_size(observations); i++)
+        {
+            entry = json_array_get(observations, i);
+            if (!json_is_object(entry))
             {
-                if (screen != NULL)
-                    print(screen, screen->mainWindow, "Could not parse FRED JSON response: line %d: text: %s\n", error.line, error.text);
                 status = ON_FRED_INVALID_JSON;
                 goto cleanup;
             }
-
-            json_t *observations = json_object_get(root, "observations");
-            if (!json_is_array(observations))
+            date = json_string_value(json_object_get(entry, "date"));
+            rateStr = json_string_value(json_object_get(entry, "value"));
+            if (rateStr != NULL)
             {
-                status = ON_FRED_INVALID_JSON;
-                goto cleanup;
+                rate = atof(rateStr);
             }
-            for (int i = 0; i < json_array_size(observations); i++)
+            else
             {
-                entry = json_array_get(observations, i);
-                if (!json_is_object(entry))
-                {
-                    status = ON_FRED_INVALID_JSON;
-                    goto cleanup;
-                }
-                date = json_string_value(json_object_get(entry, "date"));
-                rateStr = json_string_value(json_object_get(entry, "value"));
-                if (rateStr != NULL)
-                {
-                    rate = atof(rateStr);
-                }
-                else
-                {
-                    status = ON_FRED_INVALID_JSON;
-                    rate = nan("");
-                }
-
-                if (sofr != NULL)
-                    *sofr = rate;                
-                if (screen != NULL)
-                    print(screen, screen->mainWindow, "  FRED SOFR on %s: %g%%\n", date, rate);
+                status = ON_FRED_INVALID_JSON;
+                rate = nan("");
             }
-        }
 
-    cleanup:
-        json_decref(root);
-        free(data.response);
-        curl_easy_cleanup(curl);
+            if (sofr != NULL)
+                *sofr = rate;                
+            if (screen != NULL)
+                print(screen, screen->mainWindow, "  FRED SOFR on %s: %g%%\n", date, rate);
+        }
+        if (cachedBody == NULL && status == ON_OK && json_array_size(observations) > 0)
+            responseCachePut(FRED_SOFR_CACHE_KEY, body);
     }
 
-    bzero(token, strlen(token));
-    free(token);
+cleanup:
+    json_decref(root);
+    free(cachedBody);
 
     return status;
 }
 
+const char *providerApiToken(ScreenState *screen, const char *name, const char *prompt)
+{
+    const char *token = apiToken(name);
+    if (token != NULL || screen == NULL)
+        return token;
+
+    char *entered = readInput(screen, screen->mainWindow, (char *)prompt, ON_READINPUT_HIDDEN);
+    if (entered != NULL && strlen(entered) > 0)
+    {
+        saveApiToken((char *)name, entered);
+        token = apiToken(name);
+    }
+    if (entered != NULL)
+    {
+        bzero(entered, strlen(entered));
+        free(entered);
+    }
+
+    return token;
+}
+
+static void polygonIoAuthorizedUrl(const char *requestUrl, const char *token, char *url)
+{
+    unsigned char join = strchr(requestUrl, '?') != NULL ? '&' : '?';
+    snprintf(url, URL_BUFFER_SIZE, "%s%capiKey=%s", requestUrl, join, token);
+
+    return;
+}
+
+// Parsed response, or NULL with the reason printed
+static json_t *polygonIoParseResponse(ScreenState *screen, const CurlData *data)
+{
+    if (data->response == NULL)
+        return NULL;
+
+    json_error_t error = {0};
+    json_t *root = json_loads(data->response, 0, &error);
+    if (!root)
+    {
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Could not parse Polygon.IO JSON response: line %d: text: %s\n", error.line, error.text);
+        return NULL;
+    }
+    else if (!json_is_object(root))
+    {
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Invalid JSON response from Polygon.IO.\n");
+        json_decref(root);
+        return NULL;
+    }
+    const char *jsonstatus = json_string_value(json_object_get(root, "status"));
+    if (jsonstatus != NULL && strcmp("ERROR", jsonstatus) == 0)
+    {
+        const char *msg = json_string_value(json_object_get(root, "error"));
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Polygon.IO: %s\n", msg);
+        json_decref(root);
+        return NULL;
+    }
+    else if (jsonstatus != NULL && strcmp("NOT_AUTHORIZED", jsonstatus) == 0)
+    {
+        const char *msg = json_string_value(json_object_get(root, "message"));
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Polygon.IO: %s\n", msg);
+        json_decref(root);
+        return NULL;
+    }
+
+    return root;
+}
+
 json_t *polygonIoRESTRequest(ScreenState *screen, const char *requestUrl)
 {
     json_t *root = NULL;
@@ -277,43 +324,20 @@ json_t *polygonIoRESTRequest(ScreenState *screen, const char *requestUrl)
     CURLcode res;
     char url[URL_BUFFER_SIZE] = {0};
 
-    int status = 0;
-
-    char *token = loadApiToken("PIO.apitoken");
+    const char *token = providerApiToken(screen, "PIO.apitoken", PIO_TOKEN_PROMPT);
     if (token == NULL)
-    {
-        token = readInput(screen, screen->mainWindow, "  Polygon.IO (PIO) personal API token: ", ON_READINPUT_HIDDEN);
-        if (token == NULL || strlen(token) == 0)
-        {
-            free(token);
-            return NULL;
-        }
-        saveApiToken("PIO.apitoken", token);
-    }
-
-    long httpCode = 0;
+        return NULL;
 
-    curl = curl_easy_init();
+    curl = remoteSessionHandle();
 
-    struct curlData data = {0};
+    CurlData *data = remoteSessionBuffer();
 
-    unsigned char join = '?';
-    for (int i = 0; i < strlen(requestUrl); i++)
-        if (requestUrl[i] == '?')
-        {
-            join = '&';
-            break;
-        }
-
-    if (curl)
+    if (curl && data)
     {
-        sprintf(url, "%s%capiKey=%s", requestUrl, join, token);
-        bzero(token, strlen(token));
-        // print(screen, screen->mainWindow, "url:\n%s\n", url);
+        polygonIoAuthorizedUrl(requestUrl, token, url);
         curl_easy_setopt(curl, CURLOPT_URL, url);
         bzero(url, strlen(url));
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, restCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+        remoteReceiveInto(curl, data);
         /* Perform the request */
         res = curl_easy_perform(curl);
         /* Check for errors */
@@ -321,60 +345,420 @@ json_t *polygonIoRESTRequest(ScreenState *screen, const char *requestUrl)
         {
             if (screen != NULL && screen->statusWindow != NULL)
                 mvwprintw(screen->statusWindow, 0, 0, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-            goto cleanup;
         }
+        else
+            root = polygonIoParseResponse(screen, data);
+    }
+
+    return root;
+}
+
+json_t *polygonIoCachedRESTRequest(ScreenState *screen, const char *requestUrl, double ttlSeconds)
+{
+    char *body = responseCacheGet(requestUrl, ttlSeconds);
+    if (body != NULL)
+    {
+        json_t *root = json_loads(body, 0, NULL);
+        free(body);
+        if (json_is_object(root))
+            return root;
+        json_decref(root);
+    }
+
+    json_t *root = polygonIoRESTRequest(screen, requestUrl);
+    if (root != NULL)
+    {
+        char *dump = json_dumps(root, JSON_COMPACT);
+        if (dump != NULL)
+            responseCachePut(requestUrl, dump);
+        free(dump);
+    }
+
+    return root;
+}
+
+int polygonIoRESTRequests(ScreenState *screen, const char **requestUrls, size_t nRequests, json_t **roots)
+{
+    if (requestUrls == NULL || roots == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    for (size_t i = 0; i < nRequests; i++)
+        roots[i] = NULL;
+    if (nRequests == 0)
+        return ON_OK;
+
+    const char *token = providerApiToken(screen, "PIO.apitoken", PIO_TOKEN_PROMPT);
+    if (token == NULL)
+        return ON_INVALID_TOKEN;
 
-        if (data.response != NULL)
+    RemoteRequest *requests = calloc(nRequests, sizeof *requests);
+    char *urls = calloc(nRequests, URL_BUFFER_SIZE);
+    if (requests == NULL || urls == NULL)
+    {
+        free(requests);
+        free(urls);
+        return ON_HEAP_MEMORY_ERROR;
+    }
+    for (size_t i = 0; i < nRequests; i++)
+    {
+        polygonIoAuthorizedUrl(requestUrls[i], token, urls + i * URL_BUFFER_SIZE);
+        requests[i].url = urls + i * URL_BUFFER_SIZE;
+    }
+
+    int status = remotePerformAll(requests, nRequests, ON_REST_MAX_CONCURRENT, ON_PIO_REQUESTS_PER_SECOND);
+    bzero(urls, nRequests * URL_BUFFER_SIZE);
+    free(urls);
+
+    for (size_t i = 0; i < nRequests; i++)
+    {
+        if (requests[i].status == ON_OK)
+            roots[i] = polygonIoParseResponse(screen, &requests[i].response);
+        else if (screen != NULL && screen->statusWindow != NULL)
+            mvwprintw(screen->statusWindow, 0, 0, "Request %zu of %zu failed\n", i + 1, nRequests);
+        curlDataFree(&requests[i].response);
+    }
+    free(requests);
+
+    return status;
+}
+
+
+// A Polygon.IO response read as it arrives: the members outside "results" are
+// kept, and the events for each entry of "results" go to onEntry
+typedef struct pioStream {
+    ScreenState *screen;
+    JsonStreamCallback onEntry;
+    void *userdata;
+    char status[32];
+    char error[256];
+    char message[256];
+    char *nextUrl;
+    long resultsCount;
+    bool hasResults;
+    size_t nResults;
+    // Copy of the response, only if it is to be cached
+    CurlData *raw;
+} PioStream;
+
+static void copyStreamString(char *to, size_t size, const char *value, size_t length)
+{
+    snprintf(to, size, "%.*s", (int)(length < size ? length : size - 1), value);
+
+    return;
+}
+
+static int pioStreamEvent(const JsonStream *stream, JsonStreamEvent event, const char *value, size_t length, void *userdata)
+{
+    PioStream *pio = (PioStream *)userdata;
+
+    if (stream->depth == 0)
+        return event == JSON_STREAM_OBJECT_START || event == JSON_STREAM_OBJECT_END ? ON_OK : ON_PIO_REST_INVALID_JSON;
+
+    const char *key = jsonStreamKey(stream, 0);
+    if (strcmp(key, "results") == 0)
+    {
+        if (stream->depth == 1)
         {
-            int size = data.size;
-            // print(screen, screen->mainWindow, "Polygon.io response:\n%s\n", data.response);
-            json_error_t error = {0};
-            root = json_loads(data.response, 0, &error);
-            if (!root)
-            {
-                if (screen != NULL)
-                    print(screen, screen->mainWindow, "Could not parse Polygon.IO JSON response: line %d: text: %s\n", error.line, error.text);
-                goto cleanup;
-            }
-            else if (!json_is_object(root))
-            {
-                if (screen != NULL)
-                    print(screen, screen->mainWindow, "Invalid JSON response from Polygon.IO.\n");
-                json_decref(root);
-                root = NULL;
-                goto cleanup;
-            }
-            char *jsonstatus = (char *)json_string_value(json_object_get(root, "status"));
-            if (strcmp("ERROR", jsonstatus) == 0)
+            if (event == JSON_STREAM_ARRAY_START)
+                pio->hasResults = true;
+            return ON_OK;
+        }
+        if (stream->depth == 2)
+        {
+            if (event != JSON_STREAM_OBJECT_START && event != JSON_STREAM_OBJECT_END)
             {
-                char *msg = (char *)json_string_value(json_object_get(root, "error"));
-                if (screen != NULL)
-                    print(screen, screen->mainWindow, "Polygon.IO: %s\n", msg);
-                json_decref(root);
-                root = NULL;
-                goto cleanup;
-            }
-            else if (strcmp("NOT_AUTHORIZED", jsonstatus) == 0)
-            {
-                char *msg = (char *)json_string_value(json_object_get(root, "message"));
-                if (screen != NULL)
-                    print(screen, screen->mainWindow, "Polygon.IO: %s\n", msg);
-                json_decref(root);
-                root = NULL;
-                goto cleanup;
+                if (pio->screen != NULL)
+                    print(pio->screen, pio->screen->mainWindow, "Invalid JSON entry %zu\n", pio->nResults);
+                return ON_PIO_REST_INVALID_JSON;
             }
+            if (event == JSON_STREAM_OBJECT_START)
+                pio->nResults++;
         }
-cleanup:
-        curl_easy_cleanup(curl);
-        free(data.response);
+        return pio->onEntry != NULL ? pio->onEntry(stream, event, value, length, pio->userdata) : ON_OK;
     }
+    if (stream->depth > 1)
+        return ON_OK;
 
-    bzero(token, strlen(token));
-    free(token);
+    if (event == JSON_STREAM_STRING)
+    {
+        if (strcmp(key, "status") == 0)
+            copyStreamString(pio->status, sizeof pio->status, value, length);
+        else if (strcmp(key, "error") == 0)
+            copyStreamString(pio->error, sizeof pio->error, value, length);
+        else if (strcmp(key, "message") == 0)
+            copyStreamString(pio->message, sizeof pio->message, value, length);
+        else if (strcmp(key, "next_url") == 0 && length > 0)
+        {
+            free(pio->nextUrl);
+            pio->nextUrl = strdup(value);
+            if (pio->nextUrl == NULL)
+                return ON_HEAP_MEMORY_ERROR;
+        }
+    }
+    else if (event == JSON_STREAM_NUMBER && strcmp(key, "resultsCount") == 0)
+        pio->resultsCount = strtol(value, NULL, 10);
 
-    return root;
+    return ON_OK;
+}
+
+static size_t pioStreamCallback(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    JsonStream *stream = (JsonStream *)userdata;
+    PioStream *pio = (PioStream *)stream->userdata;
+    size_t realsize = size * nmemb;
+
+    if (pio->raw != NULL && curlDataAppend(pio->raw, data, realsize) != ON_OK)
+        return 0;
+    if (jsonStreamFeed(stream, data, realsize) != ON_OK)
+        return 0;
+
+    return realsize;
+}
+
+// Parses the response to requestUrl into pio while it downloads, without
+// holding the document in memory. A response cached no more than ttlSeconds ago
+// is used instead, and a new one is cached, if ttlSeconds is positive.
+// Free pio->nextUrl afterward.
+static int polygonIoStreamRequest(ScreenState *screen, const char *requestUrl, double ttlSeconds, PioStream *pio)
+{
+    JsonStream stream;
+    jsonStreamInit(&stream, pioStreamEvent, pio);
+    pio->screen = screen;
+    pio->raw = NULL;
+    int status = ON_OK;
+
+    char *body = ttlSeconds > 0.0 ? responseCacheGet(requestUrl, ttlSeconds) : NULL;
+    if (body != NULL)
+    {
+        jsonStreamFeed(&stream, body, strlen(body));
+        status = jsonStreamFinish(&stream);
+        free(body);
+    }
+    else
+    {
+        const char *token = providerApiToken(screen, "PIO.apitoken", PIO_TOKEN_PROMPT);
+        if (token == NULL)
+            return ON_INVALID_TOKEN;
+        CURL *curl = remoteSessionHandle();
+        if (curl == NULL)
+            return ON_REST_LIBCURL_ERROR;
+
+        // Reused between requests, so keeping a copy costs nothing once warm
+        if (ttlSeconds > 0.0)
+            pio->raw = remoteSessionBuffer();
+        char url[URL_BUFFER_SIZE] = {0};
+        polygonIoAuthorizedUrl(requestUrl, token, url);
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        bzero(url, strlen(url));
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, pioStreamCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+        CURLcode res = curl_easy_perform(curl);
+        // The write callback stops the transfer if parsing fails
+        status = jsonStreamFinish(&stream);
+        if (res != CURLE_OK && res != CURLE_WRITE_ERROR)
+        {
+            if (screen != NULL && screen->statusWindow != NULL)
+                mvwprintw(screen->statusWindow, 0, 0, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+            status = ON_REST_LIBCURL_ERROR;
+        }
+        else if (status == ON_OK && pio->raw != NULL && pio->raw->response != NULL && strcmp(pio->status, "ERROR") != 0 && strcmp(pio->status, "NOT_AUTHORIZED") != 0)
+            responseCachePut(requestUrl, pio->raw->response);
+        pio->raw = NULL;
+    }
+
+    if (status == ON_PARSE_INVALID_JSON || status == ON_PIO_REST_INVALID_JSON)
+    {
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Invalid JSON response from Polygon.IO.\n");
+    }
+    else if (status == ON_OK && strcmp(pio->status, "ERROR") == 0)
+    {
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Polygon.IO: %s\n", pio->error);
+        status = ON_PIO_INVALID_RESPONSE;
+    }
+    else if (status == ON_OK && strcmp(pio->status, "NOT_AUTHORIZED") == 0)
+    {
+        if (screen != NULL)
+            print(screen, screen->mainWindow, "Polygon.IO: %s\n", pio->message);
+        status = ON_PIO_INVALID_RESPONSE;
+    }
+
+    return status;
+}
+
+// Passes the next page's URL on to *nextPagePtr
+static void polygonIoNextPage(PioStream *pio, char **nextPagePtr)
+{
+    if (nextPagePtr != NULL)
+    {
+        free(*nextPagePtr);
+        *nextPagePtr = pio->nextUrl;
+    }
+    else
+        free(pio->nextUrl);
+    pio->nextUrl = NULL;
+
+    return;
 }
 
+// The fields of an options contract entry that we use
+typedef struct pioContractEntry {
+    char ticker[PIO_TICKER_LENGTH];
+    char expiry[PIO_DATE_LENGTH];
+    double strike;
+    double openInterest;
+    double bid;
+    double ask;
+    double close;
+    double volume;
+    double underlyingPrice;
+    double sharesPerContract;
+} PioContractEntry;
+
+typedef struct contractsSearchPage {
+    ScreenState *screen;
+    bool printHeader;
+    double prevStrike;
+    PioContractEntry entry;
+} ContractsSearchPage;
+
+static int contractsSearchEvent(const JsonStream *stream, JsonStreamEvent event, const char *value, size_t length, void *userdata)
+{
+    ContractsSearchPage *page = (ContractsSearchPage *)userdata;
+    PioContractEntry *entry = &page->entry;
+
+    if (stream->depth == 2 && event == JSON_STREAM_OBJECT_START)
+    {
+        memset(entry, 0, sizeof *entry);
+        if (page->printHeader)
+            print(page->screen, page->screen->mainWindow, "%15s   %8s   %s\n", "Expiry date", "Strike", "Ticker");
+        page->printHeader = false;
+    }
+    else if (stream->depth == 2 && event == JSON_STREAM_OBJECT_END)
+    {
+        if (entry->strike != page->prevStrike)
+            print(page->screen, page->screen->mainWindow, "\n");
+        print(page->screen, page->screen->mainWindow, "%8.2lf %15s   %s\n", entry->strike, entry->expiry, entry->ticker);
+        page->prevStrike = entry->strike;
+    }
+    else if (stream->depth == 3)
+    {
+        const char *key = jsonStreamKey(stream, 2);
+        if (event == JSON_STREAM_STRING && strcmp(key, "ticker") == 0)
+            copyStreamString(entry->ticker, sizeof entry->ticker, value, length);
+        else if (event == JSON_STREAM_STRING && strcmp(key, "expiration_date") == 0)
+            copyStreamString(entry->expiry, sizeof entry->expiry, value, length);
+        else if (event == JSON_STREAM_NUMBER && strcmp(key, "strike_price") == 0)
+            entry->strike = strtod(value, NULL);
+    }
+
+    return ON_OK;
+}
+
+typedef struct optionsChainPage {
+    ScreenState *screen;
+    OptionType type;
+    double minpremium;
+    bool printHeader;
+    double prevStrike;
+    // Where to add the contracts instead of printing them, if not NULL
+    OptionsChain *chain;
+    PioContractEntry entry;
+} OptionsChainPage;
+
+static int optionsChainEntryDone(OptionsChainPage *page)
+{
+    PioContractEntry *entry = &page->entry;
+    if (!(entry->bid >= page->minpremium || entry->ask >= page->minpremium || entry->close >= page->minpremium))
+        return ON_OK;
+
+    if (page->chain == NULL)
+    {
+        if (entry->strike != page->prevStrike)
+            print(page->screen, page->screen->mainWindow, "\n");
+        print(page->screen, page->screen->mainWindow, "%8.2lf %15s %.3lf %.3lf %.3lf  %s %7.0lf / %.0lf \n", entry->strike, entry->expiry, entry->bid, entry->ask, entry->close, entry->ticker, entry->volume, entry->openInterest);
+        page->prevStrike = entry->strike;
+        return ON_OK;
+    }
+
+    OptionsData contract = {0};
+    contract.ticker = strdup(entry->ticker);
+    if (contract.ticker == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    contract.type = page->type;
+    contract.strike = entry->strike;
+    if (entry->expiry[0] != '\0')
+        interpretDate(entry->expiry, &contract.expiry);
+    contract.quote.bid = entry->bid;
+    contract.quote.ask = entry->ask;
+    contract.quote.midpoint = 0.5 * (entry->bid + entry->ask);
+    contract.tickerData.close = entry->close;
+    contract.tickerData.volume = entry->volume;
+    contract.openInterest = (long)entry->openInterest;
+    contract.underlyingTickerData.close = entry->underlyingPrice;
+    contract.sharesPerContract = entry->sharesPerContract;
+    int status = optionsChainAppend(page->chain, &contract);
+    if (status != ON_OK)
+        free(contract.ticker);
+
+    return status;
+}
+
+static int optionsChainEvent(const JsonStream *stream, JsonStreamEvent event, const char *value, size_t length, void *userdata)
+{
+    OptionsChainPage *page = (OptionsChainPage *)userdata;
+    PioContractEntry *entry = &page->entry;
+
+    if (stream->depth == 2 && event == JSON_STREAM_OBJECT_START)
+    {
+        memset(entry, 0, sizeof *entry);
+        if (page->printHeader)
+            print(page->screen, page->screen->mainWindow, "%10s %8s %s %s %s %s %s %s\n", "Strike", "Expiry", "Bid", "Ask", "Last", "Volume", "OI", "Ticker");
+        page->printHeader = false;
+    }
+    else if (stream->depth == 2 && event == JSON_STREAM_OBJECT_END)
+        return optionsChainEntryDone(page);
+    else if (stream->depth == 3 && event == JSON_STREAM_NUMBER && strcmp(jsonStreamKey(stream, 2), "open_interest") == 0)
+        entry->openInterest = strtod(value, NULL);
+    else if (stream->depth == 4 && (event == JSON_STREAM_NUMBER || event == JSON_STREAM_STRING))
+    {
+        const char *group = jsonStreamKey(stream, 2);
+        const char *key = jsonStreamKey(stream, 3);
+        if (key == NULL)
+            return ON_OK;
+        double number = event == JSON_STREAM_NUMBER ? strtod(value, NULL) : 0.0;
+        if (strcmp(group, "details") == 0)
+        {
+            if (strcmp(key, "ticker") == 0)
+                copyStreamString(entry->ticker, sizeof entry->ticker, value, length);
+            else if (strcmp(key, "expiration_date") == 0)
+                copyStreamString(entry->expiry, sizeof entry->expiry, value, length);
+            else if (strcmp(key, "strike_price") == 0)
+                entry->strike = number;
+            else if (strcmp(key, "shares_per_contract") == 0)
+                entry->sharesPerContract = number;
+        }
+        else if (strcmp(group, "last_quote") == 0)
+        {
+            if (strcmp(key, "bid") == 0)
+                entry->bid = number;
+            else if (strcmp(key, "ask") == 0)
+                entry->ask = number;
+        }
+        else if (strcmp(group, "day") == 0)
+        {
+            if (strcmp(key, "close") == 0)
+                entry->close = number;
+            else if (strcmp(key, "volume") == 0)
+                entry->volume = number;
+        }
+        else if (strcmp(group, "underlying_asset") == 0 && strcmp(key, "price") == 0)
+            entry->underlyingPrice = number;
+    }
+
+    return ON_OK;
+}
 
 int polygonIoOptionsSearch(ScreenState *screen, char *ticker, char type, double minstrike, double maxstrike, Date date1, Date date2, bool expired, char **nextPagePtr)
 {
@@ -400,65 +784,28 @@ int polygonIoOptionsSearch(ScreenState *screen, char *ticker, char type, double
         sprintf(url, "https://api.polygon.io/v3/reference/options/contracts?underlying_ticker=%s&contract_type=%s&expiration_date.gte=%d-%02d-%02d&expiration_date.lte=%d-%02d-%02d&strike_price.gte=%.3lf&strike_price.lte=%.3lf&expired=%s&sort=strike_price&limit=250", ticker, type == 'C' ? "call" : "put", date1.year, date1.month, date1.day, date2.year, date2.month, date2.day, minstrike, maxstrike, expired ? "true" : "false");
     }
 
-    json_t *root = polygonIoRESTRequest(screen, url);
-    if (root == NULL)
-        return ON_PIO_REST_NO_JSON_ROOT;
-
-    json_t *results = json_object_get(root, "results");
-    if (results == NULL)
+    ContractsSearchPage page = {.screen = screen, .printHeader = !continuedSearch};
+    PioStream pio = {.onEntry = contractsSearchEvent, .userdata = &page};
+    status = polygonIoStreamRequest(screen, url, ON_PIO_CONTRACTS_TTL, &pio);
+    if (status != ON_OK)
+    {
+        free(pio.nextUrl);
+        return status;
+    }
+    polygonIoNextPage(&pio, nextPagePtr);
+    if (!pio.hasResults)
         return ON_PIO_REST_NO_JSON_RESULTS;
-
-    time_t t = 0;
-
-    char *optionTicker = NULL;
-    double strike = 0;
-    double prevStrike = 0;
-
-    char *expiry = NULL;
-    json_t *entry;
-    if (!json_is_array(results) || json_array_size(results) == 0)
+    if (pio.nResults == 0)
     {
         print(screen, screen->mainWindow, "No data from Polygon.IO.\n");
-        json_decref(root);
         return ON_PIO_REST_JSON_NO_ARRAY_ENTRY;
     }
-    if (!continuedSearch)
-        print(screen, screen->mainWindow, "%15s   %8s   %s\n", "Expiry date", "Strike", "Ticker");
-    for (int i = 0; i < json_array_size(results); i++)
-    {
-        entry = json_array_get(results, i);
-        if (!json_is_object(entry))
-        {
-            print(screen, screen->mainWindow, "Invalid JSON entry %d\n", i);
-            json_decref(root);
-            return ON_PIO_REST_INVALID_JSON;
-        }
-        optionTicker = (char *)json_string_value(json_object_get(entry, "ticker"));
-        strike = json_number_value(json_object_get(entry, "strike_price"));
-        expiry = (char *)json_string_value(json_object_get(entry, "expiration_date"));
-        if (strike != prevStrike)
-            print(screen, screen->mainWindow, "\n");
-        print(screen, screen->mainWindow, "%8.2lf %15s   %s\n", strike, expiry, optionTicker);
-        prevStrike = strike;
-        
-    }
-    char *nextUrl = (char *)json_string_value(json_object_get(root, "next_url"));
-    if (nextUrl != NULL && strlen(nextUrl) > 0 && nextPagePtr != NULL)
-        *nextPagePtr = strdup(nextUrl);
-    else
-    {
-        if (nextPagePtr != NULL)
-        {
-            free(*nextPagePtr);
-            *nextPagePtr = NULL;
-        }
-    }
-    json_decref(root);
 
     return ON_OK;
 }
 
-int polygonIoOptionsChain(ScreenState *screen, char *ticker, char type, double minstrike, double maxstrike, Date date1, Date date2, double minpremium, char **nextPagePtr)
+// Prints one page of the chain, or merges its contracts into chain if it is not NULL
+int polygonIoOptionsChain(ScreenState *screen, char *ticker, char type, double minstrike, double maxstrike, Date date1, Date date2, double minpremium, char **nextPagePtr, OptionsChain *chain)
 {
 
     if (screen == NULL)
@@ -471,16 +818,6 @@ int polygonIoOptionsChain(ScreenState *screen, char *ticker, char type, double m
 
     bool continuedSearch = false;
 
-    char *optionTicker = NULL;
-    double strike = 0;
-    char *expiry = NULL;
-    double bid = 0;
-    double ask = 0;
-    double close = 0;
-    double openInterest = 0;
-    double prevStrike = 0;
-    double volume = 0;
-
     if (nextPagePtr != NULL && *nextPagePtr != NULL)
     {
         sprintf(url, "%s", *nextPagePtr);
@@ -491,86 +828,43 @@ int polygonIoOptionsChain(ScreenState *screen, char *ticker, char type, double m
     else
         sprintf(url, "https://api.polygon.io/v3/snapshot/options/%s?contract_type=%s&expiration_date.gte=%d-%02d-%02d&expiration_date.lte=%d-%02d-%02d&strike_price.gte=%.3lf&strike_price.lte=%.3lf&sort=strike_price&order=asc&limit=250", ticker, type == 'C' ? "call" : "put", date1.year, date1.month, date1.day, date2.year, date2.month, date2.day, minstrike, maxstrike);
 
-    json_t *root = polygonIoRESTRequest(screen, url);
-    if (root == NULL)
-        return ON_PIO_REST_NO_JSON_ROOT;
-
-    json_t *results = json_object_get(root, "results");
-    if (results == NULL)
-        return ON_PIO_REST_NO_JSON_RESULTS;
-
-    time_t t = 0;
-
-    json_t *entry;
-    if (!json_is_array(results) || json_array_size(results) == 0)
+    // Contracts are decoded as the page arrives rather than from a parsed document
+    OptionsChainPage page = {
+        .screen = screen,
+        .type = type == 'C' ? CALL : PUT,
+        .minpremium = minpremium,
+        .printHeader = !continuedSearch && chain == NULL,
+        .chain = chain
+    };
+    PioStream pio = {.onEntry = optionsChainEvent, .userdata = &page};
+    int status = polygonIoStreamRequest(screen, url, 0.0, &pio);
+    // Whatever arrived is put in order, so the chain stays usable
+    if (chain != NULL)
     {
-        print(screen, screen->mainWindow, "No data from Polygon.IO.\n");
-        json_decref(root);
-        return ON_PIO_REST_JSON_NO_ARRAY_ENTRY;
+        int sortStatus = optionsChainSort(chain);
+        if (status == ON_OK)
+            status = sortStatus;
     }
-    if (!continuedSearch)
-        print(screen, screen->mainWindow, "%10s %8s %s %s %s %s %s %s\n", "Strike", "Expiry", "Bid", "Ask", "Last", "Volume", "OI", "Ticker");
-
-    json_t *details = NULL;
-    json_t *quote = NULL;
-    json_t *dayInfo = NULL;
-    for (int i = 0; i < json_array_size(results); i++)
+    if (status != ON_OK)
     {
-        entry = json_array_get(results, i);
-        if (!json_is_object(entry))
-        {
-            print(screen, screen->mainWindow, "Invalid JSON entry %d\n", i);
-            json_decref(root);
-            return ON_PIO_REST_INVALID_JSON;
-        }
-        details = json_object_get(entry, "details");
-        optionTicker = (char *)json_string_value(json_object_get(details, "ticker"));
-        strike = json_number_value(json_object_get(details, "strike_price"));
-        expiry = (char *)json_string_value(json_object_get(details, "expiration_date"));
-        openInterest = json_number_value(json_object_get(entry, "open_interest"));
-        quote = json_object_get(entry, "last_quote");
-        bid = json_number_value(json_object_get(quote, "bid"));
-        ask = json_number_value(json_object_get(quote, "ask"));
-        dayInfo = json_object_get(entry, "day");
-        close = json_number_value(json_object_get(dayInfo, "close"));
-        volume = json_number_value(json_object_get(dayInfo, "volume"));
-        if (bid >= minpremium || ask >= minpremium || close >= minpremium)
-        {
-            if (strike != prevStrike)
-                print(screen, screen->mainWindow, "\n");
-            print(screen, screen->mainWindow, "%8.2lf %15s %.3lf %.3lf %.3lf  %s %7.0lf / %.0lf \n", strike, expiry, bid, ask, close, optionTicker, volume, openInterest);
-            prevStrike = strike;
-        }
+        free(pio.nextUrl);
+        return status;
     }
-    char *nextUrl = (char *)json_string_value(json_object_get(root, "next_url"));
-    if (nextUrl != NULL && strlen(nextUrl) > 0 && nextPagePtr != NULL)
-        *nextPagePtr = strdup(nextUrl);
-    else
+    polygonIoNextPage(&pio, nextPagePtr);
+    if (!pio.hasResults)
+        return ON_PIO_REST_NO_JSON_RESULTS;
+    if (pio.nResults == 0)
     {
-        if (nextPagePtr != NULL)
-        {
-            free(*nextPagePtr);
-            *nextPagePtr = NULL;
-        }
+        print(screen, screen->mainWindow, "No data from Polygon.IO.\n");
+        return ON_PIO_REST_JSON_NO_ARRAY_ENTRY;
     }
 
-    json_decref(root);
-
     return ON_OK;
 }
 
-int polygonIoLatestPrice(ScreenState *screen, char *ticker, TickerData *tickerData, OptionsData *optionsData, bool verbose)
+// Snapshot URL for a stock, option (O:), forex (C:) or crypto (X:) ticker
+static int polygonIoSnapshotUrl(const char *ticker, char *url)
 {
-    // Maybe later this will return data to the caller, but 
-    // for now only prints to screen, so require a screen
-    if (screen == NULL)
-        return ON_NO_SCREEN;
-
-    if (ticker == NULL)
-        return ON_PIO_NO_TICKER_ARG;
-
-    char url[URL_BUFFER_SIZE] = {0};
-
     int market = STOCKS;
 
     if (strncmp("O:", ticker, 2) == 0)
@@ -582,39 +876,107 @@ int polygonIoLatestPrice(ScreenState *screen, char *ticker, TickerData *tickerDa
             p++;
         if (p != underlying + strlen(underlying))
             *p = '\0';
-        sprintf(url, "https://api.polygon.io/v3/snapshot/options/%s/%s", underlying, ticker);
+        snprintf(url, URL_BUFFER_SIZE, "https://api.polygon.io/v3/snapshot/options/%s/%s", underlying, ticker);
         free(underlying);
     }
     else if (strncmp("C:", ticker, 2) == 0)
     {
         market = FOREX;
-        sprintf(url, "https://api.polygon.io/v2/snapshot/locale/global/markets/forex/tickers/%s", ticker);
+        snprintf(url, URL_BUFFER_SIZE, "https://api.polygon.io/v2/snapshot/locale/global/markets/forex/tickers/%s", ticker);
     }
     else if (strncmp("X:", ticker, 2) == 0)
     {
         market = CRYPTO;
-        sprintf(url, "https://api.polygon.io/v2/snapshot/locale/global/markets/crypto/tickers/%s", ticker);
+        snprintf(url, URL_BUFFER_SIZE, "https://api.polygon.io/v2/snapshot/locale/global/markets/crypto/tickers/%s", ticker);
     }
     else
-        sprintf(url, "https://api.polygon.io/v2/snapshot/locale/us/markets/stocks/tickers/%s", ticker);
+        snprintf(url, URL_BUFFER_SIZE, "https://api.polygon.io/v2/snapshot/locale/us/markets/stocks/tickers/%s", ticker);
+
+    return market;
+}
+
+static int printLatestPrice(ScreenState *screen, int market, json_t *root)
+{
+    switch(market)
+    {
+        case STOCKS:
+            return printLatestPriceStocks(screen, root);
+        case OPTIONS:
+            return printLatestPriceOptions(screen, root);
+    }
+
+    return ON_OK;
+}
+
+int polygonIoLatestPrice(ScreenState *screen, char *ticker, TickerData *tickerData, OptionsData *optionsData, bool verbose)
+{
+    // Maybe later this will return data to the caller, but 
+    // for now only prints to screen, so require a screen
+    if (screen == NULL)
+        return ON_NO_SCREEN;
+
+    if (ticker == NULL)
+        return ON_PIO_NO_TICKER_ARG;
+
+    char url[URL_BUFFER_SIZE] = {0};
+    int market = polygonIoSnapshotUrl(ticker, url);
 
     json_t *root = polygonIoRESTRequest(screen, url);
     if (root == NULL)
         return ON_PIO_REST_NO_JSON_ROOT;
 
+    int status = printLatestPrice(screen, market, root);
+
+    json_decref(root);
+
+    return status;
+}
+
+int polygonIoLatestPrices(ScreenState *screen, char **tickers, size_t nTickers)
+{
+    if (screen == NULL)
+        return ON_NO_SCREEN;
+
+    if (tickers == NULL)
+        return ON_PIO_NO_TICKER_ARG;
+
+    char *urls = calloc(nTickers, URL_BUFFER_SIZE);
+    const char **requestUrls = calloc(nTickers, sizeof *requestUrls);
+    int *markets = calloc(nTickers, sizeof *markets);
+    json_t **roots = calloc(nTickers, sizeof *roots);
     int status = ON_OK;
+    if (urls == NULL || requestUrls == NULL || markets == NULL || roots == NULL)
+    {
+        status = ON_HEAP_MEMORY_ERROR;
+        goto cleanup;
+    }
 
-    switch(market)
+    for (size_t i = 0; i < nTickers; i++)
     {
-        case STOCKS:
-            status = printLatestPriceStocks(screen, root);
-            break;
-        case OPTIONS:
-            status = printLatestPriceOptions(screen, root);
-            break;
+        markets[i] = polygonIoSnapshotUrl(tickers[i], urls + i * URL_BUFFER_SIZE);
+        requestUrls[i] = urls + i * URL_BUFFER_SIZE;
     }
 
-    json_decref(root);
+    // All at once, then printed in the order given
+    status = polygonIoRESTRequests(screen, requestUrls, nTickers, roots);
+    for (size_t i = 0; i < nTickers; i++)
+    {
+        if (roots[i] == NULL)
+        {
+            print(screen, screen->mainWindow, "%5s: no data\n", tickers[i]);
+            continue;
+        }
+        int printStatus = printLatestPrice(screen, markets[i], roots[i]);
+        if (printStatus != ON_OK && status == ON_OK)
+            status = printStatus;
+        json_decref(roots[i]);
+    }
+
+cleanup:
+    free(urls);
+    free(requestUrls);
+    free(markets);
+    free(roots);
 
     return status;
 }
@@ -697,7 +1059,7 @@ int printLatestPriceOptions(ScreenState *screen, json_t *root)
     Date expiryDate = {0};
     interpretDate(expiry, &expiryDate);
     int daysLeft = tradingDaysToExpiry(expiryDate);
-    double yearsLeft = (double)daysLeft / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
+    double yearsLeft = tradingYearsToExpiry(expiryDate);
 
     double close = 0.0;
     double volume = 0.0;
@@ -775,7 +1137,7 @@ int polygonIoPreviousClose(ScreenState *screen, char *ticker, double *previousCl
     char url[URL_BUFFER_SIZE] = {0};
     sprintf(url, "https://api.polygon.io/v2/aggs/ticker/%s/prev?adjusted=true", ticker);
 
-    json_t *root = polygonIoRESTRequest(screen, url);
+    json_t *root = polygonIoCachedRESTRequest(screen, url, ON_PIO_PREVIOUS_CLOSE_TTL);
 
     json_t *results = json_object_get(root, "results");
     int nResults = json_integer_value(json_object_get(root, "resultsCount"));
@@ -842,149 +1204,279 @@ int polygonIoPreviousClose(ScreenState *screen, char *ticker, double *previousCl
     return ON_OK;
 }
 
-int polygonIoPriceHistory(ScreenState *screen, char *ticker, Date startDate, Date stopDate, PriceData *priceData)
-{
-    if (screen == NULL)
-        return ON_NO_SCREEN;
-
-    if (ticker == NULL)
-        return ON_PIO_NO_TICKER_ARG;
-    
-    char url[URL_BUFFER_SIZE] = {0};
-    sprintf(url, "https://api.polygon.io/v2/aggs/ticker/%s/range/1/day/%4d-%02d-%02d/%4d-%02d-%02d?adjusted=true&sort=asc", ticker, startDate.year, startDate.month, startDate.day, stopDate.year, stopDate.month, stopDate.day);
+typedef struct dailyBarsPage {
+    PriceData *bars;
+    size_t capacity;
+} DailyBarsPage;
 
-    json_t *root = polygonIoRESTRequest(screen, url);
-    if (root == NULL)
-        return ON_PIO_REST_NO_JSON_ROOT;
+// Bars are decoded straight into the next row of the columns
+static int dailyBarsEvent(const JsonStream *stream, JsonStreamEvent event, const char *value, size_t length, void *userdata)
+{
+    (void)length;
+    DailyBarsPage *page = (DailyBarsPage *)userdata;
+    PriceData *bars = page->bars;
+    size_t n = bars->nPrices;
 
-    json_t *results = json_object_get(root, "results");
-    int nResults = json_integer_value(json_object_get(root, "resultsCount"));
-    if (results == NULL || !json_is_array(results) || nResults == 0)
+    if (stream->depth == 2 && event == JSON_STREAM_OBJECT_START)
     {
-        json_decref(root);
-        return ON_PIO_REST_NO_JSON_RESULTS;
+        if (n == page->capacity)
+        {
+            size_t capacity = page->capacity > 0 ? 2 * page->capacity : 256;
+            int status = priceDataReserve(bars, capacity);
+            if (status != ON_OK)
+                return status;
+            page->capacity = capacity;
+        }
+        bars->times[n] = 0;
+        bars->opens[n] = 0.0;
+        bars->highs[n] = 0.0;
+        bars->lows[n] = 0.0;
+        bars->closes[n] = 0.0;
+        bars->volumes[n] = 0.0;
+        bars->vwaps[n] = 0.0;
+        bars->nTransactions[n] = 0;
     }
-        
-    time_t t = 0;
-    struct tm *timedata = NULL;
-    double volume = 0;
-    double vwap = 0;
-    double open = 0;
-    double high = 0;
-    double low = 0;
-    double close = 0;
-    int nTransactions = 0;
-    int year = 0;
-    int month = 0;
-    int day = 0;
-    double sharesPerTrade = 0;
-
-    json_t *entry;
-    long nEntries = json_array_size(results);
-    prepareForALotOfOutput(screen, nEntries);
-    for (int i = 0; i < nEntries; i++)
+    else if (stream->depth == 2 && event == JSON_STREAM_OBJECT_END)
     {
-        entry = json_array_get(results, i);
-        t = (time_t) json_integer_value(json_object_get(entry, "t")) / 1000;
-        volume = json_number_value(json_object_get(entry, "v"));
-        vwap = json_number_value(json_object_get(entry, "vw"));
-        open = json_number_value(json_object_get(entry, "o"));
-        high = json_number_value(json_object_get(entry, "h"));
-        low = json_number_value(json_object_get(entry, "l"));
-        close = json_number_value(json_object_get(entry, "c"));
-        nTransactions = json_integer_value(json_object_get(entry, "n"));
-        if (nTransactions > 0)
-            sharesPerTrade = volume / nTransactions;
-        else
-            sharesPerTrade = 0;
-        timedata = localtime(&t);
-        if (sharesPerTrade >= 2)
-            print(screen, screen->mainWindow, "%4d-%02d-%02d vwap: %.2lf, open: %.2lf, high: %.2lf, low: %.2lf, close: %.2lf, vol: %.0lf, trades: %d, shares/trade: %.1lf\n", timedata->tm_year+1900, timedata->tm_mon + 1, timedata->tm_mday, vwap, open, high, low, close, volume, nTransactions, volume / (double)nTransactions);
-        else
-            print(screen, screen->mainWindow, "%4d-%02d-%02d vwap: %.2lf, open: %.2lf, high: %.2lf, low: %.2lf, close: %.2lf, vol: %.0lf, trades: %d, shares/trade: %.3lf\n", timedata->tm_year+1900, timedata->tm_mon + 1, timedata->tm_mday, vwap, open, high, low, close, volume, nTransactions, volume / (double)nTransactions);
-        
+        if (bars->closes[n] > 0.0)
+            bars->nPrices++;
+    }
+    else if (stream->depth == 3 && event == JSON_STREAM_NUMBER)
+    {
+        const char *key = jsonStreamKey(stream, 2);
+        if (strcmp(key, "t") == 0)
+            bars->times[n] = (time_t)(strtoll(value, NULL, 10) / 1000);
+        else if (strcmp(key, "o") == 0)
+            bars->opens[n] = strtod(value, NULL);
+        else if (strcmp(key, "h") == 0)
+            bars->highs[n] = strtod(value, NULL);
+        else if (strcmp(key, "l") == 0)
+            bars->lows[n] = strtod(value, NULL);
+        else if (strcmp(key, "c") == 0)
+            bars->closes[n] = strtod(value, NULL);
+        else if (strcmp(key, "v") == 0)
+            bars->volumes[n] = strtod(value, NULL);
+        else if (strcmp(key, "vw") == 0)
+            bars->vwaps[n] = strtod(value, NULL);
+        else if (strcmp(key, "n") == 0)
+            bars->nTransactions[n] = strtol(value, NULL, 10);
     }
 
-    json_decref(root);
+    return ON_OK;
+}
+
+// Daily bars on days firstDay through lastDay, appended to bars
+static int polygonIoFetchDailyBars(ScreenState *screen, char *ticker, long firstDay, long lastDay, PriceData *bars)
+{
+    Date startDate = civilFromDays(firstDay);
+    Date stopDate = civilFromDays(lastDay);
+    char url[URL_BUFFER_SIZE] = {0};
+    sprintf(url, "https://api.polygon.io/v2/aggs/ticker/%s/range/1/day/%4d-%02d-%02d/%4d-%02d-%02d?adjusted=true&sort=asc&limit=50000", ticker, startDate.year, startDate.month, startDate.day, stopDate.year, stopDate.month, stopDate.day);
+
+    // There is at most one bar per day
+    DailyBarsPage page = {.bars = bars, .capacity = bars->nPrices + (size_t)(lastDay >= firstDay ? lastDay - firstDay + 1 : 0)};
+    int status = priceDataReserve(bars, page.capacity);
+    if (status != ON_OK)
+        return status;
+
+    PioStream pio = {.onEntry = dailyBarsEvent, .userdata = &page};
+    status = polygonIoStreamRequest(screen, url, 0.0, &pio);
+    free(pio.nextUrl);
+    if (status != ON_OK)
+        return status;
+
+    // No results is a valid answer for days without trading, but not for an error
+    if (!pio.hasResults)
+    {
+        bool noBars = (strcmp(pio.status, "OK") == 0 || strcmp(pio.status, "DELAYED") == 0) && pio.resultsCount == 0;
+        return noBars ? ON_OK : ON_PIO_REST_NO_JSON_RESULTS;
+    }
 
     return ON_OK;
 }
 
-int polygonIoVolatility(ScreenState *screen, char *ticker, Date startDate, Date stopDate, double *volatility)
+int polygonIoDailyBars(ScreenState *screen, char *ticker, Date startDate, Date stopDate, PriceData *bars)
 {
-    if (screen == NULL && volatility == NULL)
-        return ON_MISSING_ARG_POINTER;
+    if (bars == NULL)
+        return ON_MISSING_RETURN_POINTER;
 
     if (ticker == NULL)
         return ON_PIO_NO_TICKER_ARG;
-    
-    char url[URL_BUFFER_SIZE] = {0};
-    sprintf(url, "https://api.polygon.io/v2/aggs/ticker/%s/range/1/day/%4d-%02d-%02d/%4d-%02d-%02d?adjusted=true&sort=asc", ticker, startDate.year, startDate.month, startDate.day, stopDate.year, stopDate.month, stopDate.day);
 
-    json_t *root = polygonIoRESTRequest(screen, url);
-    if (root == NULL)
-        return ON_PIO_REST_NO_JSON_ROOT;
+    memset(bars, 0, sizeof *bars);
 
-    json_t *results = json_object_get(root, "results");
-    int nResults = json_integer_value(json_object_get(root, "resultsCount"));
-    if (results == NULL || !json_is_array(results) || nResults == 0)
-    {
-        json_decref(root);
+    long first = daysFromCivil(startDate);
+    long last = daysFromCivil(stopDate);
+    if (last < first)
         return ON_PIO_REST_NO_JSON_RESULTS;
-    }
 
-    double close = 0;
+    // Bars are final from the day before a trading day in New York, and
+    // through today otherwise
+    Date today = {0};
+    int minuteOfDay = 0;
+    easternTime(time(NULL), &today, &minuteOfDay);
+    long lastFinal = daysFromCivil(today) - (isTradingDay(today) ? 1 : 0);
 
-    double *prices = NULL;
-    int nPrices = 0;
+    PriceData cached = {0};
+    long cachedFirst = 0;
+    long cachedLast = -1;
+    priceCacheLoad(ticker, &cached, &cachedFirst, &cachedLast);
 
-    json_t *entry;
-    for (int i = 0; i < json_array_size(results); i++)
+    // Wholly cached: the bars stay in the file mapping
+    if (cachedLast >= cachedFirst && first >= cachedFirst && last <= cachedLast)
     {
-        entry = json_array_get(results, i);
-        if (!json_is_object(entry))
+        priceDataSlice(&cached, first, last);
+        if (cached.nPrices == 0)
         {
-            if (screen != NULL)
-                print(screen, screen->mainWindow, "Invalid JSON entry %d\n", i);
-            json_decref(root);
-            return ON_PIO_REST_INVALID_JSON;
+            freePriceData(&cached);
+            return ON_PIO_REST_NO_JSON_RESULTS;
         }
-        close = json_number_value(json_object_get(entry, "c"));
-        
-        if (close > 0.0)
-            nPrices++;
+        *bars = cached;
+        return ON_OK;
+    }
+
+    // Fetch what is missing on either side of the cached days, keeping
+    // the days covered contiguous
+    PriceData merged = {0};
+    int status = ON_OK;
+    long coveredFirst = cachedFirst;
+    long coveredLast = cachedLast;
+    if (cachedLast < cachedFirst)
+    {
+        status = polygonIoFetchDailyBars(screen, ticker, first, last, &merged);
+        coveredFirst = first;
+        coveredLast = last < lastFinal ? last : lastFinal;
     }
-    if (nPrices > 0)
+    else
     {
-        prices = malloc(nPrices * sizeof *prices);
-        if (prices == NULL)
+        // Adjusted bars all change after a split. The last cached bar is
+        // fetched again with any newer days: if its close moved, the cached
+        // bars are on the old basis and everything is downloaded again.
+        PriceData recent = {0};
+        long checkDay = cached.nPrices > 0 ? priceDataDay(cached.times[cached.nPrices - 1]) : cachedLast + 1;
+        if (cached.nPrices > 0 || last > cachedLast)
+            status = polygonIoFetchDailyBars(screen, ticker, checkDay, last > cachedLast ? last : checkDay, &recent);
+        bool rebased = false;
+        if (status == ON_OK && cached.nPrices > 0)
+        {
+            double cachedClose = cached.closes[cached.nPrices - 1];
+            rebased = recent.nPrices == 0 || priceDataDay(recent.times[0]) != checkDay || fabs(recent.closes[0] - cachedClose) > PRICE_CACHE_CLOSE_TOLERANCE * cachedClose;
+        }
+
+        if (rebased)
         {
             if (screen != NULL)
-                print(screen, screen->mainWindow, "Memory error\n");
-            json_decref(root);
-            return ON_HEAP_MEMORY_ERROR;
+                print(screen, screen->mainWindow, "  Cached %s bars were adjusted since; downloading them again\n", ticker);
+            status = polygonIoFetchDailyBars(screen, ticker, first, last, &merged);
+            coveredFirst = first;
+            coveredLast = last < lastFinal ? last : lastFinal;
         }
-        nPrices = 0;
-        for (int i = 0; i < json_array_size(results); i++)
+        else
         {
-            entry = json_array_get(results, i);
-            close = json_real_value(json_object_get(entry, "c"));                
-            if (close > 0.0)
+            if (status == ON_OK && first < cachedFirst)
+            {
+                status = polygonIoFetchDailyBars(screen, ticker, first, cachedFirst - 1, &merged);
+                coveredFirst = first;
+            }
+            if (status == ON_OK)
+                status = priceDataAppend(&merged, &cached, cachedFirst, cachedLast);
+            if (status == ON_OK && last > cachedLast)
             {
-                prices[nPrices] = close;
-                nPrices++;
+                status = priceDataAppend(&merged, &recent, cachedLast + 1, last);
+                if (lastFinal > cachedLast)
+                    coveredLast = last < lastFinal ? last : lastFinal;
             }
         }
-        double vol = calculate_volatility(prices, nPrices);
+        freePriceData(&recent);
+    }
+    freePriceData(&cached);
+
+    if (status == ON_OK && (coveredFirst != cachedFirst || coveredLast != cachedLast))
+        priceCacheSave(ticker, &merged, coveredFirst, coveredLast);
+
+    if (status == ON_OK)
+        status = priceDataAppend(bars, &merged, first, last);
+    freePriceData(&merged);
+
+    if (status == ON_OK && bars->nPrices == 0)
+        status = ON_PIO_REST_NO_JSON_RESULTS;
+    if (status != ON_OK)
+        freePriceData(bars);
 
-        if (volatility != NULL)
-            *volatility = vol * 100;
+    return status;
+}
+
+int polygonIoPriceHistory(ScreenState *screen, char *ticker, Date startDate, Date stopDate, PriceData *priceData, bool verbose)
+{
+    if (screen == NULL)
+        return ON_NO_SCREEN;
+
+    PriceData bars = {0};
+    int status = polygonIoDailyBars(screen, ticker, startDate, stopDate, &bars);
+    if (status != ON_OK)
+        return status;
+
+    if (verbose)
+    {
+        prepareForALotOfOutput(screen, bars.nPrices);
+        for (size_t i = 0; i < bars.nPrices; i++)
+        {
+            struct tm *timedata = localtime(&bars.times[i]);
+            double sharesPerTrade = bars.nTransactions[i] > 0 ? bars.volumes[i] / (double)bars.nTransactions[i] : 0.0;
+            print(screen, screen->mainWindow, sharesPerTrade >= 2 ? "%4d-%02d-%02d vwap: %.2lf, open: %.2lf, high: %.2lf, low: %.2lf, close: %.2lf, vol: %.0lf, trades: %ld, shares/trade: %.1lf\n" : "%4d-%02d-%02d vwap: %.2lf, open: %.2lf, high: %.2lf, low: %.2lf, close: %.2lf, vol: %.0lf, trades: %ld, shares/trade: %.3lf\n", timedata->tm_year+1900, timedata->tm_mon + 1, timedata->tm_mday, bars.vwaps[i], bars.opens[i], bars.highs[i], bars.lows[i], bars.closes[i], bars.volumes[i], bars.nTransactions[i], sharesPerTrade);
+        }
+    }
+
+    if (priceData != NULL)
+        *priceData = bars;
+    else
+        freePriceData(&bars);
+
+    return ON_OK;
+}
+
+int polygonIoVolatility(ScreenState *screen, char *ticker, Date startDate, Date stopDate, double *volatility)
+{
+    if (screen == NULL && volatility == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    PriceData bars = {0};
+    int status = polygonIoDailyBars(screen, ticker, startDate, stopDate, &bars);
+    if (status != ON_OK)
+        return status;
+
+    // Daily closes, and ranges where bars have them
+    VolatilityEstimator estimator = {0};
+    volatilityEstimatorInit(&estimator, OPTIONS_TRADING_DAYS_PER_YEAR);
+    for (size_t i = 0; i < bars.nPrices; i++)
+    {
+        if (bars.opens[i] > 0.0 && bars.highs[i] > 0.0 && bars.lows[i] > 0.0)
+            volatilityEstimatorAddBar(&estimator, bars.opens[i], bars.highs[i], bars.lows[i], bars.closes[i]);
+        else
+            volatilityEstimatorAddClose(&estimator, bars.closes[i]);
+    }
+    freePriceData(&bars);
+
+    if (estimator.nReturns < 2)
+    {
         if (screen != NULL)
-            print(screen, screen->mainWindow, "  Annualized Volatility: %.1lf%%\n", vol*100);
+            print(screen, screen->mainWindow, "  Not enough prices for a volatility\n");
+        return ON_PIO_REST_NO_JSON_RESULTS;
+    }
 
-        free(prices);
+    double vol = volatilityEstimate(&estimator, VOLATILITY_CLOSE_TO_CLOSE);
+    if (volatility != NULL)
+        *volatility = vol * 100;
+    if (screen != NULL)
+    {
+        print(screen, screen->mainWindow, "  Annualized Volatility: %.1lf%%\n", vol*100);
+        for (VolatilityMethod m = VOLATILITY_PARKINSON; m <= VOLATILITY_YANG_ZHANG; m++)
+        {
+            double rangeVol = volatilityEstimate(&estimator, m);
+            if (!isnan(rangeVol))
+                print(screen, screen->mainWindow, "  %21s: %.1lf%%\n", volatilityMethodName(m), rangeVol * 100);
+        }
     }
-    json_decref(root);
 
     return ON_OK;
 }
@@ -21,25 +21,22 @@
 #define AUTH_HEADER_BUFFER_SIZE 512
 #define JSON_DATA_BUFFER_SIZE 8192
 #define PIO_CHANNEL_LENGTH 64
+#define PIO_TICKER_LENGTH 64
+#define PIO_DATE_LENGTH 16
 
 #include "on_state.h"
 #include "on_parse.h"
 #include "on_data.h"
+#include "on_statistics.h"
+#include "on_pricecache.h"
+#include "on_optionschain.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
 #include <jansson.h>
 
-typedef struct {
-    size_t nPrices;
-    time_t *times;
-    double *opens;
-    double *highs;
-    double *lows;
-    double *closes;
-} PriceData;
-
 typedef struct pioSubscription {
     char channel[PIO_CHANNEL_LENGTH];
     double reportedTimeSecs;
@@ -54,8 +51,14 @@ typedef struct pioSubscription {
     double aggChange;
     double dayChange;
     double dayPercentChange;
+    VolatilityEstimator realizedVolatility;
 } PioSubscription;
 
+#define PIO_TOKEN_PROMPT "  Polygon.IO (PIO) personal API token: "
+
+// Borrowed API token (see apiToken()), asking for it with prompt the first time
+const char *providerApiToken(ScreenState *screen, const char *name, const char *prompt);
+
 int updateQuestradeAccessToken(ScreenState *screen);
 double questradeStockQuote(ScreenState *screen, char *symbol);
 
@@ -70,12 +73,26 @@ enum polygonMarket
 };
 
 json_t *polygonIoRESTRequest(ScreenState *screen, const char *requestUrl);
+// As polygonIoRESTRequest, answered from the response cache if the same request
+// was made less than ttlSeconds ago
+json_t *polygonIoCachedRESTRequest(ScreenState *screen, const char *requestUrl, double ttlSeconds);
+// Requests the URLs concurrently (see remotePerformAll()); roots[i] is the parsed
+// response to requestUrls[i], or NULL. json_decref() each root.
+int polygonIoRESTRequests(ScreenState *screen, const char **requestUrls, size_t nRequests, json_t **roots);
 
 int polygonIoOptionsSearch(ScreenState *screen, char *ticker, char type, double minstrike, double maxstrike, Date date1, Date date2, bool expired, char **nextPagePtr);
-int polygonIoOptionsChain(ScreenState *screen, char *ticker, char type, double minstrike, double maxstrike, Date date1, Date date2, double minpremium, char **nextPagePtr);
-int polygonIoPriceHistory(ScreenState *screen, char *symbol, Date startDate, Date stopDate, PriceData *priceData);
+int polygonIoOptionsChain(ScreenState *screen, char *ticker, char type, double minstrike, double maxstrike, Date date1, Date date2, double minpremium, char **nextPagePtr, OptionsChain *chain);
+// Daily bars from startDate through stopDate, from the price cache where it has
+// them and from Polygon.IO otherwise. Days fetched that can no longer change
+// are added to the cache. Free bars with freePriceData().
+int polygonIoDailyBars(ScreenState *screen, char *symbol, Date startDate, Date stopDate, PriceData *bars);
+// Fills priceData (if not NULL) with the daily bars; free with freePriceData().
+// Bars are printed if verbose.
+int polygonIoPriceHistory(ScreenState *screen, char *symbol, Date startDate, Date stopDate, PriceData *priceData, bool verbose);
 int polygonIoVolatility(ScreenState *screen, char *symbol, Date startDate, Date stopDate, double *volatility);
 int polygonIoLatestPrice(ScreenState *screen, char *ticker, TickerData *tickerData, OptionsData *optionsData, bool verbose);
+// Prints the latest prices of several tickers, fetched concurrently
+int polygonIoLatestPrices(ScreenState *screen, char **tickers, size_t nTickers);
 int printLatestPriceStocks(ScreenState *screen, json_t *root);
 int printLatestPriceOptions(ScreenState *screen, json_t *root);
 
@@ -30,6 +30,8 @@
 #include "on_screen_io.h"
 
 #include "on_websocket.h"
+#include "on_threadpool.h"
+#include "on_volsurface.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -116,6 +118,26 @@ FunctionValue showCommandsFunction(ScreenState *screen, FunctionValue arg)
     return FV_OK;
 }
 
+// V:s looks the volatility up on the surface vol_surface built; anything else is a percentage
+static int interpretVolatility(ScreenState *screen, const char *value, double K, double T, double *sigma, bool *fromSurface)
+{
+    *fromSurface = value[0] == 's' || value[0] == 'S';
+    if (!*fromSurface)
+    {
+        *sigma = atof(value);
+        return ON_OK;
+    }
+
+    *sigma = volSurfaceVolatility(screen->volSurface, K, T) * 100.0;
+    if (isnan(*sigma))
+    {
+        print(screen, screen->mainWindow, "No volatility surface for V:s; build one with vol_surface.\n");
+        return ON_STATISTICS_NOT_ENOUGH_DATA;
+    }
+
+    return ON_OK;
+}
+
 FunctionValue blackScholesOptionPriceFunction(ScreenState *screen, FunctionValue arg)
 {
     int status = 0;
@@ -128,6 +150,7 @@ FunctionValue blackScholesOptionPriceFunction(ScreenState *screen, FunctionValue
     int daysToExpire = 0;
     double yearsToExpire = 0.0;
     char type = 0;
+    bool fromSurface = false;
 
     char *params = arg.charStarValue;
     char **tokens = NULL;
@@ -156,21 +179,21 @@ FunctionValue blackScholesOptionPriceFunction(ScreenState *screen, FunctionValue
     type = tokens[0][strlen(keys[0])];
     K = atof(tokens[1]+strlen(keys[1]));
     interpretDate(tokens[2]+strlen(keys[2]), &date);
-    sigma = atof(tokens[3] + strlen(keys[3]));
     r = atof(tokens[4] + strlen(keys[4]));
     S = atof(tokens[5] + strlen(keys[5]));
     
-    // Not counting weekends. Does not account for holidays
+    // Not counting weekends and exchange holidays
     daysToExpire = tradingDaysToExpiry(date);
+    yearsToExpire = tradingYearsToExpiry(date);
+    if (interpretVolatility(screen, tokens[3] + strlen(keys[3]), K, yearsToExpire, &sigma, &fromSurface) != ON_OK)
+        goto cleanup;
 
     print(screen, screen->mainWindow, "%25s: $%.2lf\n", "Strike", K);
     print(screen, screen->mainWindow, "%25s: %4d-%02d-%02d (in %d trading days, %0.1lf weeks)\n", "Expiry", date.year, date.month, date.day, daysToExpire, (double)daysToExpire / 5.0);
-    print(screen, screen->mainWindow, "%25s: %.1lf%%\n", "Volatility", sigma);
+    print(screen, screen->mainWindow, "%25s: %.1lf%%%s\n", "Volatility", sigma, fromSurface ? " (from surface)" : "");
     print(screen, screen->mainWindow, "%25s: %.2lf%%\n", "Risk-free rate", r);
     print(screen, screen->mainWindow, "%25s: $%.2lf\n", "Share price", S);
 
-    yearsToExpire = (double)daysToExpire / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
-
     OptionType otype = CALL;
     if (type == 'P')
         otype = PUT;
@@ -190,7 +213,7 @@ FunctionValue blackScholesOptionPriceFunction(ScreenState *screen, FunctionValue
 
 cleanup:
     if (status == 2)
-        print(screen, screen->mainWindow, "parameters: T:<C or P>,S:<strike>,E:<yyyy-mm-dd>,V:<volatility %%>,R:<risk-free-rate %%>,P:<underlying-price>\n");
+        print(screen, screen->mainWindow, "parameters: T:<C or P>,S:<strike>,E:<yyyy-mm-dd>,V:<volatility %% or s(urface)>,R:<risk-free-rate %%>,P:<underlying-price>\n");
 
     free(tokens);
     free(parameters);
@@ -211,6 +234,7 @@ FunctionValue binomialOptionPriceFunction(ScreenState *screen, FunctionValue arg
     double yearsToExpire = 0.0;
     char type = 0;
     OptionType otype = CALL;
+    bool fromSurface = false;
 
     char *params = arg.charStarValue;
     char **tokens = NULL;
@@ -239,24 +263,25 @@ FunctionValue binomialOptionPriceFunction(ScreenState *screen, FunctionValue arg
     type = tokens[0][strlen(keys[0])];
     K = atof(tokens[1]+strlen(keys[1]));
     interpretDate(tokens[2]+strlen(keys[2]), &date);
-    sigma = atof(tokens[3] + strlen(keys[3]));
     r = atof(tokens[4] + strlen(keys[4]));
     q = atof(tokens[5] + strlen(keys[5]));
     S = atof(tokens[6] + strlen(keys[6]));
 
-    // Not counting weekends. Does not account for holidays
+    // Not counting weekends and exchange holidays
     daysToExpire = tradingDaysToExpiry(date);
+    yearsToExpire = tradingYearsToExpiry(date);
+    if (interpretVolatility(screen, tokens[3] + strlen(keys[3]), K, yearsToExpire, &sigma, &fromSurface) != ON_OK)
+        goto cleanup;
 
     print(screen, screen->mainWindow, "%25s: $%.2lf\n", "Strike", K);
     print(screen, screen->mainWindow, "%25s: %4d-%02d-%02d (in %d trading days, %0.1lf weeks)\n", "Expiry", date.year, date.month, date.day, daysToExpire, (double)daysToExpire / 5.0);
-    print(screen, screen->mainWindow, "%25s: %.1lf%%\n", "Volatility", sigma);
+    print(screen, screen->mainWindow, "%25s: %.1lf%%%s\n", "Volatility", sigma, fromSurface ? " (from surface)" : "");
     print(screen, screen->mainWindow, "%25s: %.2lf%%\n", "Risk-free rate", r);
     print(screen, screen->mainWindow, "%25s: %.2lf%%\n", "Dividend yield", q);
     print(screen, screen->mainWindow, "%25s: $%.2lf\n", "Share price", S);
 
     if (type == 'P')
         otype = PUT;
-    yearsToExpire = (double)daysToExpire / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
     Option opt = {S, K, r / 100.0, q / 100.0, sigma / 100.0, yearsToExpire};
     optionValue = binomial_option_value(opt, otype);
 
@@ -273,7 +298,7 @@ FunctionValue binomialOptionPriceFunction(ScreenState *screen, FunctionValue arg
 
 cleanup:
     if (status == 2)
-        print(screen, screen->mainWindow, "parameters: T:<C or P>,S:<strike>,E:<yyyy-mm-dd>,V:<volatility %%>,R:<risk-free-rate %%>,Q:<dividend-yield %%>,P:<underlying-price>\n");
+        print(screen, screen->mainWindow, "parameters: T:<C or P>,S:<strike>,E:<yyyy-mm-dd>,V:<volatility %% or s(urface)>,R:<risk-free-rate %%>,Q:<dividend-yield %%>,P:<underlying-price>\n");
 
     free(tokens);
     free(parameters);
@@ -330,7 +355,7 @@ FunctionValue optionsTimeDecayFunction(ScreenState *screen, FunctionValue arg)
             return FV_NOTOK;
     }
 
-    // Not counting weekends. Does not account for holidays
+    // Not counting weekends and exchange holidays
     Date date = {year, month, day};
     daysToExpire = tradingDaysToExpiry(date);
 
@@ -344,14 +369,18 @@ FunctionValue optionsTimeDecayFunction(ScreenState *screen, FunctionValue arg)
     if (type == 'P')
         otype = PUT;
 
-    prepareForALotOfOutput(screen, daysToExpire + 1);
+    // From now, then at each close before expiry and through the last session
+    double days = tradingYearsToExpiry(date) * (double)OPTIONS_TRADING_DAYS_PER_YEAR;
+    prepareForALotOfOutput(screen, daysToExpire + 5);
     print(screen, screen->mainWindow, "Days to go\tprice\n");
-    while (daysToExpire > 0)
+    while (days > 0.0)
     {
-        opt.T = (double)daysToExpire / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
+        opt.T = days / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
         price = algorithm(opt, otype);
-        print(screen, screen->mainWindow, "%10d\t%8.3lf\n", daysToExpire, price);
-        daysToExpire--;
+        print(screen, screen->mainWindow, "%10.2lf\t%8.3lf\n", days, price);
+        // Whole sessions, then quarters of the last one
+        double step = days > 1.0 ? 1.0 : 0.25;
+        days = step * (ceil(days / step) - 1.0);
     }
 
     return FV_OK;
@@ -370,6 +399,7 @@ FunctionValue geeksFunction(ScreenState *screen, FunctionValue arg)
     double yearsToExpire = 0.0;
     char type = 0;
     char geek = 0;
+    char exerciseMethod = 'A';
     OptionType otype = CALL;
 
     char *params = arg.charStarValue;
@@ -387,8 +417,19 @@ FunctionValue geeksFunction(ScreenState *screen, FunctionValue arg)
         memorize(screen->userInput, parameters);
 
     char *keys[] = {"G:", "T:", "S:", "E:", "V:", "R:", "Q:", "P:", 0};
-    tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
-    if (tokens == NULL || nTokens != 8)
+    char *exerciseKeys[] = {"G:", "X:", "T:", "S:", "E:", "V:", "R:", "Q:", "P:", 0};
+    // X:<A or E> is optional; American exercise if not given
+    tokens = splitStringByKeys(parameters, exerciseKeys, ',', &nTokens);
+    if (tokens != NULL)
+    {
+        exerciseMethod = tokens[1][strlen(exerciseKeys[1])];
+        free(tokens[1]);
+        memmove(tokens + 1, tokens + 2, (nTokens - 2) * sizeof *tokens);
+        nTokens--;
+    }
+    else
+        tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
+    if (tokens == NULL || nTokens != 8 || (exerciseMethod != 'A' && exerciseMethod != 'E'))
     {
         status = 2;
         goto cleanup;
@@ -403,7 +444,7 @@ FunctionValue geeksFunction(ScreenState *screen, FunctionValue arg)
     q = atof(tokens[6] + strlen(keys[6]));
     S = atof(tokens[7] + strlen(keys[7]));
 
-    // Not counting weekends. Does not account for holidays
+    // Not counting weekends and exchange holidays
     daysToExpire = tradingDaysToExpiry(date);
 
     print(screen, screen->mainWindow, "%25s: $%.2lf\n", "Strike", K);
@@ -416,9 +457,24 @@ FunctionValue geeksFunction(ScreenState *screen, FunctionValue arg)
     if (type == 'P')
         otype = PUT;
 
-    yearsToExpire = (double)daysToExpire / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
+    yearsToExpire = tradingYearsToExpiry(date);
     Option opt = {S, K, r / 100.0, q / 100.0, sigma / 100.0, yearsToExpire};
-    optionValue = binomial_option_value(opt, otype);
+
+    bool all = geek == 'a';
+    OptionGeeks geeks = {0};
+    // American calls on shares without a dividend are never exercised early,
+    // so the closed-form European geeks apply to them too
+    if (exerciseMethod == 'E' || (otype == CALL && opt.q == 0.0))
+        geeks = blackscholes_option_value_and_geeks(opt, otype);
+    else
+    {
+        // Value, theta, delta and gamma from one tree; vega needs two more
+        geeks = binomial_option_value_and_geeks(opt, otype);
+        if (geek == 'v' || all)
+            geeks.vega = binomial_option_geeks(opt, otype, "d$dV");
+    }
+
+    optionValue = geeks.value;
     bookValue = S - K;
     if (otype == PUT)
         bookValue *= -1.0;
@@ -430,32 +486,18 @@ FunctionValue geeksFunction(ScreenState *screen, FunctionValue arg)
     print(screen, screen->mainWindow, "%25s: $%.2lf (%.1lf%%)\n", "Time value", timeValue, timeValue / optionValue * 100.0);
     print(screen, screen->mainWindow, "%25s: $%.2lf\n", otype == CALL ? "Call value" : "Put value", optionValue);
 
-    double result = 0;
-    bool all = geek == 'a';
     if (geek == 't' || all)
-    {
-        result = binomial_option_geeks(opt, otype, "d$dt");
-        print(screen, screen->mainWindow, "%25s: $%.4lf/day\n", "theta", result);
-    }
+        print(screen, screen->mainWindow, "%25s: $%.4lf/day\n", "theta", geeks.theta);
     if (geek == 'v' || all)
-    {
-        result = binomial_option_geeks(opt, otype, "d$dV");
-        print(screen, screen->mainWindow, "%25s: $%.4lf/%%\n", "vega", result);
-    }
+        print(screen, screen->mainWindow, "%25s: $%.4lf/%%\n", "vega", geeks.vega);
     if (geek == 'd' || all)
-    {
-        result = binomial_option_geeks(opt, otype, "d$dP");
-        print(screen, screen->mainWindow, "%25s: $%.4lf/$\n", "delta", result);
-    }
+        print(screen, screen->mainWindow, "%25s: $%.4lf/$\n", "delta", geeks.delta);
     if (geek == 'g' || all)
-    {
-        result = binomial_option_geeks(opt, otype, "d2$dP2");
-        print(screen, screen->mainWindow, "%25s: $%.6lf/$/$\n", "gamma", result);
-    }
+        print(screen, screen->mainWindow, "%25s: $%.6lf/$/$\n", "gamma", geeks.gamma);
 
 cleanup:
     if (status == 2)
-        print(screen, screen->mainWindow, "parameters: G:<t, d, g, v or a>,T:<C or P>,S:<strike>,E:<yyyy-mm-dd>,V:<volatility %%>,R:<risk-free-rate %%>,Q:<dividend-yield %%>,P:<underlying-price>\n");
+        print(screen, screen->mainWindow, "parameters: G:<t, d, g, v or a>,[X:<A(merican) or E(uropean)>,]T:<C or P>,S:<strike>,E:<yyyy-mm-dd>,V:<volatility %%>,R:<risk-free-rate %%>,Q:<dividend-yield %%>,P:<underlying-price>\n");
 
     free(tokens);
     free(parameters);
@@ -475,6 +517,7 @@ FunctionValue impliedVolatilityFunction(ScreenState *screen, FunctionValue arg)
     int daysToExpire = 0;
     double yearsToExpire = 0.0;
     char type = 0;
+    char exerciseMethod = 'A';
     OptionType otype = CALL;
 
     char *params = arg.charStarValue;
@@ -493,8 +536,19 @@ FunctionValue impliedVolatilityFunction(ScreenState *screen, FunctionValue arg)
         memorize(screen->userInput, parameters);
         
     char *keys[] = {"T:", "S:", "E:", "R:", "Q:", "P:", "B:", "A:", 0};
-    tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
-    if (tokens == NULL || nTokens != 8)
+    char *exerciseKeys[] = {"X:", "T:", "S:", "E:", "R:", "Q:", "P:", "B:", "A:", 0};
+    // X:<A or E> is optional; American exercise if not given
+    tokens = splitStringByKeys(parameters, exerciseKeys, ',', &nTokens);
+    if (tokens != NULL)
+    {
+        exerciseMethod = tokens[0][strlen(exerciseKeys[0])];
+        free(tokens[0]);
+        memmove(tokens, tokens + 1, (nTokens - 1) * sizeof *tokens);
+        nTokens--;
+    }
+    else
+        tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
+    if (tokens == NULL || nTokens != 8 || (exerciseMethod != 'A' && exerciseMethod != 'E'))
     {
         status = 2;
         goto cleanup;
@@ -512,25 +566,34 @@ FunctionValue impliedVolatilityFunction(ScreenState *screen, FunctionValue arg)
     if (type == 'P')
         otype = PUT;
 
-    // Not counting weekends. Does not account for holidays
+    // Not counting weekends and exchange holidays
     daysToExpire = tradingDaysToExpiry(date);
 
     print(screen, screen->mainWindow, "%25s: %4d-%02d-%02d (in %d trading days, %0.1lf weeks)\n", "Expiry", date.year, date.month, date.day, daysToExpire, (double)daysToExpire / 5.0);
 
-    yearsToExpire = (double)daysToExpire / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
+    yearsToExpire = tradingYearsToExpiry(date);
     Option opt = {S, K, r / 100.0, q / 100.0, 0.0, yearsToExpire};
-    int res = binomial_option_implied_volatility(opt, otype, bid, &bidImpliedVolatility);
-    if (res != 0)
-        return (FunctionValue)res;
-    res = binomial_option_implied_volatility(opt, otype, ask, &askImpliedVolatility);
-    if (res != 0)
-        return (FunctionValue)res;
+    if (exerciseMethod == 'E')
+    {
+        // NaN if the price is outside the Black-Scholes range
+        blackscholes_option_implied_volatility(opt, otype, bid, &bidImpliedVolatility);
+        blackscholes_option_implied_volatility(opt, otype, ask, &askImpliedVolatility);
+    }
+    else
+    {
+        int res = binomial_option_implied_volatility(opt, otype, bid, &bidImpliedVolatility);
+        if (res != 0)
+            return (FunctionValue)res;
+        res = binomial_option_implied_volatility(opt, otype, ask, &askImpliedVolatility);
+        if (res != 0)
+            return (FunctionValue)res;
+    }
 
     print(screen, screen->mainWindow, "%25s: bid: %.1lf%%, ask %.1lf%%\n", "Implied volatility", bidImpliedVolatility * 100.0, askImpliedVolatility * 100.0);
 
 cleanup:
     if (status == 2)
-        print(screen, screen->mainWindow, "parameters: T:<type (C or P)>,S:<strike>,E:<yyyy-mm-dd>,R:<risk-free-rate %%>,Q:<dividend-yield %%>,P:<underlying-price>,B:<option-bid-price>,A:<option-ask-price>\n");
+        print(screen, screen->mainWindow, "parameters: [X:<A(merican) or E(uropean)>,]T:<type (C or P)>,S:<strike>,E:<yyyy-mm-dd>,R:<risk-free-rate %%>,Q:<dividend-yield %%>,P:<underlying-price>,B:<option-bid-price>,A:<option-ask-price>\n");
 
     free(tokens);
     free(parameters);
@@ -550,6 +613,7 @@ FunctionValue impliedPriceFunction(ScreenState *screen, FunctionValue arg)
     int daysToExpire = 0;
     double yearsToExpire = 0.0;
     char type = 0;
+    OptionType otype = CALL;
 
     char *params = arg.charStarValue;
     char **tokens = NULL;
@@ -568,7 +632,7 @@ FunctionValue impliedPriceFunction(ScreenState *screen, FunctionValue arg)
         
     char *keys[] = {"T:", "S:", "E:", "V:", "R:", "Q:", "O:", 0};
     tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
-    if (tokens == NULL)
+    if (tokens == NULL || nTokens != 7)
     {
         status = 2;
         goto cleanup;
@@ -582,18 +646,26 @@ FunctionValue impliedPriceFunction(ScreenState *screen, FunctionValue arg)
     q = atof(tokens[5]+strlen(keys[5]));
     optionPrice = atof(tokens[6]+strlen(keys[6]));
 
-    // Not counting weekends. Does not account for holidays
+    if (type == 'P')
+        otype = PUT;
+
+    // Not counting weekends and exchange holidays
     daysToExpire = tradingDaysToExpiry(expiry);
 
     print(screen, screen->mainWindow, "%25s: %4d-%02d-%02d (in %d trading days, %0.1lf weeks)\n", "Expiry", expiry.year, expiry.month, expiry.day, daysToExpire, (double)daysToExpire / 5.0);
 
-    yearsToExpire = (double)daysToExpire / (double)OPTIONS_TRADING_DAYS_PER_YEAR;
+    yearsToExpire = tradingYearsToExpiry(expiry);
     Option opt = {0.0, K, r / 100.0, q / 100.0, v / 100.0, yearsToExpire};
-    int res = binomial_option_implied_price_of_underlying(opt, type, optionPrice, &impliedPriceOfUnderlying);
-    if (res != 0)
-        return (FunctionValue)res;
-
-    print(screen, screen->mainWindow, "%25s: $%.3lf\n", "Implied price", impliedPriceOfUnderlying);
+    int res = binomial_option_implied_price_of_underlying(opt, otype, optionPrice, &impliedPriceOfUnderlying);
+    if (res == ON_OPTIONS_MODELS_NO_SOLUTION)
+        print(screen, screen->mainWindow, "%25s: none (option price is outside the model's range)\n", "Implied price");
+    else if (res != ON_OK)
+    {
+        status = res;
+        goto cleanup;
+    }
+    else
+        print(screen, screen->mainWindow, "%25s: $%.3lf\n", "Implied price", impliedPriceOfUnderlying);
 
 cleanup:
     if (status == 2)
@@ -886,7 +958,7 @@ FunctionValue pioOptionsChainFunction(ScreenState *screen, FunctionValue arg)
     print(screen, screen->mainWindow, "%s: %s $%.2lf - $%.2lf expiring %d-%02d-%02d - %d-%02d-%02d, premium >= $%.2lf\n", ticker, type == 'C' ? "calls" : "puts", minstrike, maxstrike, date1.year, date1.month, date1.day, date2.year, date2.month, date2.day, minpremium);
     do
     {
-        polygonIoOptionsChain(screen, ticker, type, minstrike, maxstrike, date1, date2, minpremium, &nextPagePtr);
+        polygonIoOptionsChain(screen, ticker, type, minstrike, maxstrike, date1, date2, minpremium, &nextPagePtr, NULL);
         if (nextPagePtr != NULL)
             action = continueOrQuit(screen, 50, false);
     } while (nextPagePtr != NULL && action != 'q');
@@ -903,6 +975,313 @@ cleanup:
     return FV_OK;
 }
 
+// Work shared by the threads pricing a chain; slot i belongs to contract i
+typedef struct chainAnalytics
+{
+    OptionsData *contracts;
+    Option *options;
+    double *marketPrices;
+    double *values;
+    double *impliedVolatilities;
+} ChainAnalytics;
+
+static void chainAnalyticsJob(void *context, size_t i)
+{
+    ChainAnalytics *chain = context;
+    OptionType type = chain->contracts[i].type;
+
+    chain->values[i] = binomial_option_value(chain->options[i], type);
+    chain->impliedVolatilities[i] = nan("");
+    if (chain->marketPrices[i] > 0.0)
+        binomial_option_implied_volatility(chain->options[i], type, chain->marketPrices[i], &chain->impliedVolatilities[i]);
+
+    return;
+}
+
+FunctionValue chainAnalyticsFunction(ScreenState *screen, FunctionValue arg)
+{
+    if (screen == NULL)
+        return (FunctionValue)ON_NO_SCREEN;
+
+    char type = 0;
+    double minstrike = 0;
+    double maxstrike = 0;
+    double sigma = 0;
+    double r = 0;
+    double q = 0;
+    double S = 0;
+
+    Date date1 = {0};
+    Date date2 = {0};
+
+    int status = 0;
+
+    char *ticker = NULL;
+    char **tokens = NULL;
+    int nTokens = 0;
+
+    OptionsChain optionsChain = {0};
+    OptionsData *contracts = NULL;
+    size_t nContracts = 0;
+    ChainAnalytics chain = {0};
+
+    char *params = arg.charStarValue;
+
+    char *parameters = NULL;
+    if (params != NULL)
+        parameters = strdup(params);
+    else
+        parameters = readInput(screen, screen->mainWindow, "  parameters: ", ON_READINPUT_ALL);
+    if (!parameters)
+        return FV_NOTOK;
+    if (parameters[0] == 0)
+    {
+        status = 2;
+        goto cleanup;
+    }
+
+    if (params == NULL && parameters[0] != 0)
+        memorize(screen->userInput, parameters);
+
+    char *keys[] = {"", "T:", "s:", "S:", "e:", "E:", "V:", "R:", "Q:", "P:", 0};
+    tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
+    if (tokens == NULL || nTokens != 10)
+    {
+        status = 2;
+        goto cleanup;
+    }
+
+    ticker = strdup(tokens[0]);
+    type = tokens[1][strlen(keys[1])];
+    minstrike = atof(tokens[2]+strlen(keys[2]));
+    maxstrike = atof(tokens[3]+strlen(keys[3]));
+    interpretDate(tokens[4]+strlen(keys[4]), &date1);
+    interpretDate(tokens[5]+strlen(keys[5]), &date2);
+    sigma = atof(tokens[6]+strlen(keys[6]));
+    r = atof(tokens[7]+strlen(keys[7]));
+    q = atof(tokens[8]+strlen(keys[8]));
+    S = atof(tokens[9]+strlen(keys[9]));
+
+    // Whole chain first, then price it
+    char *nextPagePtr = NULL;
+    do
+    {
+        status = polygonIoOptionsChain(screen, ticker, type, minstrike, maxstrike, date1, date2, 0.0, &nextPagePtr, &optionsChain);
+    } while (status == ON_OK && nextPagePtr != NULL);
+    free(nextPagePtr);
+    // Sorted by expiry, then strike
+    contracts = optionsChain.contracts;
+    nContracts = optionsChain.nContracts;
+    if (nContracts == 0)
+    {
+        print(screen, screen->mainWindow, "No contracts found.\n");
+        status = 0;
+        goto cleanup;
+    }
+    status = 0;
+
+    chain.contracts = contracts;
+    chain.options = calloc(nContracts, sizeof *chain.options);
+    chain.marketPrices = calloc(nContracts, sizeof *chain.marketPrices);
+    chain.values = calloc(nContracts, sizeof *chain.values);
+    chain.impliedVolatilities = calloc(nContracts, sizeof *chain.impliedVolatilities);
+    if (chain.options == NULL || chain.marketPrices == NULL || chain.values == NULL || chain.impliedVolatilities == NULL)
+    {
+        print(screen, screen->mainWindow, "Out of memory.\n");
+        goto cleanup;
+    }
+
+    // Dates are worked out here, the pricing on the thread pool
+    for (size_t i = 0; i < nContracts; i++)
+    {
+        OptionsData *contract = &contracts[i];
+        double underlying = S > 0.0 ? S : contract->underlyingTickerData.close;
+        double years = tradingYearsToExpiry(contract->expiry);
+        Option opt = {underlying, contract->strike, r / 100.0, q / 100.0, sigma / 100.0, years};
+        chain.options[i] = opt;
+        chain.marketPrices[i] = contract->quote.bid > 0.0 && contract->quote.ask > 0.0 ? contract->quote.midpoint : contract->tickerData.close;
+    }
+
+    ThreadPool *pool = threadPoolShared();
+    struct timespec start = {0};
+    struct timespec stop = {0};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (pool != NULL)
+        threadPoolParallelFor(pool, nContracts, chainAnalyticsJob, &chain);
+    else
+        for (size_t i = 0; i < nContracts; i++)
+            chainAnalyticsJob(&chain, i);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double elapsed = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    print(screen, screen->mainWindow, "%s: %zu %s priced in %.3lf s on %d thread%s\n", ticker, nContracts, type == 'C' ? "calls" : "puts", elapsed, threadPoolSize(pool) > 0 ? threadPoolSize(pool) : 1, threadPoolSize(pool) > 1 ? "s" : "");
+    print(screen, screen->mainWindow, "%8s %11s %8s %8s %8s %7s  %s\n", "Strike", "Expiry", "Price", "Market", "Value", "IV", "Ticker");
+    for (size_t e = 0; e < optionsChain.nExpiries; e++)
+    {
+        const ExpiryRange *range = &optionsChain.expiries[e];
+        if (e > 0)
+            print(screen, screen->mainWindow, "\n");
+        for (size_t i = range->first; i < range->first + range->count; i++)
+        {
+            OptionsData *contract = &contracts[i];
+            print(screen, screen->mainWindow, "%8.2lf %4d-%02d-%02d %8.2lf %8.3lf %8.3lf %6.1lf%%  %s\n", contract->strike, contract->expiry.year, contract->expiry.month, contract->expiry.day, chain.options[i].S, chain.marketPrices[i], chain.values[i], chain.impliedVolatilities[i] * 100.0, contract->ticker);
+        }
+    }
+
+cleanup:
+    if (status == 2)
+        print(screen, screen->mainWindow, "parameters: <ticker>,T:<C(all) or P(ut),s:<min-strike>,S:<max-strike>,e:<earliest-expiry>,E:<latest-expiry>,V:<volatility-%%>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-price or 0 for latest>\n");
+
+    free(chain.options);
+    free(chain.marketPrices);
+    free(chain.values);
+    free(chain.impliedVolatilities);
+    freeOptionsChain(&optionsChain);
+    freeTokens(tokens, nTokens);
+    free(parameters);
+    free(ticker);
+
+    return FV_OK;
+}
+
+FunctionValue volSurfaceFunction(ScreenState *screen, FunctionValue arg)
+{
+    if (screen == NULL)
+        return (FunctionValue)ON_NO_SCREEN;
+
+    double minstrike = 0;
+    double maxstrike = 0;
+    double r = 0;
+    double q = 0;
+    double S = 0;
+
+    Date date1 = {0};
+    Date date2 = {0};
+
+    int status = 0;
+
+    char *ticker = NULL;
+    char **tokens = NULL;
+    int nTokens = 0;
+
+    OptionsChain optionsChain = {0};
+
+    char *params = arg.charStarValue;
+
+    char *parameters = NULL;
+    if (params != NULL)
+        parameters = strdup(params);
+    else
+        parameters = readInput(screen, screen->mainWindow, "  parameters: ", ON_READINPUT_ALL);
+    if (!parameters)
+        return FV_NOTOK;
+    if (parameters[0] == 0)
+    {
+        status = 2;
+        goto cleanup;
+    }
+
+    if (params == NULL && parameters[0] != 0)
+        memorize(screen->userInput, parameters);
+
+    char *keys[] = {"", "s:", "S:", "e:", "E:", "R:", "Q:", "P:", 0};
+    tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
+    if (tokens == NULL || nTokens != 8)
+    {
+        status = 2;
+        goto cleanup;
+    }
+
+    ticker = strdup(tokens[0]);
+    minstrike = atof(tokens[1]+strlen(keys[1]));
+    maxstrike = atof(tokens[2]+strlen(keys[2]));
+    interpretDate(tokens[3]+strlen(keys[3]), &date1);
+    interpretDate(tokens[4]+strlen(keys[4]), &date2);
+    r = atof(tokens[5]+strlen(keys[5]));
+    q = atof(tokens[6]+strlen(keys[6]));
+    S = atof(tokens[7]+strlen(keys[7]));
+
+    // Calls and puts, so that each side of the smile is out of the money
+    char types[] = {'C', 'P'};
+    status = ON_OK;
+    for (int t = 0; t < 2 && status == ON_OK; t++)
+    {
+        char *nextPagePtr = NULL;
+        do
+        {
+            status = polygonIoOptionsChain(screen, ticker, types[t], minstrike, maxstrike, date1, date2, 0.0, &nextPagePtr, &optionsChain);
+        } while (status == ON_OK && nextPagePtr != NULL);
+        free(nextPagePtr);
+    }
+    if (optionsChain.nContracts == 0)
+    {
+        print(screen, screen->mainWindow, "No contracts found.\n");
+        status = 0;
+        goto cleanup;
+    }
+    status = 0;
+    if (S <= 0.0)
+        S = optionsChain.contracts[0].underlyingTickerData.close;
+
+    if (screen->volSurface == NULL)
+        screen->volSurface = calloc(1, sizeof *screen->volSurface);
+    VolSurface *surface = screen->volSurface;
+    if (surface == NULL)
+    {
+        print(screen, screen->mainWindow, "Out of memory.\n");
+        goto cleanup;
+    }
+
+    // The same ticker again only re-solves the quotes that moved
+    struct timespec start = {0};
+    struct timespec stop = {0};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (surface->ticker != NULL && strcasecmp(surface->ticker, ticker) == 0)
+        status = volSurfaceUpdate(surface, &optionsChain, S, r / 100.0, q / 100.0);
+    else
+        status = volSurfaceBuild(surface, ticker, &optionsChain, S, r / 100.0, q / 100.0);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double elapsed = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_nsec - start.tv_nsec) / 1e9;
+    if (status != ON_OK || surface->nSmiles == 0)
+    {
+        print(screen, screen->mainWindow, "Unable to build a volatility surface for %s.\n", ticker);
+        freeVolSurface(surface);
+        status = 0;
+        goto cleanup;
+    }
+
+    ThreadPool *pool = threadPoolShared();
+    print(screen, screen->mainWindow, "%s: %zu contracts, %zu implied volatilities solved in %.3lf s on %d thread%s\n", ticker, surface->nQuotes, surface->nSolved, elapsed, threadPoolSize(pool) > 0 ? threadPoolSize(pool) : 1, threadPoolSize(pool) > 1 ? "s" : "");
+    print(screen, screen->mainWindow, "Implied volatility (%%) by strike as a fraction of the share price $%.2lf:\n", surface->S);
+    double moneyness[] = {0.8, 0.9, 0.95, 1.0, 1.05, 1.1, 1.2};
+    int nMoneyness = (int)(sizeof moneyness / sizeof moneyness[0]);
+    print(screen, screen->mainWindow, "%11s %7s", "Expiry", "Strikes");
+    for (int m = 0; m < nMoneyness; m++)
+        print(screen, screen->mainWindow, " %6.2lf", moneyness[m]);
+    print(screen, screen->mainWindow, "\n");
+    for (size_t e = 0; e < surface->nSmiles; e++)
+    {
+        const VolSmile *smile = &surface->smiles[e];
+        Date expiry = civilFromDays(smile->day);
+        print(screen, screen->mainWindow, " %4d-%02d-%02d %7zu", expiry.year, expiry.month, expiry.day, smile->nKnots);
+        for (int m = 0; m < nMoneyness; m++)
+            print(screen, screen->mainWindow, " %6.1lf", volSurfaceVolatility(surface, moneyness[m] * surface->S, smile->T) * 100.0);
+        print(screen, screen->mainWindow, "\n");
+    }
+    print(screen, screen->mainWindow, "Price with V:s in european_option or american_option to use this surface.\n");
+
+cleanup:
+    if (status == 2)
+        print(screen, screen->mainWindow, "parameters: <ticker>,s:<min-strike>,S:<max-strike>,e:<earliest-expiry>,E:<latest-expiry>,R:<risk-free-rate-%%>,Q:<dividend-yield-%%>,P:<underlying-share-price or 0 for latest>\n");
+
+    freeOptionsChain(&optionsChain);
+    freeTokens(tokens, nTokens);
+    free(parameters);
+    free(ticker);
+
+    return FV_OK;
+}
+
 FunctionValue pioPriceHistoryFunction(ScreenState *screen, FunctionValue arg)
 {
     if (screen == NULL)
@@ -950,7 +1329,8 @@ FunctionValue pioPriceHistoryFunction(ScreenState *screen, FunctionValue arg)
 
     // Call PIO
     PriceData data = {0};
-    polygonIoPriceHistory(screen, ticker, date1, date2, &data);
+    polygonIoPriceHistory(screen, ticker, date1, date2, &data, true);
+    freePriceData(&data);
 
 cleanup:
     if (status == 2)
@@ -1021,6 +1401,95 @@ cleanup:
 
 }
 
+FunctionValue pioVolatilityForecastFunction(ScreenState *screen, FunctionValue arg)
+{
+    if (screen == NULL)
+        return (FunctionValue)ON_NO_SCREEN;
+
+    char *ticker = NULL;
+    int status = 0;
+    char **tokens = NULL;
+    int nTokens = 0;
+    Date date1 = {0};
+    Date date2 = {0};
+    PriceData data = {0};
+
+    char *params = arg.charStarValue;
+
+    char *parameters = NULL;
+    if (params != NULL)
+        parameters = strdup(params);
+    else
+        parameters = readInput(screen, screen->mainWindow, "  parameters: ", ON_READINPUT_ALL);
+    if (!parameters)
+        return FV_NOTOK;
+    if (parameters[0] == 0)
+    {
+        status = 2;
+        goto cleanup;
+    }
+
+    if (params == NULL && parameters[0] != 0)
+        memorize(screen->userInput, parameters);
+
+    char *keys[] = {"", "", "", 0};
+    tokens = splitStringByKeys(parameters, keys, ',', &nTokens);
+    if (tokens == NULL)
+    {
+        status = 2;
+        goto cleanup;
+    }
+
+    ticker = strdup(tokens[0]);
+    interpretDate(tokens[1], &date1);
+    interpretDate(tokens[2], &date2);
+
+    // Call PIO
+    status = polygonIoPriceHistory(screen, ticker, date1, date2, &data, false);
+    if (status != ON_OK)
+    {
+        print(screen, screen->mainWindow, "  Could not get the price history for %s\n", ticker);
+        goto cleanup;
+    }
+
+    EwmaModel ewma = {0};
+    GarchModel garch = {0};
+    status = ewmaFit(data.closes, (int)data.nPrices, &ewma);
+    if (status == ON_OK)
+        status = garchFit(data.closes, (int)data.nPrices, &garch);
+    if (status == ON_STATISTICS_NOT_ENOUGH_DATA)
+    {
+        print(screen, screen->mainWindow, "  Need at least %d daily closes to fit a forecast\n", VOLATILITY_FIT_MIN_RETURNS + 1);
+        goto cleanup;
+    }
+    else if (status != ON_OK)
+        goto cleanup;
+
+    print(screen, screen->mainWindow, "  %zu daily closes\n", data.nPrices);
+    print(screen, screen->mainWindow, "  EWMA: lambda %.4lf (RiskMetrics %.2lf)\n", ewma.lambda, EWMA_RISKMETRICS_LAMBDA);
+    print(screen, screen->mainWindow, "  GARCH(1,1): omega %.3le, alpha %.4lf, beta %.4lf, persistence %.4lf, long-run volatility %.1lf%%\n", garch.omega, garch.alpha, garch.beta, garch.alpha + garch.beta, 100.0 * sqrt(garch.longRunVariance * OPTIONS_TRADING_DAYS_PER_YEAR));
+    print(screen, screen->mainWindow, "  %10s %8s %8s\n", "Days", "EWMA", "GARCH");
+    int horizons[] = {1, 5, 21, 63, 126, 251};
+    int nHorizons = (int)(sizeof horizons / sizeof horizons[0]);
+    for (int i = 0; i < nHorizons; i++)
+    {
+        double years = (double)horizons[i] / OPTIONS_TRADING_DAYS_PER_YEAR;
+        print(screen, screen->mainWindow, "  %10d %7.1lf%% %7.1lf%%\n", horizons[i], 100.0 * ewmaForecastVolatility(&ewma, years), 100.0 * garchForecastVolatility(&garch, years));
+    }
+
+cleanup:
+    if (status == 2)
+        print(screen, screen->mainWindow, "parameters: <ticker>,<startDate>,<endDate>\n");
+
+    freePriceData(&data);
+    freeTokens(tokens, nTokens);
+    free(parameters);
+    free(ticker);
+
+    return FV_OK;
+
+}
+
 FunctionValue pioLatestPriceFunction(ScreenState *screen, FunctionValue arg)
 {
     if (screen == NULL)
@@ -1047,8 +1516,29 @@ FunctionValue pioLatestPriceFunction(ScreenState *screen, FunctionValue arg)
         return FV_NOTOK;
     }
 
-    // Call PIO
-    polygonIoLatestPrice(screen, ticker, NULL, NULL, true);
+    // Call PIO, fetching a list of tickers concurrently
+    const char *delimiters = ", ";
+    if (strpbrk(ticker, delimiters) == NULL)
+        polygonIoLatestPrice(screen, ticker, NULL, NULL, true);
+    else
+    {
+        // At most one more ticker than delimiters
+        size_t maxTickers = 1;
+        for (char *c = ticker; *c != '\0'; c++)
+            if (strchr(delimiters, *c) != NULL)
+                maxTickers++;
+        char **tickers = calloc(maxTickers, sizeof *tickers);
+        if (tickers != NULL)
+        {
+            size_t nTickers = 0;
+            char *savePtr = NULL;
+            for (char *t = strtok_r(ticker, delimiters, &savePtr); t != NULL && nTickers < maxTickers; t = strtok_r(NULL, delimiters, &savePtr))
+                tickers[nTickers++] = t;
+            if (nTickers > 0)
+                polygonIoLatestPrices(screen, tickers, nTickers);
+            free(tickers);
+        }
+    }
 
     free(ticker);
 
@@ -76,8 +76,11 @@ FunctionValue timeValueOfMoneyFunction(ScreenState *screen, FunctionValue arg);
 // Data
 FunctionValue pioOptionsSearchFunction(ScreenState *screen, FunctionValue arg);
 FunctionValue pioOptionsChainFunction(ScreenState *screen, FunctionValue arg);
+FunctionValue chainAnalyticsFunction(ScreenState *screen, FunctionValue arg);
+FunctionValue volSurfaceFunction(ScreenState *screen, FunctionValue arg);
 FunctionValue pioPriceHistoryFunction(ScreenState *screen, FunctionValue arg);
 FunctionValue pioVolatilityFunction(ScreenState *screen, FunctionValue arg);
+FunctionValue pioVolatilityForecastFunction(ScreenState *screen, FunctionValue arg);
 FunctionValue pioLatestPriceFunction(ScreenState *screen, FunctionValue arg);
 FunctionValue pioPreviousCloseFunction(ScreenState *screen, FunctionValue arg);
 
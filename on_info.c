@@ -56,26 +56,6 @@ FunctionValue aboutFunction(ScreenState *screen, FunctionValue notUsed)
     return FV_OK;
 }
 
-static size_t curlCallback(char *data, size_t size, size_t nmemb, void *userdata)
-{
-    if (data == NULL || userdata == NULL)
-        return ON_OK;
-
-    size_t realsize = size * nmemb;
-    struct curlData *mem = (struct curlData *)userdata;
-
-    char *ptr = realloc(mem->response, mem->size + realsize + 1);
-    if (ptr == NULL)
-        return ON_OK; /* out of memory! */
-
-    mem->response = ptr;
-    memcpy(&(mem->response[mem->size]), data, realsize);
-    mem->size += realsize;
-    mem->response[mem->size] = 0;
-
-    return realsize;
-}
-
 FunctionValue licenseFunction(ScreenState *screen, FunctionValue notUsed)
 {
     if (screen == NULL)
@@ -83,31 +63,30 @@ FunctionValue licenseFunction(ScreenState *screen, FunctionValue notUsed)
 
     (void)notUsed;
     
-    CURL *curl = curl_easy_init();
+    CURL *curl = remoteSessionHandle();
 
-    struct curlData data = {0};
+    CurlData *data = remoteSessionBuffer();
     CURLcode res = CURLE_OK;
 
     bool gotLicense = false;
 
     char url[256] = {0};
-    if (curl)
+    if (curl && data)
     {
         sprintf(url, "https://www.gnu.org/licenses/gpl-3.0.txt");
 
         curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+        remoteReceiveInto(curl, data);
         /* Perform the request */
         res = curl_easy_perform(curl);
         /* Check for errors */
-        if (res == CURLE_OK && data.response != NULL)
+        if (res == CURLE_OK && data->response != NULL)
         {
             int height = screen->mainWindowViewHeight;
             int lineCount = 0;
             char action = 0;
             int maxLineLength = 0;
-            char *start = data.response;
+            char *start = data->response;
             char *end = strchr(start, '\n');
             while (end != NULL)
             {
@@ -146,9 +125,6 @@ FunctionValue licenseFunction(ScreenState *screen, FunctionValue notUsed)
         print(screen, screen->mainWindow, "%s\n", ON_READING_CUE);
     }
 
-    curl_easy_cleanup(curl);
-    free(data.response);
-
     return FV_OK;
 
 }
@@ -205,7 +181,8 @@ FunctionValue helpFunction(ScreenState *screen, FunctionValue topicArg)
     }
     else if (strcasecmp("greeks", topic) == 0)
     {
-        print(screen, screen->mainWindow, "%s  Option greeks estimated from the binomial option model using finite difference derivatives\n", ON_READING_CUE);
+        print(screen, screen->mainWindow, "%s  Option greeks are closed-form (Black-Scholes) for European exercise (X:E) and for American calls without dividend,\n", ON_READING_CUE);
+        print(screen, screen->mainWindow, "%s  otherwise taken from a single binomial tree (vega from finite differences)\n", ON_READING_CUE);
         print(screen, screen->mainWindow, "%s%20s - %s\n", ON_READING_CUE, "t", "theta, the time rate of change of option value in $/day");
         print(screen, screen->mainWindow, "%s%20s - %s\n", ON_READING_CUE, "v", "vega, the volatility rate of change of option value in $/%%");
         print(screen, screen->mainWindow, "%s%20s - %s\n", ON_READING_CUE, "d", "delta, the stock price rate of change of option value in $/$");
@@ -0,0 +1,460 @@
+/*
+    Options Numerics: on_jsonstream.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_jsonstream.h"
+#include "on_status.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum jsonStreamStates
+{
+    STATE_VALUE = 0,
+    STATE_VALUE_OR_END,
+    STATE_KEY,
+    STATE_KEY_OR_END,
+    STATE_COLON,
+    STATE_COMMA_OR_END,
+    STATE_STRING,
+    STATE_ESCAPE,
+    STATE_UNICODE,
+    STATE_NUMBER,
+    STATE_LITERAL,
+    STATE_END
+};
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+void jsonStreamInit(JsonStream *stream, JsonStreamCallback callback, void *userdata)
+{
+    if (stream == NULL)
+        return;
+
+    memset(stream, 0, sizeof *stream);
+    stream->callback = callback;
+    stream->userdata = userdata;
+    stream->state = STATE_VALUE;
+
+    return;
+}
+
+static int appendToken(JsonStream *stream, const char *bytes, size_t n)
+{
+    if (stream->tokenLength + n + 1 > stream->tokenSize)
+    {
+        size_t size = stream->tokenSize > 0 ? stream->tokenSize : 64;
+        while (stream->tokenLength + n + 1 > size)
+            size *= 2;
+        char *token = realloc(stream->token, size);
+        if (token == NULL)
+            return ON_HEAP_MEMORY_ERROR;
+        stream->token = token;
+        stream->tokenSize = size;
+    }
+    memcpy(stream->token + stream->tokenLength, bytes, n);
+    stream->tokenLength += n;
+    stream->token[stream->tokenLength] = '\0';
+
+    return ON_OK;
+}
+
+static int appendCodePoint(JsonStream *stream, unsigned int c)
+{
+    char utf8[4] = {0};
+    size_t n = 0;
+    if (c < 0x80)
+        utf8[n++] = (char)c;
+    else if (c < 0x800)
+    {
+        utf8[n++] = (char)(0xC0 | (c >> 6));
+        utf8[n++] = (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+        utf8[n++] = (char)(0xE0 | (c >> 12));
+        utf8[n++] = (char)(0x80 | ((c >> 6) & 0x3F));
+        utf8[n++] = (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+        utf8[n++] = (char)(0xF0 | (c >> 18));
+        utf8[n++] = (char)(0x80 | ((c >> 12) & 0x3F));
+        utf8[n++] = (char)(0x80 | ((c >> 6) & 0x3F));
+        utf8[n++] = (char)(0x80 | (c & 0x3F));
+    }
+
+    return appendToken(stream, utf8, n);
+}
+
+static int emit(JsonStream *stream, JsonStreamEvent event, const char *value, size_t length)
+{
+    if (stream->callback == NULL)
+        return ON_OK;
+
+    return stream->callback(stream, event, value, length, stream->userdata);
+}
+
+// After a whole value, at the depth of its container
+static void valueDone(JsonStream *stream)
+{
+    if (stream->depth == 0)
+    {
+        stream->state = STATE_END;
+        stream->done = true;
+    }
+    else
+        stream->state = STATE_COMMA_OR_END;
+
+    return;
+}
+
+static int openContainer(JsonStream *stream, bool isArray)
+{
+    if (stream->depth == JSON_STREAM_MAX_DEPTH)
+        return ON_PARSE_INVALID_JSON;
+
+    int status = emit(stream, isArray ? JSON_STREAM_ARRAY_START : JSON_STREAM_OBJECT_START, NULL, 0);
+    if (status != ON_OK)
+        return status;
+
+    JsonStreamLevel *level = &stream->levels[stream->depth++];
+    level->isArray = isArray;
+    level->key[0] = '\0';
+    stream->state = isArray ? STATE_VALUE_OR_END : STATE_KEY_OR_END;
+
+    return ON_OK;
+}
+
+static int closeContainer(JsonStream *stream, bool isArray)
+{
+    if (stream->depth == 0 || stream->levels[stream->depth - 1].isArray != isArray)
+        return ON_PARSE_INVALID_JSON;
+
+    stream->depth--;
+    int status = emit(stream, isArray ? JSON_STREAM_ARRAY_END : JSON_STREAM_OBJECT_END, NULL, 0);
+    valueDone(stream);
+
+    return status;
+}
+
+static int endString(JsonStream *stream)
+{
+    const char *token = stream->token != NULL ? stream->token : "";
+    if (stream->readingKey)
+    {
+        char *key = stream->levels[stream->depth - 1].key;
+        size_t n = stream->tokenLength < JSON_STREAM_KEY_LENGTH - 1 ? stream->tokenLength : JSON_STREAM_KEY_LENGTH - 1;
+        memcpy(key, token, n);
+        key[n] = '\0';
+        stream->state = STATE_COLON;
+        return ON_OK;
+    }
+
+    int status = emit(stream, JSON_STREAM_STRING, token, stream->tokenLength);
+    valueDone(stream);
+
+    return status;
+}
+
+static int endNumber(JsonStream *stream)
+{
+    char *end = NULL;
+    strtod(stream->token, &end);
+    if (end != stream->token + stream->tokenLength || stream->tokenLength == 0)
+        return ON_PARSE_INVALID_JSON;
+
+    int status = emit(stream, JSON_STREAM_NUMBER, stream->token, stream->tokenLength);
+    valueDone(stream);
+
+    return status;
+}
+
+static int startValue(JsonStream *stream, char c)
+{
+    stream->tokenLength = 0;
+    switch (c)
+    {
+        case '{':
+            return openContainer(stream, false);
+        case '[':
+            return openContainer(stream, true);
+        case '"':
+            stream->readingKey = false;
+            stream->state = STATE_STRING;
+            return appendToken(stream, "", 0);
+        case 't':
+            stream->literal = "true";
+            break;
+        case 'f':
+            stream->literal = "false";
+            break;
+        case 'n':
+            stream->literal = "null";
+            break;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                stream->state = STATE_NUMBER;
+                return appendToken(stream, &c, 1);
+            }
+            return ON_PARSE_INVALID_JSON;
+    }
+    stream->literalIndex = 1;
+    stream->state = STATE_LITERAL;
+
+    return ON_OK;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+// Adds a \u escape to the token, pairing UTF-16 surrogates
+static int unicodeDone(JsonStream *stream)
+{
+    unsigned int c = stream->codePoint;
+    if (c >= 0xD800 && c < 0xDC00)
+    {
+        int status = ON_OK;
+        if (stream->highSurrogate != 0)
+            status = appendCodePoint(stream, 0xFFFD);
+        stream->highSurrogate = c;
+        stream->state = STATE_STRING;
+        return status;
+    }
+    if (c >= 0xDC00 && c < 0xE000)
+    {
+        if (stream->highSurrogate == 0)
+            c = 0xFFFD;
+        else
+            c = 0x10000 + ((stream->highSurrogate - 0xD800) << 10) + (c - 0xDC00);
+    }
+    else if (stream->highSurrogate != 0)
+    {
+        int status = appendCodePoint(stream, 0xFFFD);
+        if (status != ON_OK)
+            return status;
+    }
+    stream->highSurrogate = 0;
+    stream->state = STATE_STRING;
+
+    return appendCodePoint(stream, c);
+}
+
+static int parseByte(JsonStream *stream, char c)
+{
+    switch (stream->state)
+    {
+        case STATE_STRING:
+            if (c == '\\')
+            {
+                stream->state = STATE_ESCAPE;
+                return ON_OK;
+            }
+            if ((unsigned char)c < 0x20)
+                return ON_PARSE_INVALID_JSON;
+            if (stream->highSurrogate != 0)
+            {
+                // Not followed by its low surrogate
+                stream->highSurrogate = 0;
+                int status = appendCodePoint(stream, 0xFFFD);
+                if (status != ON_OK)
+                    return status;
+            }
+            if (c == '"')
+                return endString(stream);
+            return appendToken(stream, &c, 1);
+
+        case STATE_ESCAPE:
+        {
+            const char *escapes = "\"\\/bfnrt";
+            const char *unescaped = "\"\\/\b\f\n\r\t";
+            const char *e = c != '\0' ? strchr(escapes, c) : NULL;
+            stream->state = STATE_STRING;
+            if (stream->highSurrogate != 0 && c != 'u')
+            {
+                stream->highSurrogate = 0;
+                int status = appendCodePoint(stream, 0xFFFD);
+                if (status != ON_OK)
+                    return status;
+            }
+            if (e != NULL)
+                return appendToken(stream, unescaped + (e - escapes), 1);
+            if (c != 'u')
+                return ON_PARSE_INVALID_JSON;
+            stream->codePoint = 0;
+            stream->hexDigits = 0;
+            stream->state = STATE_UNICODE;
+            return ON_OK;
+        }
+
+        case STATE_UNICODE:
+        {
+            int h = hexValue(c);
+            if (h < 0)
+                return ON_PARSE_INVALID_JSON;
+            stream->codePoint = (stream->codePoint << 4) | (unsigned int)h;
+            if (++stream->hexDigits == 4)
+                return unicodeDone(stream);
+            return ON_OK;
+        }
+
+        case STATE_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+                return appendToken(stream, &c, 1);
+            else
+            {
+                int status = endNumber(stream);
+                if (status != ON_OK)
+                    return status;
+                // c belongs to what follows the number
+                return parseByte(stream, c);
+            }
+
+        case STATE_LITERAL:
+            if (c != stream->literal[stream->literalIndex])
+                return ON_PARSE_INVALID_JSON;
+            if (stream->literal[++stream->literalIndex] == '\0')
+            {
+                JsonStreamEvent event = stream->literal[0] == 't' ? JSON_STREAM_TRUE : stream->literal[0] == 'f' ? JSON_STREAM_FALSE : JSON_STREAM_NULL;
+                int status = emit(stream, event, stream->literal, stream->literalIndex);
+                valueDone(stream);
+                return status;
+            }
+            return ON_OK;
+
+        default:
+            break;
+    }
+
+    if (IS_SPACE(c))
+        return ON_OK;
+
+    switch (stream->state)
+    {
+        case STATE_VALUE_OR_END:
+            if (c == ']')
+                return closeContainer(stream, true);
+            return startValue(stream, c);
+
+        case STATE_VALUE:
+            return startValue(stream, c);
+
+        case STATE_KEY_OR_END:
+            if (c == '}')
+                return closeContainer(stream, false);
+            // Fall through
+        case STATE_KEY:
+            if (c != '"')
+                return ON_PARSE_INVALID_JSON;
+            stream->tokenLength = 0;
+            stream->readingKey = true;
+            stream->state = STATE_STRING;
+            return appendToken(stream, "", 0);
+
+        case STATE_COLON:
+            if (c != ':')
+                return ON_PARSE_INVALID_JSON;
+            stream->state = STATE_VALUE;
+            return ON_OK;
+
+        case STATE_COMMA_OR_END:
+        {
+            bool inArray = stream->levels[stream->depth - 1].isArray;
+            if (c == ',')
+            {
+                stream->state = inArray ? STATE_VALUE : STATE_KEY;
+                return ON_OK;
+            }
+            if (c == (inArray ? ']' : '}'))
+                return closeContainer(stream, inArray);
+            return ON_PARSE_INVALID_JSON;
+        }
+
+        default:
+            // Only whitespace after the document
+            return ON_PARSE_INVALID_JSON;
+    }
+}
+
+int jsonStreamFeed(JsonStream *stream, const char *data, size_t length)
+{
+    if (stream == NULL || (data == NULL && length > 0))
+        return ON_MISSING_ARG_POINTER;
+
+    for (size_t i = 0; i < length && stream->status == ON_OK; i++)
+        stream->status = parseByte(stream, data[i]);
+
+    return stream->status;
+}
+
+int jsonStreamFinish(JsonStream *stream)
+{
+    if (stream == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    // A number is only known to have ended when something follows it
+    if (stream->status == ON_OK && stream->state == STATE_NUMBER && stream->depth == 0)
+        stream->status = endNumber(stream);
+    if (stream->status == ON_OK && !stream->done)
+        stream->status = ON_PARSE_INVALID_JSON;
+
+    free(stream->token);
+    stream->token = NULL;
+    stream->tokenLength = 0;
+    stream->tokenSize = 0;
+
+    return stream->status;
+}
+
+const char *jsonStreamKey(const JsonStream *stream, int level)
+{
+    if (stream == NULL || level < 0 || level >= stream->depth || stream->levels[level].isArray)
+        return NULL;
+
+    return stream->levels[level].key;
+}
+
+bool jsonStreamPath(const JsonStream *stream, int n, ...)
+{
+    if (stream == NULL || n > stream->depth)
+        return false;
+
+    va_list args;
+    va_start(args, n);
+    bool matches = true;
+    for (int level = 0; level < n && matches; level++)
+    {
+        const char *name = va_arg(args, const char *);
+        const char *key = jsonStreamKey(stream, level);
+        if (name == NULL || key == NULL)
+            matches = name == NULL && stream->levels[level].isArray;
+        else
+            matches = strcmp(name, key) == 0;
+    }
+    va_end(args);
+
+    return matches;
+}
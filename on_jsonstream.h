@@ -0,0 +1,87 @@
+/*
+    Options Numerics: on_jsonstream.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_JSONSTREAM_H
+#define _ON_JSONSTREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Push parser for JSON arriving in pieces, e.g. from a libcurl write callback.
+// Nothing is kept but the keys of the open containers and the current token,
+// so memory does not grow with the size of the document.
+#define JSON_STREAM_MAX_DEPTH 32
+// Longer keys are truncated
+#define JSON_STREAM_KEY_LENGTH 64
+
+typedef enum {
+    JSON_STREAM_OBJECT_START,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_START,
+    JSON_STREAM_ARRAY_END,
+    JSON_STREAM_STRING,
+    JSON_STREAM_NUMBER,
+    JSON_STREAM_TRUE,
+    JSON_STREAM_FALSE,
+    JSON_STREAM_NULL
+} JsonStreamEvent;
+
+typedef struct jsonStream JsonStream;
+
+// Called for each value. The value is a member of the container at level
+// stream->depth - 1, named jsonStreamKey(stream, stream->depth - 1), or is the
+// document itself if stream->depth is 0; this holds for the start and end
+// events of containers too. Strings are unescaped and numbers are as written,
+// both NUL-terminated and valid only during the call. Anything but ON_OK stops
+// the parse with that status.
+typedef int (*JsonStreamCallback)(const JsonStream *stream, JsonStreamEvent event, const char *value, size_t length, void *userdata);
+
+typedef struct jsonStreamLevel {
+    bool isArray;
+    char key[JSON_STREAM_KEY_LENGTH];
+} JsonStreamLevel;
+
+struct jsonStream {
+    JsonStreamCallback callback;
+    void *userdata;
+    int depth;
+    JsonStreamLevel levels[JSON_STREAM_MAX_DEPTH];
+    int state;
+    int status;
+    bool done;
+    // Token being read
+    char *token;
+    size_t tokenLength;
+    size_t tokenSize;
+    bool readingKey;
+    const char *literal;
+    int literalIndex;
+    unsigned int codePoint;
+    unsigned int highSurrogate;
+    int hexDigits;
+};
+
+void jsonStreamInit(JsonStream *stream, JsonStreamCallback callback, void *userdata);
+// Parses the next length bytes; ON_OK, the callback's status, or ON_PARSE_INVALID_JSON
+int jsonStreamFeed(JsonStream *stream, const char *data, size_t length);
+// Checks that the document is complete and frees the token buffer
+int jsonStreamFinish(JsonStream *stream);
+// Name of the member being read at level (0 is the document's container), or NULL in an array
+const char *jsonStreamKey(const JsonStream *stream, int level);
+// Whether the keys of levels 0 through n - 1 are the n names given; NULL matches an array
+bool jsonStreamPath(const JsonStream *stream, int n, ...);
+
+#endif // _ON_JSONSTREAM_H
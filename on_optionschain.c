@@ -0,0 +1,256 @@
+/*
+    Options Numerics: on_optionschain.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_optionschain.h"
+#include "on_optionstiming.h"
+#include "on_status.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compareStrikes(double a, double b)
+{
+    if (a < b - OPTIONS_CHAIN_STRIKE_TOLERANCE)
+        return -1;
+    if (a > b + OPTIONS_CHAIN_STRIKE_TOLERANCE)
+        return 1;
+
+    return 0;
+}
+
+static int compareKeys(long dayA, double strikeA, OptionType typeA, long dayB, double strikeB, OptionType typeB)
+{
+    if (dayA != dayB)
+        return dayA < dayB ? -1 : 1;
+    int strikes = compareStrikes(strikeA, strikeB);
+    if (strikes != 0)
+        return strikes;
+    if (typeA != typeB)
+        return typeA < typeB ? -1 : 1;
+
+    return 0;
+}
+
+static int compareContracts(const void *a, const void *b)
+{
+    const OptionsData *contractA = (const OptionsData *)a;
+    const OptionsData *contractB = (const OptionsData *)b;
+
+    int keys = compareKeys(daysFromCivil(contractA->expiry), contractA->strike, contractA->type, daysFromCivil(contractB->expiry), contractB->strike, contractB->type);
+    if (keys != 0)
+        return keys;
+    if (contractA->ticker == NULL || contractB->ticker == NULL)
+        return (contractA->ticker != NULL) - (contractB->ticker != NULL);
+
+    return strcmp(contractA->ticker, contractB->ticker);
+}
+
+int optionsChainAppend(OptionsChain *chain, const OptionsData *contract)
+{
+    if (chain == NULL || contract == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    if (chain->nContracts == chain->capacity)
+    {
+        size_t capacity = chain->capacity > 0 ? 2 * chain->capacity : 256;
+        OptionsData *contracts = realloc(chain->contracts, capacity * sizeof *contracts);
+        if (contracts == NULL)
+            return ON_HEAP_MEMORY_ERROR;
+        chain->contracts = contracts;
+        chain->capacity = capacity;
+    }
+    chain->contracts[chain->nContracts++] = *contract;
+
+    return ON_OK;
+}
+
+static int buildExpiryRanges(OptionsChain *chain)
+{
+    chain->nExpiries = 0;
+    for (size_t i = 0; i < chain->nContracts; i++)
+    {
+        long day = daysFromCivil(chain->contracts[i].expiry);
+        if (chain->nExpiries > 0 && chain->expiries[chain->nExpiries - 1].day == day)
+        {
+            chain->expiries[chain->nExpiries - 1].count++;
+            continue;
+        }
+        if (chain->nExpiries == chain->expiriesCapacity)
+        {
+            size_t capacity = chain->expiriesCapacity > 0 ? 2 * chain->expiriesCapacity : 16;
+            ExpiryRange *expiries = realloc(chain->expiries, capacity * sizeof *expiries);
+            if (expiries == NULL)
+                return ON_HEAP_MEMORY_ERROR;
+            chain->expiries = expiries;
+            chain->expiriesCapacity = capacity;
+        }
+        ExpiryRange *range = &chain->expiries[chain->nExpiries++];
+        range->expiry = chain->contracts[i].expiry;
+        range->day = day;
+        range->first = i;
+        range->count = 1;
+    }
+
+    return ON_OK;
+}
+
+int optionsChainSort(OptionsChain *chain)
+{
+    if (chain == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    size_t nNew = chain->nContracts - chain->nSorted;
+    if (nNew == 0)
+        return buildExpiryRanges(chain);
+
+    OptionsData *added = chain->contracts + chain->nSorted;
+    qsort(added, nNew, sizeof *added, compareContracts);
+
+    // Merge the new page with the contracts already in order. A contract seen
+    // again replaces the old copy.
+    OptionsData *merged = malloc(chain->capacity * sizeof *merged);
+    if (merged == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+
+    size_t i = 0;
+    size_t j = 0;
+    size_t n = 0;
+    while (i < chain->nSorted || j < nNew)
+    {
+        const OptionsData *next = NULL;
+        if (j == nNew)
+            next = &chain->contracts[i++];
+        else if (i == chain->nSorted)
+            next = &added[j++];
+        else
+        {
+            int order = compareContracts(&chain->contracts[i], &added[j]);
+            if (order == 0)
+                free(chain->contracts[i++].ticker);
+            next = order < 0 ? &chain->contracts[i++] : &added[j++];
+        }
+        if (n > 0 && compareContracts(&merged[n - 1], next) == 0)
+        {
+            free(merged[n - 1].ticker);
+            n--;
+        }
+        merged[n++] = *next;
+    }
+
+    free(chain->contracts);
+    chain->contracts = merged;
+    chain->nContracts = n;
+    chain->nSorted = n;
+
+    return buildExpiryRanges(chain);
+}
+
+const ExpiryRange *optionsChainExpiry(const OptionsChain *chain, Date expiry)
+{
+    if (chain == NULL)
+        return NULL;
+
+    long day = daysFromCivil(expiry);
+    size_t low = 0;
+    size_t high = chain->nExpiries;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (chain->expiries[mid].day < day)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == chain->nExpiries || chain->expiries[low].day != day)
+        return NULL;
+
+    return &chain->expiries[low];
+}
+
+OptionsData *optionsChainFind(const OptionsChain *chain, Date expiry, double strike, OptionType type)
+{
+    const ExpiryRange *range = optionsChainExpiry(chain, expiry);
+    if (range == NULL)
+        return NULL;
+
+    size_t low = range->first;
+    size_t high = range->first + range->count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        const OptionsData *contract = &chain->contracts[mid];
+        if (compareKeys(range->day, contract->strike, contract->type, range->day, strike, type) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    // Adjusted contracts with the same key follow
+    for (size_t i = low; i < range->first + range->count; i++)
+    {
+        OptionsData *contract = &chain->contracts[i];
+        if (compareStrikes(contract->strike, strike) != 0 || contract->type != type)
+            break;
+        if (optionsContractIsStandard(contract))
+            return contract;
+    }
+
+    return NULL;
+}
+
+bool optionsContractIsStandard(const OptionsData *contract)
+{
+    if (contract == NULL)
+        return false;
+    if (contract->sharesPerContract > 0.0 && contract->sharesPerContract != OPTIONS_STANDARD_SHARES_PER_CONTRACT)
+        return false;
+
+    // O:<root><yymmdd><C or P><strike x 1000, 8 digits>
+    const char *ticker = contract->ticker;
+    if (ticker == NULL)
+        return true;
+    if (strncmp(ticker, "O:", 2) == 0)
+        ticker += 2;
+    size_t length = strlen(ticker);
+    if (length <= 15)
+        return true;
+
+    return !isdigit((unsigned char)ticker[length - 16]);
+}
+
+void freeOptionsChain(OptionsChain *chain)
+{
+    if (chain == NULL)
+        return;
+
+    freeOptionsContracts(chain->contracts, chain->nContracts);
+    free(chain->expiries);
+    memset(chain, 0, sizeof *chain);
+
+    return;
+}
+
+void freeOptionsContracts(OptionsData *contracts, size_t nContracts)
+{
+    if (contracts == NULL)
+        return;
+
+    for (size_t i = 0; i < nContracts; i++)
+        free(contracts[i].ticker);
+    free(contracts);
+
+    return;
+}
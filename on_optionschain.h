@@ -0,0 +1,73 @@
+/*
+    Options Numerics: on_optionschain.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_OPTIONSCHAIN_H
+#define _ON_OPTIONSCHAIN_H
+
+#include "on_data.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Strikes closer than this are the same strike
+#define OPTIONS_CHAIN_STRIKE_TOLERANCE 1e-6
+
+// Contracts expiring on one day: chain->contracts[first] through [first + count - 1]
+typedef struct expiryRange
+{
+    Date expiry;
+    long day; // daysFromCivil(expiry)
+    size_t first;
+    size_t count;
+} ExpiryRange;
+
+// Contracts in one array sorted by expiry, strike, type and then ticker, with
+// the range of each expiry. Pages are appended as they arrive and merged in by
+// optionsChainSort(); a contract appearing again replaces the earlier one.
+// Adjusted contracts, e.g. after a split, share an expiry, strike and type
+// with the standard ones but have their own tickers, so both are kept.
+typedef struct optionsChain
+{
+    OptionsData *contracts;
+    size_t nContracts;
+    size_t capacity;
+    // Contracts before this are sorted and indexed
+    size_t nSorted;
+
+    ExpiryRange *expiries;
+    size_t nExpiries;
+    size_t expiriesCapacity;
+} OptionsChain;
+
+// Adds a copy of contract after the sorted ones; the chain takes over contract->ticker
+int optionsChainAppend(OptionsChain *chain, const OptionsData *contract);
+// Merges the appended contracts into order and rebuilds the expiry ranges
+int optionsChainSort(OptionsChain *chain);
+// O(log n) lookups among the sorted contracts; NULL if there is none.
+// optionsChainFind() only returns a standard contract.
+OptionsData *optionsChainFind(const OptionsChain *chain, Date expiry, double strike, OptionType type);
+const ExpiryRange *optionsChainExpiry(const OptionsChain *chain, Date expiry);
+void freeOptionsChain(OptionsChain *chain);
+
+// Standard contracts deliver OPTIONS_STANDARD_SHARES_PER_CONTRACT shares of the
+// underlying. Adjusted ones deliver something else, and OCC adds a digit to
+// their root symbol, e.g. O:GME1 for O:GME after a split.
+#define OPTIONS_STANDARD_SHARES_PER_CONTRACT 100
+bool optionsContractIsStandard(const OptionsData *contract);
+
+void freeOptionsContracts(OptionsData *contracts, size_t nContracts);
+
+#endif // _ON_OPTIONSCHAIN_H
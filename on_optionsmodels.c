@@ -19,8 +19,11 @@
 #include "on_data.h"
 #include "on_optionstiming.h"
 #include "on_screen_io.h"
+#include "on_simd.h"
 
+#include <float.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -34,6 +37,11 @@ double cdf(double x)
     return 0.5 * (1.0 + erf(x / sqrt(2.0)));
 }
 
+double pdf(double x)
+{
+    return exp(-0.5 * x * x) / sqrt(2.0 * M_PI);
+}
+
 double d1(double S, double K, double r, double sigma, double t)
 {
     return (log(S / K) + (r + sigma * sigma / 2.0) * t) / (sigma * sqrt(t));
@@ -46,156 +54,439 @@ double d2(double d1Val, double sigma, double t)
 
 double blackscholes_option_value(Option opt, OptionType type)
 {
-    double d_1 = d1(opt.S, opt.K, opt.r, opt.v, opt.T);
+    double d_1 = d1(opt.S, opt.K, opt.r - opt.q, opt.v, opt.T);
     double d_2 = d2(d_1, opt.v, opt.T);
     double price = 0.0;
     if (type == CALL)
-        price = opt.S * cdf(d_1) - opt.K * exp(-opt.r * opt.T) * cdf(d_2);
+        price = opt.S * exp(-opt.q * opt.T) * cdf(d_1) - opt.K * exp(-opt.r * opt.T) * cdf(d_2);
     else
-        price = opt.K * exp(-opt.r * opt.T) * cdf(-d_2) - opt.S * cdf(-d_1);
+        price = opt.K * exp(-opt.r * opt.T) * cdf(-d_2) - opt.S * exp(-opt.q * opt.T) * cdf(-d_1);
 
     return price;
 }
 
+// Closed-form value and geeks from a single evaluation of d1, d2, cdf, pdf and the discount factors
+OptionGeeks blackscholes_option_value_and_geeks(Option opt, OptionType type)
+{
+    OptionGeeks geeks = {0};
+
+    double dividendDiscount = exp(-opt.q * opt.T);
+    double rateDiscount = exp(-opt.r * opt.T);
+    double sign = type == PUT ? -1.0 : 1.0;
+
+    // Expired or no volatility: only the (discounted) book value remains
+    if (opt.T <= 0.0 || opt.v <= 0.0)
+    {
+        double bookValue = sign * (opt.S * dividendDiscount - opt.K * rateDiscount);
+        if (bookValue > 0.0)
+        {
+            geeks.value = bookValue;
+            geeks.delta = sign * dividendDiscount;
+        }
+        return geeks;
+    }
+
+    double sqrtT = sqrt(opt.T);
+    double d_1 = d1(opt.S, opt.K, opt.r - opt.q, opt.v, opt.T);
+    double d_2 = d2(d_1, opt.v, opt.T);
+    double nd1 = pdf(d_1);
+    double Nd1 = cdf(sign * d_1);
+    double Nd2 = cdf(sign * d_2);
+    double discountedS = opt.S * dividendDiscount;
+    double discountedK = opt.K * rateDiscount;
+
+    geeks.value = sign * (discountedS * Nd1 - discountedK * Nd2);
+    geeks.delta = sign * dividendDiscount * Nd1;
+    geeks.gamma = dividendDiscount * nd1 / (opt.S * opt.v * sqrtT);
+    geeks.vega = discountedS * nd1 * sqrtT / 100.0;
+    // -dV/dT, per trading day
+    geeks.theta = (-discountedS * nd1 * opt.v / (2.0 * sqrtT) - sign * opt.r * discountedK * Nd2 + sign * opt.q * discountedS * Nd1) / OPTIONS_TRADING_DAYS_PER_YEAR;
+    geeks.rho = sign * discountedK * opt.T * Nd2 / 100.0;
+
+    return geeks;
+}
+
+// Options per pass of the batch functions; keeps the temporaries in L1
+#define BATCH_CHUNK 128
+
+static int checkBatch(const OptionBatch *batch)
+{
+    if (batch == NULL)
+        return ON_MISSING_ARG_POINTER;
+    if (batch->n > 0 && (batch->S == NULL || batch->K == NULL || batch->r == NULL || batch->v == NULL || batch->T == NULL || batch->type == NULL))
+        return ON_MISSING_ARG_POINTER;
+
+    return ON_OK;
+}
+
+static Option batchOption(const OptionBatch *batch, size_t i)
+{
+    Option opt = {batch->S[i], batch->K[i], batch->r[i], batch->q != NULL ? batch->q[i] : 0.0, batch->v[i], batch->T[i]};
+
+    return opt;
+}
+
+static void storeGeeks(OptionGeeksBatch *out, size_t i, OptionGeeks geeks)
+{
+    if (out->value != NULL)
+        out->value[i] = geeks.value;
+    if (out->delta != NULL)
+        out->delta[i] = geeks.delta;
+    if (out->gamma != NULL)
+        out->gamma[i] = geeks.gamma;
+    if (out->vega != NULL)
+        out->vega[i] = geeks.vega;
+    if (out->theta != NULL)
+        out->theta[i] = geeks.theta;
+    if (out->rho != NULL)
+        out->rho[i] = geeks.rho;
+}
+
+// Options start .. start + m - 1 of a batch, as in blackscholes_option_value_and_geeks().
+// The logs, discount factors, cdfs and pdfs each go through one vectorized pass.
+static void blackscholes_batch_chunk(const OptionBatch *batch, size_t start, size_t m, OptionGeeksBatch *out)
+{
+    double sign[BATCH_CHUNK];
+    double q[BATCH_CHUNK];
+    double volSqrtT[BATCH_CHUNK];
+    double d_1[BATCH_CHUNK];
+    double Nd1[BATCH_CHUNK];
+    double Nd2[BATCH_CHUNK];
+    double nd1[BATCH_CHUNK];
+    double dividendDiscount[BATCH_CHUNK];
+    double rateDiscount[BATCH_CHUNK];
+
+    const double *S = batch->S + start;
+    const double *K = batch->K + start;
+    const double *r = batch->r + start;
+    const double *v = batch->v + start;
+    const double *T = batch->T + start;
+    const OptionType *type = batch->type + start;
+    bool needPdf = out->gamma != NULL || out->vega != NULL || out->theta != NULL;
+
+    if (batch->q != NULL)
+        memcpy(q, batch->q + start, m * sizeof *q);
+    else
+        memset(q, 0, m * sizeof *q);
+
+    for (size_t i = 0; i < m; i++)
+    {
+        sign[i] = type[i] == PUT ? -1.0 : 1.0;
+        volSqrtT[i] = v[i] * sqrt(fmax(T[i], 0.0));
+        d_1[i] = S[i] / K[i];
+        dividendDiscount[i] = -q[i] * T[i];
+        rateDiscount[i] = -r[i] * T[i];
+    }
+    simdLog(d_1, d_1, m);
+    simdExp(dividendDiscount, dividendDiscount, m);
+    simdExp(rateDiscount, rateDiscount, m);
+
+    for (size_t i = 0; i < m; i++)
+    {
+        d_1[i] = (d_1[i] + (r[i] - q[i] + 0.5 * v[i] * v[i]) * T[i]) / volSqrtT[i];
+        Nd1[i] = sign[i] * d_1[i];
+        Nd2[i] = sign[i] * (d_1[i] - volSqrtT[i]);
+        nd1[i] = -0.5 * d_1[i] * d_1[i];
+    }
+    simdNormalCdf(Nd1, Nd1, m);
+    simdNormalCdf(Nd2, Nd2, m);
+    if (needPdf)
+        simdExp(nd1, nd1, m);
+
+    // One simple loop per output so each vectorizes
+    for (size_t i = 0; i < m; i++)
+    {
+        Nd1[i] *= S[i] * dividendDiscount[i]; // discountedS * N(sign d1)
+        Nd2[i] *= K[i] * rateDiscount[i]; // discountedK * N(sign d2)
+        nd1[i] *= S[i] * dividendDiscount[i] / sqrt(2.0 * M_PI); // discountedS * pdf(d1)
+    }
+    if (out->value != NULL)
+        for (size_t i = 0; i < m; i++)
+            out->value[start + i] = sign[i] * (Nd1[i] - Nd2[i]);
+    if (out->delta != NULL)
+        for (size_t i = 0; i < m; i++)
+            out->delta[start + i] = sign[i] * Nd1[i] / S[i];
+    if (out->gamma != NULL)
+        for (size_t i = 0; i < m; i++)
+            out->gamma[start + i] = nd1[i] / (S[i] * S[i] * volSqrtT[i]);
+    if (out->vega != NULL)
+        for (size_t i = 0; i < m; i++)
+            out->vega[start + i] = nd1[i] * volSqrtT[i] / v[i] / 100.0;
+    if (out->theta != NULL)
+        for (size_t i = 0; i < m; i++)
+            out->theta[start + i] = (-nd1[i] * v[i] * v[i] / (2.0 * volSqrtT[i]) - sign[i] * r[i] * Nd2[i] + sign[i] * q[i] * Nd1[i]) / OPTIONS_TRADING_DAYS_PER_YEAR;
+    if (out->rho != NULL)
+        for (size_t i = 0; i < m; i++)
+            out->rho[start + i] = sign[i] * Nd2[i] * T[i] / 100.0;
+
+    // Expired or no volatility
+    for (size_t i = 0; i < m; i++)
+        if (T[i] <= 0.0 || v[i] <= 0.0)
+            storeGeeks(out, start + i, blackscholes_option_value_and_geeks(batchOption(batch, start + i), type[i]));
+}
+
+int blackscholes_option_value_batch(const OptionBatch *batch, double *values)
+{
+    if (values == NULL)
+        return ON_MISSING_RETURN_POINTER;
+
+    OptionGeeksBatch out = {.value = values};
+
+    return blackscholes_option_value_and_geeks_batch(batch, &out);
+}
+
+int blackscholes_option_value_and_geeks_batch(const OptionBatch *batch, OptionGeeksBatch *geeks)
+{
+    if (geeks == NULL)
+        return ON_MISSING_RETURN_POINTER;
+    int status = checkBatch(batch);
+    if (status != ON_OK)
+        return status;
+
+    for (size_t start = 0; start < batch->n; start += BATCH_CHUNK)
+    {
+        size_t m = batch->n - start < BATCH_CHUNK ? batch->n - start : BATCH_CHUNK;
+        blackscholes_batch_chunk(batch, start, m, geeks);
+    }
+
+    return ON_OK;
+}
+
+// Thread's own scratch space for trees of up to BINOMIAL_N_STEPS steps
+static _Thread_local double binomialWorkspace[BINOMIAL_WORKSPACE_SIZE(BINOMIAL_N_STEPS)];
+
 // Assisted by ChatGPT 14 Jan 2023
 // Binomial call or put
-double binomial_option_value(Option opt, OptionType type)
+// Option values at the nodes of the first two levels of the tree are copied
+// to level1 (2 nodes) and level2 (3 nodes) unless those are NULL
+// workspace holds BINOMIAL_WORKSPACE_SIZE(nSteps) doubles, or is NULL to use
+// the thread's own scratch space
+static double binomial_tree(Option opt, OptionType type, int nSteps, double *workspace, double *level1, double *level2)
 {
-    double dt = opt.T / BINOMIAL_N_STEPS;
+    if (nSteps < 2)
+        return nan("");
+
+    double sign = type == PUT ? -1.0 : 1.0;
+
+    // No time or volatility left: book value
+    if (opt.T <= 0.0 || opt.v <= 0.0)
+        return fmax(sign * (opt.S - opt.K), 0.0);
+
+    double dt = opt.T / nSteps;
     double u = exp(opt.v * sqrt(dt));
     double d = 1 / u;
-    double p_up = (exp(opt.r * dt) - d) / (u - d);
-    double p_down = 1 - p_up;
-    double price = 0.0;
 
     // CRR method from Wikipedia
     double q = opt.q; // Dividend yield
     double p0 = (u * exp(-q * dt) - exp(-opt.r * dt)) / (u * u - 1);
     double p1 = exp(-opt.r * dt) - p0;
 
-    double *p = malloc((BINOMIAL_N_STEPS + 1) * sizeof *p);
-    if (p == NULL)
-        return nan(""); // Memory
-
-    for (int i = 0; i <= BINOMIAL_N_STEPS; i++)
+    double *allocated = NULL;
+    if (workspace == NULL)
     {
-        p[i] = opt.S * pow(u, 2 * i - BINOMIAL_N_STEPS) - opt.K;
-        if (type == PUT)
-            p[i] *= -1.0;
-
-        if (p[i] < 0.0)
-            p[i] = 0.0;
+        if (nSteps <= BINOMIAL_N_STEPS)
+            workspace = binomialWorkspace;
+        else
+        {
+            allocated = malloc(BINOMIAL_WORKSPACE_SIZE(nSteps) * sizeof *allocated);
+            if (allocated == NULL)
+                return nan(""); // Memory
+            workspace = allocated;
+        }
     }
 
-    double exercise = 0.0;
-    for (int j = BINOMIAL_N_STEPS - 1; j >= 0; j--)
+    // Option values at the nodes of one level of the tree
+    double *p = workspace;
+    // Exercise value for underlying price S * u^(k - nSteps), k = 0 .. 2 * nSteps,
+    // built outward from S by repeated multiplication.
+    // Node i of level j has k = nSteps - j + 2 * i, so the nodes of a level
+    // are contiguous in either the even-k or the odd-k ladder
+    double *exerciseEven = workspace + nSteps + 1;
+    double *exerciseOdd = exerciseEven + nSteps + 1;
+    double up = opt.S;
+    double down = opt.S;
+    double *centre = nSteps % 2 == 0 ? exerciseEven + nSteps / 2 : exerciseOdd + nSteps / 2;
+    centre[0] = sign * (opt.S - opt.K);
+    for (int k = 1; k <= nSteps; k++)
     {
-        for (int i = 0; i <= j; i++)
+        up *= u;
+        down *= d;
+        if ((nSteps + k) % 2 == 0)
         {
-            p[i] = p0 * p[i + 1] + p1 * p[i];
-            exercise = opt.S * pow(u, 2 * i - j) - opt.K;
-            if (type == PUT)
-                exercise *= -1.0;
-
-            if (p[i] < exercise)
-                p[i] = exercise;
+            exerciseEven[(nSteps + k) / 2] = sign * (up - opt.K);
+            exerciseEven[(nSteps - k) / 2] = sign * (down - opt.K);
         }
+        else
+        {
+            exerciseOdd[(nSteps + k) / 2] = sign * (up - opt.K);
+            exerciseOdd[(nSteps - k) / 2] = sign * (down - opt.K);
+        }
+    }
+
+    for (int i = 0; i <= nSteps; i++)
+        p[i] = fmax(exerciseEven[i], 0.0);
+
+    for (int j = nSteps - 1; j >= 0; j--)
+    {
+        int k0 = nSteps - j;
+        const double *levelExercise = k0 % 2 == 0 ? exerciseEven + k0 / 2 : exerciseOdd + k0 / 2;
+        simdRollbackLevel(p, levelExercise, j + 1, p0, p1);
+        if (j == 2 && level2 != NULL)
+            memcpy(level2, p, 3 * sizeof *p);
+        else if (j == 1 && level1 != NULL)
+            memcpy(level1, p, 2 * sizeof *p);
     }
-    price = p[0];
+    double price = p[0];
 
-    free(p);
+    free(allocated);
 
     return price;
 }
 
-int binomial_option_implied_volatility(Option opt, OptionType type, double actualPrice, double *impliedVolatility)
+double binomial_option_value(Option opt, OptionType type)
 {
-    if (impliedVolatility == NULL)
+    return binomial_tree(opt, type, BINOMIAL_N_STEPS, NULL, NULL, NULL);
+}
+
+double binomial_option_value_steps(Option opt, OptionType type, int nSteps, double *workspace)
+{
+    return binomial_tree(opt, type, nSteps, workspace, NULL, NULL);
+}
+
+// Value, delta, gamma and theta from one backward induction.
+// Delta and gamma come from the first two levels of the tree, theta from
+// the middle node two steps in, which has the same underlying price.
+// Vega and rho are not available from the tree and are set to NaN.
+OptionGeeks binomial_option_value_and_geeks(Option opt, OptionType type)
+{
+    OptionGeeks geeks = {0};
+    double level1[2] = {0};
+    double level2[3] = {0};
+
+    // No tree without time or volatility left: book value
+    if (opt.T <= 0.0 || opt.v <= 0.0)
+    {
+        Option expired = opt;
+        expired.T = 0.0;
+        return blackscholes_option_value_and_geeks(expired, type);
+    }
+
+    geeks.value = binomial_tree(opt, type, BINOMIAL_N_STEPS, NULL, level1, level2);
+
+    double dt = opt.T / BINOMIAL_N_STEPS;
+    double u = exp(opt.v * sqrt(dt));
+    double d = 1 / u;
+
+    geeks.delta = (level1[1] - level1[0]) / (opt.S * (u - d));
+    double deltaUp = (level2[2] - level2[1]) / (opt.S * (u * u - 1.0));
+    double deltaDown = (level2[1] - level2[0]) / (opt.S * (1.0 - d * d));
+    geeks.gamma = (deltaUp - deltaDown) / (0.5 * opt.S * (u * u - d * d));
+    geeks.theta = (level2[1] - geeks.value) / (2.0 * dt) / OPTIONS_TRADING_DAYS_PER_YEAR;
+    geeks.vega = nan("");
+    geeks.rho = nan("");
+
+    return geeks;
+}
+
+// Each tree is already vectorized along its levels, so options are priced one at a time
+int binomial_option_value_batch(const OptionBatch *batch, double *values)
+{
+    if (values == NULL)
         return ON_MISSING_RETURN_POINTER;
+    int status = checkBatch(batch);
+    if (status != ON_OK)
+        return status;
 
-    Option searchOpt = opt;
-    searchOpt.v = 1.0;
+    for (size_t i = 0; i < batch->n; i++)
+        values[i] = binomial_option_value(batchOption(batch, i), batch->type[i]);
 
-    double theoreticalPrice = binomial_option_value(searchOpt, type);
-    double lastTheoreticalPrice = -1.0;
+    return ON_OK;
+}
 
-    int iterations = 0;
-    double deltaV = 0.1;
-    double deltaVDecay = 0.9;
+int binomial_option_value_and_geeks_batch(const OptionBatch *batch, OptionGeeksBatch *geeks)
+{
+    if (geeks == NULL)
+        return ON_MISSING_RETURN_POINTER;
+    int status = checkBatch(batch);
+    if (status != ON_OK)
+        return status;
 
-    double priceDiff = fabs(theoreticalPrice - actualPrice);
-    while (iterations < IV_MAX_ITERATIONS && priceDiff > IV_MAX_PRICE_DIFFERENCE && fabs(theoreticalPrice - lastTheoreticalPrice) > IV_MIN_PRICE_CHANGE)
-    {
-        if (actualPrice > theoreticalPrice)
-            deltaV = deltaVDecay * fabs(deltaV);
-        else
-            deltaV = -deltaVDecay * fabs(deltaV);
-        
-        if (deltaV < 0 && -deltaV >= searchOpt.v)
-            searchOpt.v *= 0.9;
-        else
-            searchOpt.v += deltaV;
+    for (size_t i = 0; i < batch->n; i++)
+        storeGeeks(geeks, i, binomial_option_value_and_geeks(batchOption(batch, i), batch->type[i]));
 
-        lastTheoreticalPrice = theoreticalPrice;
-        theoreticalPrice = binomial_option_value(searchOpt, type);
-        priceDiff = fabs(theoreticalPrice - actualPrice);
-        iterations++;
-    }
-    if (iterations == IV_MAX_ITERATIONS)
-    {
-        return ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED;
-    }
-    // No solution - market bid was less than book value?
-    if (fabs(theoreticalPrice - lastTheoreticalPrice) < IV_MIN_PRICE_CHANGE)
-        *impliedVolatility = nan("");
-    else
-        *impliedVolatility = searchOpt.v;
     return ON_OK;
 }
 
+int binomial_option_implied_volatility(Option opt, OptionType type, double actualPrice, double *impliedVolatility)
+{
+    int status = option_implied_volatility(opt, type, actualPrice, binomial_option_value, impliedVolatility, NULL);
+    // No solution - market bid was less than book value?
+    if (status == ON_OPTIONS_MODELS_NO_SOLUTION)
+        status = ON_OK;
+
+    return status;
+}
+
+// Newton steps on the tree's value and delta, kept inside a bracket in S
+// that falls back to bisection (or doubling until a price is too high)
 int binomial_option_implied_price_of_underlying(Option opt, OptionType type, double optionPrice, double *impliedPriceOfUnderlying)
 {
     if (impliedPriceOfUnderlying == NULL)
         return ON_MISSING_RETURN_POINTER;
 
-    Option searchOpt = opt;
-    searchOpt.S = 0.0;
+    *impliedPriceOfUnderlying = nan("");
 
-    double theoreticalPrice = binomial_option_value(searchOpt, type);
-    double lastTheoreticalPrice = -1.0;
+    // A put is worth less than K, and calls and puts more than nothing
+    if (opt.K <= 0.0 || !(optionPrice > 0.0) || (type == PUT && optionPrice >= opt.K))
+        return ON_OPTIONS_MODELS_NO_SOLUTION;
 
-    int iterations = 0;
-    double deltaS = 10;
-    double deltaSDecay = 0.9;
+    // Calls gain and puts lose value with S; sign * (value - price) increases with S
+    double sign = type == PUT ? -1.0 : 1.0;
+    // A call is worth less than S and a put at least K - S, so S lies above lo.
+    // hi is only a bracket once a price there has been found too high.
+    double lo = type == PUT ? opt.K - optionPrice : optionPrice;
+    double hi = INFINITY;
+    // A deep in-the-money American put trades at K - S, exactly the bound
+    bool loTried = false;
+
+    Option trial = opt;
+    trial.S = fmax(opt.K, 2.0 * lo);
 
-    double priceDiff = fabs(theoreticalPrice - optionPrice);
-    while (iterations < IV_MAX_ITERATIONS && priceDiff > IV_MAX_PRICE_DIFFERENCE && fabs(theoreticalPrice - lastTheoreticalPrice) > IV_MIN_PRICE_CHANGE)
+    int status = ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED;
+    for (int evaluations = 0; evaluations < IV_MAX_EVALUATIONS; evaluations++)
     {
-        if (optionPrice > theoreticalPrice)
-            deltaS = deltaSDecay * fabs(deltaS);
-        else
-            deltaS = -deltaSDecay * fabs(deltaS);
-        
-        if (deltaS < 0 && -deltaS >= searchOpt.S)
-            searchOpt.v *= 0.9;
+        OptionGeeks geeks = binomial_option_value_and_geeks(trial, type);
+        double diff = sign * (geeks.value - optionPrice);
+        if (fabs(diff) < IV_MAX_PRICE_DIFFERENCE)
+        {
+            status = ON_OK;
+            break;
+        }
+        if (diff > 0.0)
+            hi = trial.S;
         else
-            searchOpt.S += deltaS;
+            lo = trial.S;
+        if (!isinf(hi) && hi - lo <= 4.0 * DBL_EPSILON * hi)
+        {
+            status = ON_OK;
+            break;
+        }
 
-        lastTheoreticalPrice = theoreticalPrice;
-        theoreticalPrice = binomial_option_value(searchOpt, type);
-        priceDiff = fabs(theoreticalPrice - optionPrice);
-        iterations++;
-    }
-    if (iterations == IV_MAX_ITERATIONS)
-    {
-        return ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED;
+        double slope = sign * geeks.delta;
+        double next = slope > 0.0 ? trial.S - diff / slope : nan("");
+        if (next <= lo && !loTried)
+        {
+            next = lo;
+            loTried = true;
+        }
+        else if (!(next > lo && next < hi))
+            next = isinf(hi) ? 2.0 * trial.S : 0.5 * (lo + hi);
+        trial.S = next;
     }
-    // No solution - market bid was less than book value?
-    if (fabs(theoreticalPrice - lastTheoreticalPrice) < IV_MIN_PRICE_CHANGE)
-        *impliedPriceOfUnderlying= nan("");
-    else
-        *impliedPriceOfUnderlying = searchOpt.S;
-    return ON_OK;
+    if (status == ON_OK)
+        *impliedPriceOfUnderlying = trial.S;
+
+    return status;
 }
 
 double option_geeks(Option opt, OptionType type, char *geek, double (*optionValueFunction)(Option, OptionType))
@@ -257,11 +548,744 @@ double option_geeks(Option opt, OptionType type, char *geek, double (*optionValu
 
 double black_scholes_option_geeks(Option opt, OptionType type, char *geek)
 {
-    return option_geeks(opt, type, geek, blackscholes_option_value);
+    if (geek == NULL)
+        return nan("");
+
+    OptionGeeks geeks = blackscholes_option_value_and_geeks(opt, type);
+
+    if (strcasecmp("d$dt", geek) == 0)
+        return geeks.theta;
+    else if (strcasecmp("d$dV", geek) == 0)
+        return geeks.vega;
+    else if (strcasecmp("d$dP", geek) == 0)
+        return geeks.delta;
+    else if (strcasecmp("d2$dP2", geek) == 0)
+        return geeks.gamma;
+    else if (strcasecmp("d$dr", geek) == 0)
+        return geeks.rho;
+
+    return nan("");
 }
 
 double binomial_option_geeks(Option opt, OptionType type, char *geek)
 {
+    if (geek == NULL)
+        return nan("");
+
+    // Delta, gamma and theta come from a single tree
+    if (strcasecmp("d$dt", geek) == 0)
+        return binomial_option_value_and_geeks(opt, type).theta;
+    else if (strcasecmp("d$dP", geek) == 0)
+        return binomial_option_value_and_geeks(opt, type).delta;
+    else if (strcasecmp("d2$dP2", geek) == 0)
+        return binomial_option_value_and_geeks(opt, type).gamma;
+
     return option_geeks(opt, type, geek, binomial_option_value);
 }
 
+
+// "Let's Be Rational", P. Jaeckel (2015), Wilmott pp 40-53, with the
+// refinements of the 2016 reference implementation.
+// Works with the normalised Black price b(x, s) = price / sqrt(F K) of an
+// out-of-the-money call, x = ln(F / K) <= 0, s = v sqrt(T). Four rational
+// cubic branches give a guess that two Householder(3) steps bring to
+// machine precision.
+
+#define LBR_ITERATIONS 2
+#define LBR_ASYMPTOTIC_EXPANSION_THRESHOLD -10.0
+// 2 * DBL_EPSILON^(1/16)
+#define LBR_SMALL_T_EXPANSION_THRESHOLD 0.21081851067789195
+#define LBR_MIN_CONTROL_PARAMETER (-(1.0 - 1.4901161193847656e-08))
+#define LBR_MAX_CONTROL_PARAMETER (2.0 / (DBL_EPSILON * DBL_EPSILON))
+#define LBR_SQRT_DBL_MAX 1.3407807929942596e+154
+// 98 * DBL_EPSILON^(1/4)
+#define LBR_INTRINSIC_SERIES_LIMIT 0.01197548774766322
+
+static double norm_cdf(double z)
+{
+    return 0.5 * erfc(-z * M_SQRT1_2);
+}
+
+static double norm_pdf(double z)
+{
+    return exp(-0.5 * z * z) / sqrt(2.0 * M_PI);
+}
+
+// exp(x^2) erfc(x), with x^2 split so that exp() sees an exact argument
+static double erfcx(double x)
+{
+    if (x < 26.0)
+    {
+        double xHigh = (double)(float)x;
+        double xLow = x - xHigh;
+        return erfc(x) * exp(xHigh * xHigh) * exp(xLow * (2.0 * xHigh + xLow));
+    }
+
+    // Asymptotic series, beyond where erfc() underflows
+    double z = 0.5 / (x * x);
+    double series = 1.0 - z * (1.0 - 3.0 * z * (1.0 - 5.0 * z * (1.0 - 7.0 * z * (1.0 - 9.0 * z * (1.0 - 11.0 * z * (1.0 - 13.0 * z * (1.0 - 15.0 * z)))))));
+
+    return series / (x * sqrt(M_PI));
+}
+
+// Acklam's rational approximation, polished by one Halley step on erfc()
+static double inverse_norm_cdf(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+    const double pLow = 0.02425;
+
+    if (p <= 0.0)
+        return -HUGE_VAL;
+    if (p >= 1.0)
+        return HUGE_VAL;
+
+    double x = 0.0;
+    if (p < pLow || p > 1.0 - pLow)
+    {
+        double q = sqrt(-2.0 * log(p < pLow ? p : 1.0 - p));
+        x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+        if (p > 1.0 - pLow)
+            x = -x;
+    }
+    else
+    {
+        double q = p - 0.5;
+        double r = q * q;
+        x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0);
+    }
+
+    double e = norm_cdf(x) - p;
+    double u = e * sqrt(2.0 * M_PI) * exp(0.5 * x * x);
+
+    return x - u / (1.0 + 0.5 * x * u);
+}
+
+static double householder_factor(double newton, double halley, double hh3)
+{
+    return (1.0 + 0.5 * halley * newton) / (1.0 + newton * (halley + hh3 * newton / 6.0));
+}
+
+// Normalised intrinsic value; theta is +1 for calls, -1 for puts
+static double normalised_intrinsic(double x, double theta)
+{
+    if (theta * x <= 0.0)
+        return 0.0;
+
+    double x2 = x * x;
+    // sinh series where exp(x / 2) - exp(-x / 2) cancels
+    if (x2 < LBR_INTRINSIC_SERIES_LIMIT)
+        return fabs(fmax(theta * x * (1.0 + x2 * (1.0 / 24.0 + x2 * (1.0 / 1920.0 + x2 * (1.0 / 322560.0 + (1.0 / 92897280.0) * x2)))), 0.0));
+
+    double bMax = exp(0.5 * x);
+
+    return fabs(fmax(theta * (bMax - 1.0 / bMax), 0.0));
+}
+
+// h = x / s < -10: sum of the Mills ratio series of both terms, combined
+// without cancellation. With e = (t / h)^2 and q = (h / r)^2, r = (h + t)(h - t),
+// b = pdf * (t / r) * sum_k (-1)^k 2 (2k - 1)!! q^k sum_i C(2k + 1, 2i + 1) e^i
+static double asymptotic_expansion_of_normalised_black_call(double h, double t)
+{
+    double e = (t / h) * (t / h);
+    double r = (h + t) * (h - t);
+    double q = (h / r) * (h / r);
+
+    double sum = 0.0;
+    double qk = 1.0;
+    double doubleFactorial = 1.0;
+    for (int k = 0; k <= 17; k++)
+    {
+        int n = 2 * k + 1;
+        double binomial = n;
+        double ei = 1.0;
+        double inner = 0.0;
+        for (int i = 0; i <= k; i++)
+        {
+            inner += binomial * ei;
+            binomial *= (double)(n - 2 * i - 1) * (double)(n - 2 * i - 2) / ((double)(2 * i + 2) * (double)(2 * i + 3));
+            ei *= e;
+        }
+        sum += (k % 2 == 0 ? 2.0 : -2.0) * doubleFactorial * inner * qk;
+        doubleFactorial *= n;
+        qk *= q;
+    }
+
+    double b = exp(-0.5 * (h * h + t * t)) / sqrt(2.0 * M_PI) * (t / r) * sum;
+
+    return fabs(fmax(b, 0.0));
+}
+
+// t = s / 2 small: Taylor series in t of M(h + t) - M(h - t), M = cdf / pdf,
+// whose odd derivatives are P_n(h^2) + h Q_n(h^2) M(h)
+static double small_t_expansion_of_normalised_black_call(double h, double t)
+{
+    static const double P[7][7] = {
+        {1},
+        {2, 1},
+        {8, 9, 1},
+        {48, 87, 20, 1},
+        {384, 975, 345, 35, 1},
+        {3840, 12645, 6090, 938, 54, 1},
+        {46080, 187425, 114765, 23814, 2070, 77, 1}
+    };
+    static const double Q[7][7] = {
+        {1},
+        {3, 1},
+        {15, 10, 1},
+        {105, 105, 21, 1},
+        {945, 1260, 378, 36, 1},
+        {10395, 17325, 6930, 990, 55, 1},
+        {135135, 270270, 135135, 25740, 2145, 78, 1}
+    };
+
+    double h2 = h * h;
+    double w = t * t;
+    double mills = 0.5 * sqrt(2.0 * M_PI) * erfcx(-M_SQRT1_2 * h);
+
+    // Horner in w = t^2 from the highest order, t^(2j + 1) / (2j + 1)!
+    double expansion = 0.0;
+    for (int j = 6; j >= 0; j--)
+    {
+        double p = 0.0;
+        double q = 0.0;
+        for (int i = j; i >= 0; i--)
+        {
+            p = p * h2 + P[j][i];
+            q = q * h2 + Q[j][i];
+        }
+        double factorial = 1.0;
+        for (int f = 2; f <= 2 * j + 1; f++)
+            factorial *= f;
+        expansion = expansion * w + (p + h * q * mills) / factorial;
+    }
+    expansion *= 2.0 * t;
+
+    double b = exp(-0.5 * (h * h + t * t)) / sqrt(2.0 * M_PI) * expansion;
+
+    return fabs(fmax(b, 0.0));
+}
+
+static double normalised_black_call_using_norm_cdf(double x, double s)
+{
+    double h = x / s;
+    double t = 0.5 * s;
+    double bMax = exp(0.5 * x);
+    double b = norm_cdf(h + t) * bMax - norm_cdf(h - t) / bMax;
+
+    return fabs(fmax(b, 0.0));
+}
+
+static double normalised_black_call_using_erfcx(double h, double t)
+{
+    double b = 0.5 * exp(-0.5 * (h * h + t * t)) * (erfcx(-M_SQRT1_2 * (h + t)) - erfcx(-M_SQRT1_2 * (h - t)));
+
+    return fabs(fmax(b, 0.0));
+}
+
+static double normalised_black_call(double x, double s)
+{
+    // In the money via put-call parity
+    if (x > 0.0)
+        return normalised_intrinsic(x, 1.0) + normalised_black_call(-x, s);
+    if (s <= 0.0)
+        return normalised_intrinsic(x, 1.0);
+
+    // h < -10 and h + t small enough, without dividing by s
+    if (x < s * LBR_ASYMPTOTIC_EXPANSION_THRESHOLD && 0.5 * s * s + x < s * (LBR_SMALL_T_EXPANSION_THRESHOLD + LBR_ASYMPTOTIC_EXPANSION_THRESHOLD))
+        return asymptotic_expansion_of_normalised_black_call(x / s, 0.5 * s);
+    if (0.5 * s < LBR_SMALL_T_EXPANSION_THRESHOLD)
+        return small_t_expansion_of_normalised_black_call(x / s, 0.5 * s);
+    // Beyond about 85% of exp(x / 2) the first term dominates
+    if (x + 0.5 * s * s > s * 0.85)
+        return normalised_black_call_using_norm_cdf(x, s);
+
+    return normalised_black_call_using_erfcx(x / s, 0.5 * s);
+}
+
+static double normalised_vega(double x, double s)
+{
+    double ax = fabs(x);
+    if (ax <= 0.0)
+        return exp(-0.125 * s * s) / sqrt(2.0 * M_PI);
+    if (s <= 0.0 || s <= ax * sqrt(DBL_MIN))
+        return 0.0;
+
+    return exp(-0.5 * ((x / s) * (x / s) + 0.25 * s * s)) / sqrt(2.0 * M_PI);
+}
+
+static double rational_cubic_interpolation(double x, double xL, double xR, double yL, double yR, double dL, double dR, double r)
+{
+    double h = xR - xL;
+    if (fabs(h) <= 0.0)
+        return 0.5 * (yL + yR);
+
+    double t = (x - xL) / h;
+    if (!(r >= LBR_MAX_CONTROL_PARAMETER))
+    {
+        double omt = 1.0 - t;
+        double t2 = t * t;
+        double omt2 = omt * omt;
+        return (yR * t2 * t + (r * yR - h * dR) * t2 * omt + (r * yL + h * dL) * t * omt2 + yL * omt2 * omt) / (1.0 + (r - 3.0) * t * omt);
+    }
+
+    return yR * t + yL * (1.0 - t);
+}
+
+static bool is_zero(double x)
+{
+    return fabs(x) < DBL_MIN;
+}
+
+static double minimum_rational_cubic_control_parameter(double dL, double dR, double s, bool preferShapePreservation)
+{
+    bool monotonic = dL * s >= 0.0 && dR * s >= 0.0;
+    bool convex = dL <= s && s <= dR;
+    bool concave = dL >= s && s >= dR;
+    if (!monotonic && !convex && !concave)
+        return LBR_MIN_CONTROL_PARAMETER;
+
+    double r1 = -DBL_MAX;
+    double r2 = -DBL_MAX;
+    if (monotonic)
+    {
+        if (!is_zero(s))
+            r1 = (dR + dL) / s;
+        else if (preferShapePreservation)
+            r1 = LBR_MAX_CONTROL_PARAMETER;
+    }
+    if (convex || concave)
+    {
+        if (!(is_zero(s - dL) || is_zero(dR - s)))
+            r2 = fmax(fabs((dR - dL) / (dR - s)), fabs((dR - dL) / (s - dL)));
+        else if (preferShapePreservation)
+            r2 = LBR_MAX_CONTROL_PARAMETER;
+    }
+    else if (monotonic && preferShapePreservation)
+        r2 = LBR_MAX_CONTROL_PARAMETER;
+
+    return fmax(LBR_MIN_CONTROL_PARAMETER, fmax(r1, r2));
+}
+
+static double control_parameter_from_slopes(double numerator, double denominator)
+{
+    if (is_zero(numerator))
+        return 0.0;
+    if (is_zero(denominator))
+        return numerator > 0.0 ? LBR_MAX_CONTROL_PARAMETER : LBR_MIN_CONTROL_PARAMETER;
+
+    return numerator / denominator;
+}
+
+static double convex_control_parameter_at_left_side(double xL, double xR, double yL, double yR, double dL, double dR, double secondDerivativeL, bool preferShapePreservation)
+{
+    double h = xR - xL;
+    double r = control_parameter_from_slopes(0.5 * h * secondDerivativeL + (dR - dL), (yR - yL) / h - dL);
+
+    return fmax(r, minimum_rational_cubic_control_parameter(dL, dR, (yR - yL) / h, preferShapePreservation));
+}
+
+static double convex_control_parameter_at_right_side(double xL, double xR, double yL, double yR, double dL, double dR, double secondDerivativeR, bool preferShapePreservation)
+{
+    double h = xR - xL;
+    double r = control_parameter_from_slopes(0.5 * h * secondDerivativeR + (dR - dL), dR - (yR - yL) / h);
+
+    return fmax(r, minimum_rational_cubic_control_parameter(dL, dR, (yR - yL) / h, preferShapePreservation));
+}
+
+static void f_lower_map_and_derivatives(double x, double s, double *f, double *fp, double *fpp)
+{
+    double ax = fabs(x);
+    double z = ax / (sqrt(3.0) * s);
+    double y = z * z;
+    double s2 = s * s;
+    double Phi = norm_cdf(-z);
+    double phi = norm_pdf(z);
+
+    *fpp = M_PI / 6.0 * y / (s2 * s) * Phi * (8.0 * sqrt(3.0) * s * ax + (3.0 * s2 * (s2 - 8.0) - 8.0 * x * x) * Phi / phi) * exp(2.0 * y + 0.25 * s2);
+    if (s <= 0.0)
+    {
+        *fp = 1.0;
+        *f = 0.0;
+        return;
+    }
+    double Phi2 = Phi * Phi;
+    *fp = 2.0 * M_PI * y * Phi2 * exp(y + 0.125 * s2);
+    *f = x == 0.0 ? 0.0 : 2.0 * M_PI / sqrt(27.0) * ax * Phi2 * Phi;
+
+    return;
+}
+
+static double inverse_f_lower_map(double x, double f)
+{
+    if (f <= 0.0)
+        return 0.0;
+
+    return fabs(x / (sqrt(3.0) * inverse_norm_cdf(cbrt(f / (2.0 * M_PI / sqrt(27.0) * fabs(x))))));
+}
+
+static void f_upper_map_and_derivatives(double x, double s, double *f, double *fp, double *fpp)
+{
+    *f = norm_cdf(-0.5 * s);
+    if (x == 0.0)
+    {
+        *fp = -0.5;
+        *fpp = 0.0;
+        return;
+    }
+    double w = (x / s) * (x / s);
+    *fp = -0.5 * exp(0.5 * w);
+    *fpp = sqrt(M_PI / 2.0) * exp(w + 0.125 * s * s) * w / s;
+
+    return;
+}
+
+static double inverse_f_upper_map(double f)
+{
+    return -2.0 * inverse_norm_cdf(f);
+}
+
+// Bisects if the iteration leaves [sLeft, sRight] or keeps changing direction;
+// returns true when the bracket has closed
+static bool lbr_safeguard(double *s, double *ds, double dsPrevious, int iteration, int *directionReversals, double sLeft, double sRight)
+{
+    if (*ds * dsPrevious < 0.0)
+        (*directionReversals)++;
+    if (iteration > 0 && (*directionReversals == 3 || !(*s > sLeft && *s < sRight)))
+    {
+        *s = 0.5 * (sLeft + sRight);
+        if (sRight - sLeft <= DBL_EPSILON * *s)
+            return true;
+        *directionReversals = 0;
+        *ds = 0.0;
+    }
+
+    return false;
+}
+
+// s = v sqrt(T) for normalised price beta of an option with x = ln(F / K);
+// theta is +1 for calls, -1 for puts. Returns NaN outside the attainable range.
+static double normalised_implied_volatility(double beta, double x, double theta)
+{
+    // In the money to out of the money, then puts to calls
+    if (theta * x > 0.0)
+    {
+        beta = fabs(fmax(beta - normalised_intrinsic(x, theta), 0.0));
+        theta = -theta;
+    }
+    if (theta < 0.0)
+        x = -x;
+    if (beta <= 0.0)
+        return nan("");
+
+    double bMax = exp(0.5 * x);
+    if (beta >= bMax)
+        return nan("");
+
+    int iterations = 0;
+    int directionReversals = 0;
+    double f = -DBL_MAX;
+    double s = -DBL_MAX;
+    double ds = s;
+    double dsPrevious = 0.0;
+    double sLeft = DBL_MIN;
+    double sRight = DBL_MAX;
+
+    double sC = sqrt(fabs(2.0 * x));
+    double bC = normalised_black_call(x, sC);
+    double vC = normalised_vega(x, sC);
+
+    if (beta < bC)
+    {
+        double sL = sC - bC / vC;
+        double bL = normalised_black_call(x, sL);
+        if (beta < bL)
+        {
+            // Lowest branch: rational cubic in the transformed f_lower_map, then
+            // Householder steps on 1 / ln(b) - 1 / ln(beta)
+            double fLower = 0.0, dfLower = 0.0, d2fLower = 0.0;
+            f_lower_map_and_derivatives(x, sL, &fLower, &dfLower, &d2fLower);
+            double r = convex_control_parameter_at_right_side(0.0, bL, 0.0, fLower, 1.0, dfLower, d2fLower, true);
+            f = rational_cubic_interpolation(beta, 0.0, bL, 0.0, fLower, 1.0, dfLower, r);
+            if (!(f > 0.0))
+            {
+                double t = beta / bL;
+                f = (fLower * t + bL * (1.0 - t)) * t;
+            }
+            s = inverse_f_lower_map(x, f);
+            sRight = sL;
+            for (; iterations < LBR_ITERATIONS && fabs(ds) > DBL_EPSILON * s; iterations++)
+            {
+                if (lbr_safeguard(&s, &ds, dsPrevious, iterations, &directionReversals, sLeft, sRight))
+                    break;
+                dsPrevious = ds;
+                double b = normalised_black_call(x, s);
+                double bp = normalised_vega(x, s);
+                if (b > beta && s < sRight)
+                    sRight = s;
+                else if (b < beta && s > sLeft)
+                    sLeft = s;
+                if (b <= 0.0 || bp <= 0.0)
+                    ds = 0.5 * (sLeft + sRight) - s;
+                else
+                {
+                    double lnB = log(b);
+                    double lnBeta = log(beta);
+                    double bpob = bp / b;
+                    double h = x / s;
+                    double bHalley = h * h / s - s / 4.0;
+                    double newton = (lnBeta - lnB) * lnB / lnBeta / bpob;
+                    double halley = bHalley - bpob * (1.0 + 2.0 / lnB);
+                    double bHh3 = bHalley * bHalley - 3.0 * (h / s) * (h / s) - 0.25;
+                    double hh3 = bHh3 + 2.0 * bpob * bpob * (1.0 + 3.0 / lnB * (1.0 + 1.0 / lnB)) - 3.0 * bHalley * bpob * (1.0 + 2.0 / lnB);
+                    ds = newton * householder_factor(newton, halley, hh3);
+                }
+                ds = fmax(-0.5 * s, ds);
+                s += ds;
+            }
+            return s;
+        }
+        double vL = normalised_vega(x, sL);
+        double r = convex_control_parameter_at_right_side(bL, bC, sL, sC, 1.0 / vL, 1.0 / vC, 0.0, false);
+        s = rational_cubic_interpolation(beta, bL, bC, sL, sC, 1.0 / vL, 1.0 / vC, r);
+        sLeft = sL;
+        sRight = sC;
+    }
+    else
+    {
+        double sH = vC > DBL_MIN ? sC + (bMax - bC) / vC : sC;
+        double bH = normalised_black_call(x, sH);
+        if (beta <= bH)
+        {
+            double vH = normalised_vega(x, sH);
+            double r = convex_control_parameter_at_left_side(bC, bH, sC, sH, 1.0 / vC, 1.0 / vH, 0.0, false);
+            s = rational_cubic_interpolation(beta, bC, bH, sC, sH, 1.0 / vC, 1.0 / vH, r);
+            sLeft = sC;
+            sRight = sH;
+        }
+        else
+        {
+            // Highest branch: rational cubic in the transformed f_upper_map
+            double fUpper = 0.0, dfUpper = 0.0, d2fUpper = 0.0;
+            f_upper_map_and_derivatives(x, sH, &fUpper, &dfUpper, &d2fUpper);
+            if (d2fUpper > -LBR_SQRT_DBL_MAX && d2fUpper < LBR_SQRT_DBL_MAX)
+            {
+                double r = convex_control_parameter_at_left_side(bH, bMax, fUpper, 0.0, dfUpper, -0.5, d2fUpper, true);
+                f = rational_cubic_interpolation(beta, bH, bMax, fUpper, 0.0, dfUpper, -0.5, r);
+            }
+            if (f <= 0.0)
+            {
+                double h = bMax - bH;
+                double t = (beta - bH) / h;
+                f = (fUpper * (1.0 - t) + 0.5 * h * t) * (1.0 - t);
+            }
+            s = inverse_f_upper_map(f);
+            sLeft = sH;
+            // Householder steps on ln((bMax - beta) / (bMax - b)), unless beta
+            // is low enough for the plain objective below
+            if (beta > 0.5 * bMax)
+            {
+                for (; iterations < LBR_ITERATIONS && fabs(ds) > DBL_EPSILON * s; iterations++)
+                {
+                    if (lbr_safeguard(&s, &ds, dsPrevious, iterations, &directionReversals, sLeft, sRight))
+                        break;
+                    dsPrevious = ds;
+                    double b = normalised_black_call(x, s);
+                    double bp = normalised_vega(x, s);
+                    if (b > beta && s < sRight)
+                        sRight = s;
+                    else if (b < beta && s > sLeft)
+                        sLeft = s;
+                    if (b >= bMax || bp <= DBL_MIN)
+                        ds = 0.5 * (sLeft + sRight) - s;
+                    else
+                    {
+                        double betaBar = bMax - beta;
+                        double bBar = bMax - b;
+                        double g = log(betaBar / bBar);
+                        double gp = bp / bBar;
+                        double h = x / s;
+                        double bHalley = h * h / s - s / 4.0;
+                        double bHh3 = bHalley * bHalley - 3.0 * (h / s) * (h / s) - 0.25;
+                        double newton = -g / gp;
+                        double halley = bHalley + gp;
+                        double hh3 = bHh3 + gp * (2.0 * gp + 3.0 * bHalley);
+                        ds = newton * householder_factor(newton, halley, hh3);
+                    }
+                    ds = fmax(-0.5 * s, ds);
+                    s += ds;
+                }
+                return s;
+            }
+        }
+    }
+
+    // Middle branches: Householder steps on b - beta
+    for (; iterations < LBR_ITERATIONS && fabs(ds) > DBL_EPSILON * s; iterations++)
+    {
+        if (lbr_safeguard(&s, &ds, dsPrevious, iterations, &directionReversals, sLeft, sRight))
+            break;
+        dsPrevious = ds;
+        double b = normalised_black_call(x, s);
+        double bp = normalised_vega(x, s);
+        if (b > beta && s < sRight)
+            sRight = s;
+        else if (b < beta && s > sLeft)
+            sLeft = s;
+        double newton = (beta - b) / bp;
+        double halley = (x / s) * (x / s) / s - s / 4.0;
+        double hh3 = halley * halley - 3.0 * (x / (s * s)) * (x / (s * s)) - 0.25;
+        ds = fmax(-0.5 * s, newton * householder_factor(newton, halley, hh3));
+        s += ds;
+    }
+
+    return s;
+}
+
+int blackscholes_option_implied_volatility(Option opt, OptionType type, double optionPrice, double *impliedVolatility)
+{
+    if (impliedVolatility == NULL)
+        return ON_MISSING_RETURN_POINTER;
+
+    *impliedVolatility = nan("");
+    if (opt.T <= 0.0 || opt.S <= 0.0 || opt.K <= 0.0)
+        return ON_OPTIONS_MODELS_NO_SOLUTION;
+
+    // Undiscounted (Black) price on the forward
+    double F = opt.S * exp((opt.r - opt.q) * opt.T);
+    double price = optionPrice * exp(opt.r * opt.T);
+    double s = normalised_implied_volatility(price / sqrt(F * opt.K), log(F / opt.K), type == PUT ? -1.0 : 1.0);
+    if (isnan(s))
+        return ON_OPTIONS_MODELS_NO_SOLUTION;
+
+    *impliedVolatility = s / sqrt(opt.T);
+
+    return ON_OK;
+}
+
+double implied_volatility_estimate(Option opt, OptionType type, double optionPrice)
+{
+    double S = opt.S * exp(-opt.q * opt.T);
+    double X = opt.K * exp(-opt.r * opt.T);
+    // Put-call parity
+    double callPrice = type == PUT ? optionPrice + S - X : optionPrice;
+
+    double a = callPrice - 0.5 * (S - X);
+    double b = a * a - (S - X) * (S - X) / M_PI;
+    double estimate = sqrt(2.0 * M_PI / opt.T) / (S + X) * (a + sqrt(fmax(b, 0.0)));
+    if (!isfinite(estimate) || estimate <= 0.0)
+        estimate = sqrt(2.0 * M_PI / opt.T) * optionPrice / S;
+
+    return fmin(fmax(estimate, IV_MIN_VOLATILITY), IV_MAX_VOLATILITY);
+}
+
+int option_implied_volatility(Option opt, OptionType type, double optionPrice, double (*optionValueFunction)(Option, OptionType), double *impliedVolatility, int *evaluations)
+{
+    if (impliedVolatility == NULL)
+        return ON_MISSING_RETURN_POINTER;
+    if (optionValueFunction == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    *impliedVolatility = nan("");
+    int nEvaluations = 0;
+    int status = ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED;
+
+    // No volatility gives a price outside the no-arbitrage bounds
+    double sign = type == PUT ? -1.0 : 1.0;
+    double lowerBound = fmax(sign * (opt.S * exp(-opt.q * opt.T) - opt.K * exp(-opt.r * opt.T)), 0.0);
+    double upperBound = type == PUT ? opt.K : opt.S;
+    if (opt.T <= 0.0 || !(optionPrice > lowerBound && optionPrice < upperBound))
+    {
+        status = ON_OPTIONS_MODELS_NO_SOLUTION;
+        goto done;
+    }
+
+    // Price increases with volatility: below lo is too cheap, above hi too dear.
+    // hi is only a bracket once a price there has been found too high.
+    double lo = 0.0;
+    double hi = IV_MAX_VOLATILITY;
+    bool bracketed = false;
+    double lastWidth = hi - lo;
+    int slowSteps = 0;
+
+    // The European implied volatility is exact for Black-Scholes and an upper
+    // bound for American prices, which are at least the European value
+    Option trial = opt;
+    if (blackscholes_option_implied_volatility(opt, type, optionPrice, &trial.v) != ON_OK)
+        trial.v = implied_volatility_estimate(opt, type, optionPrice);
+    trial.v = fmin(fmax(trial.v, IV_MIN_VOLATILITY), IV_MAX_VOLATILITY);
+    double previousV = nan("");
+    double previousDiff = nan("");
+
+    while (nEvaluations < IV_MAX_EVALUATIONS)
+    {
+        double diff = optionValueFunction(trial, type) - optionPrice;
+        nEvaluations++;
+        if (fabs(diff) < IV_MAX_PRICE_DIFFERENCE)
+        {
+            status = ON_OK;
+            break;
+        }
+        if (diff > 0.0)
+        {
+            if (trial.v <= IV_MIN_VOLATILITY)
+            {
+                status = ON_OPTIONS_MODELS_NO_SOLUTION;
+                break;
+            }
+            hi = trial.v;
+            bracketed = true;
+        }
+        else
+        {
+            if (trial.v >= IV_MAX_VOLATILITY)
+            {
+                status = ON_OPTIONS_MODELS_NO_SOLUTION;
+                break;
+            }
+            lo = trial.v;
+        }
+
+        // Secant slope once there are two points, Black-Scholes vega otherwise
+        double slope = (diff - previousDiff) / (trial.v - previousV);
+        if (!isfinite(slope) || slope <= 0.0)
+            slope = blackscholes_option_value_and_geeks(trial, type).vega * 100.0;
+        double next = trial.v - diff / slope;
+
+        // Bisect if the step leaves the bracket or the bracket stops shrinking
+        if (bracketed && hi - lo > 0.5 * lastWidth)
+            slowSteps++;
+        else
+            slowSteps = 0;
+        lastWidth = hi - lo;
+        if (!isfinite(next) || next <= lo || next >= hi || slowSteps > 1)
+        {
+            next = bracketed ? 0.5 * (lo + hi) : fmin(2.0 * trial.v, IV_MAX_VOLATILITY);
+            if (next <= lo)
+                next = 0.5 * (lo + hi);
+            slowSteps = 0;
+        }
+        next = fmin(fmax(next, IV_MIN_VOLATILITY), IV_MAX_VOLATILITY);
+
+        if (fabs(next - trial.v) < IV_VOLATILITY_TOLERANCE)
+        {
+            trial.v = next;
+            status = ON_OK;
+            break;
+        }
+        previousV = trial.v;
+        previousDiff = diff;
+        trial.v = next;
+    }
+
+    if (status == ON_OK)
+        *impliedVolatility = trial.v;
+
+done:
+    if (evaluations != NULL)
+        *evaluations = nEvaluations;
+
+    return status;
+}
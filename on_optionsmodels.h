@@ -19,6 +19,8 @@
 
 #include "on_data.h"
 
+#include <stddef.h>
+
 typedef struct {
     double S; // Security price
     double K; // Strike
@@ -28,21 +30,82 @@ typedef struct {
     double T; // Trading years until expiration (assume 251 trading days per year)
 } Option;
 
-// Black-Scholes
+// Value and geeks in the same units as option_geeks()
+typedef struct {
+    double value; // Option value ($)
+    double delta; // $/$ of underlying price
+    double gamma; // $/$/$ of underlying price
+    double vega; // $/% of volatility
+    double theta; // $/trading day
+    double rho; // $/% of risk-free rate
+} OptionGeeks;
+
+// Structure-of-arrays batch of n options, e.g. a whole chain.
+// Members are as in Option; q may be NULL for no dividends.
+typedef struct {
+    size_t n;
+    const double *S;
+    const double *K;
+    const double *r;
+    const double *q;
+    const double *v;
+    const double *T;
+    const OptionType *type;
+} OptionBatch;
+
+// Caller arrays of n outputs for a batch; NULL members are not computed
+typedef struct {
+    double *value;
+    double *delta;
+    double *gamma;
+    double *vega;
+    double *theta;
+    double *rho;
+} OptionGeeksBatch;
+
+// Black-Scholes (Merton's form with continuous dividend yield opt.q)
 double cdf(double x);
+double pdf(double x);
 double d1(double S, double K, double r, double sigma, double t);
 double d2(double d1Val, double sigma, double t);
 double blackscholes_option_value(Option opt, OptionType type);
+OptionGeeks blackscholes_option_value_and_geeks(Option opt, OptionType type);
+int blackscholes_option_value_batch(const OptionBatch *batch, double *values);
+int blackscholes_option_value_and_geeks_batch(const OptionBatch *batch, OptionGeeksBatch *geeks);
+// Volatility giving the European optionPrice to machine precision with two
+// iterations of Jaeckel's "Let's Be Rational" method. Returns
+// ON_OPTIONS_MODELS_NO_SOLUTION with NaN if optionPrice is at or below intrinsic
+// value or at or above the upper bound.
+int blackscholes_option_implied_volatility(Option opt, OptionType type, double optionPrice, double *impliedVolatility);
 
 // Binomial no dividend
 
 #define BINOMIAL_N_STEPS 500
+// Number of doubles of scratch space for a tree with nSteps steps
+#define BINOMIAL_WORKSPACE_SIZE(nSteps) (3 * (nSteps) + 2)
 #define IV_MAX_ITERATIONS 300
 #define IV_MAX_PRICE_DIFFERENCE 0.000001
 #define IV_MIN_PRICE_CHANGE 0.000001
+// Implied volatility search range (fraction) and limits
+#define IV_MIN_VOLATILITY 0.0001
+#define IV_MAX_VOLATILITY 10.0
+#define IV_VOLATILITY_TOLERANCE 1e-8
+#define IV_MAX_EVALUATIONS 50
 
 double binomial_option_value(Option opt, OptionType type);
+// workspace holds BINOMIAL_WORKSPACE_SIZE(nSteps) doubles, or is NULL to use
+// per-thread scratch space (heap for nSteps > BINOMIAL_N_STEPS)
+double binomial_option_value_steps(Option opt, OptionType type, int nSteps, double *workspace);
+OptionGeeks binomial_option_value_and_geeks(Option opt, OptionType type);
+int binomial_option_value_batch(const OptionBatch *batch, double *values);
+// Vega and rho are not available from the tree and are set to NaN
+int binomial_option_value_and_geeks_batch(const OptionBatch *batch, OptionGeeksBatch *geeks);
+// Sets *impliedVolatility to NaN and returns ON_OK if no volatility gives actualPrice
 int binomial_option_implied_volatility(Option opt, OptionType type, double actualPrice, double *impliedVolatility);
+// Underlying price at which the option is worth optionPrice, from Newton steps on
+// the tree's delta inside a bisection bracket. Returns ON_OPTIONS_MODELS_NO_SOLUTION
+// (NaN) if no price gives optionPrice and ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED
+// if the search does not converge
 int binomial_option_implied_price_of_underlying(Option opt, OptionType type, double optionPrice, double *impliedPriceOfUnderlying);
 
 
@@ -52,4 +115,14 @@ double option_geeks(Option opt, OptionType type, char *geek, double (*optionValu
 double black_scholes_option_geeks(Option opt, OptionType type, char *geek);
 double binomial_option_geeks(Option opt, OptionType type, char *geek);
 
+// Implied volatility
+// Corrado-Miller estimate from the European price, or Brenner-Subrahmanyam where that fails
+double implied_volatility_estimate(Option opt, OptionType type, double optionPrice);
+// Volatility at which optionValueFunction gives optionPrice, from Newton steps
+// (Black-Scholes vega, then secant slopes) kept inside a bracket that falls back
+// to bisection, starting at the Black-Scholes implied volatility. *evaluations (if not NULL) is set to the number of model evaluations.
+// Returns ON_OPTIONS_MODELS_NO_SOLUTION if optionPrice is outside the model's range
+// and ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED if the search does not converge
+int option_implied_volatility(Option opt, OptionType type, double optionPrice, double (*optionValueFunction)(Option, OptionType), double *impliedVolatility, int *evaluations);
+
 #endif // _ON_OPTIONSMODELS_H
@@ -16,122 +16,445 @@
 
 #include "on_optionstiming.h"
 #include "on_status.h"
+#include "on_config.h"
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-// Function created by ChatGPT from
-// "Can you show this code as a function called daysToTrade that takes the year, month and day of expiry as input?"
-// on 11 Jan 2023
+// Days since 1970-01-01 in the proleptic Gregorian calendar, from
+// H. Hinnant, "chrono-Compatible Low-Level Date Algorithms".
+// Years start in March so that the leap day is the last day of the year.
+long daysFromCivil(Date date)
+{
+    long y = date.year - (date.month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yearOfEra = y - era * 400;
+    long dayOfYear = (153 * (date.month + (date.month > 2 ? -3 : 9)) + 2) / 5 + date.day - 1;
+    long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+    return era * 146097 + dayOfEra - 719468;
+}
+
+Date civilFromDays(long days)
+{
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long dayOfEra = days - era * 146097;
+    long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    long mp = (5 * dayOfYear + 2) / 153;
+
+    Date date = {0};
+    date.day = (int)(dayOfYear - (153 * mp + 2) / 5 + 1);
+    date.month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    date.year = (int)(yearOfEra + era * 400 + (date.month <= 2));
+
+    return date;
+}
+
+// 0 for Sunday to 6 for Saturday; 1970-01-01 was a Thursday
+int dayOfWeek(Date date)
+{
+    long days = daysFromCivil(date);
+
+    return (int)(days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6);
+}
+
+// Weekdays before day number days, counted from Monday 1969-12-29
+static long weekdaysBefore(long days)
+{
+    long sinceMonday = days + 3;
+    long weeks = sinceMonday >= 0 ? sinceMonday / 7 : -((-sinceMonday + 6) / 7);
+    long rest = sinceMonday - 7 * weeks;
+
+    return 5 * weeks + (rest < 5 ? rest : 5);
+}
+
+int weekdaysBetween(Date from, Date to)
+{
+    long first = daysFromCivil(from);
+    long last = daysFromCivil(to);
+    if (last < first)
+        return 0;
+
+    return (int)(weekdaysBefore(last + 1) - weekdaysBefore(first));
+}
+
+Date todaysDate(void)
+{
+    time_t now = time(NULL);
+    struct tm local = {0};
+    localtime_r(&now, &local);
+
+    Date date = {local.tm_year + 1900, local.tm_mon + 1, local.tm_mday};
+
+    return date;
+}
+
+// Exchange holidays
+
+// Closures outside the regular rules
+static const Date specialClosures[] = {
+    {2001, 9, 11}, {2001, 9, 12}, {2001, 9, 13}, {2001, 9, 14}, // September 11
+    {2004, 6, 11}, // President Reagan's funeral
+    {2007, 1, 2}, // President Ford's funeral
+    {2012, 10, 29}, {2012, 10, 30}, // Hurricane Sandy
+    {2018, 12, 5}, // President G. H. W. Bush's funeral
+    {2025, 1, 9}, // President Carter's funeral
+};
+
+static long firstCalendarDay = 0;
+static long nCalendarDays = 0;
+// tradingDaysBefore[i] is the number of trading days from the first day of
+// CALENDAR_FIRST_YEAR up to (not including) day firstCalendarDay + i
+static int *tradingDaysBefore = NULL;
+static pthread_once_t calendarOnce = PTHREAD_ONCE_INIT;
+
+// n-th (1-based) day of week (0 for Sunday) of a month, or the last if n is 0
+static Date nthWeekdayOfMonth(int year, int month, int weekday, int n)
+{
+    Date date = {year, month, 1};
+    if (n == 0)
+    {
+        Date nextMonth = {month == 12 ? year + 1 : year, month == 12 ? 1 : month + 1, 1};
+        long last = daysFromCivil(nextMonth) - 1;
+        int lastWeekday = dayOfWeek(civilFromDays(last));
+        return civilFromDays(last - (lastWeekday - weekday + 7) % 7);
+    }
+    date.day = 1 + (weekday - dayOfWeek(date) + 7) % 7 + 7 * (n - 1);
+
+    return date;
+}
+
+// Western Easter Sunday (anonymous Gregorian algorithm)
+static Date easterSunday(int year)
+{
+    int a = year % 19;
+    int b = year / 100;
+    int c = year % 100;
+    int d = b / 4;
+    int e = b % 4;
+    int f = (b + 8) / 25;
+    int g = (b - f + 1) / 3;
+    int h = (19 * a + b - d - g + 15) % 30;
+    int i = c / 4;
+    int k = c % 4;
+    int l = (32 + 2 * e + 2 * i - h - k) % 7;
+    int m = (a + 11 * h + 22 * l) / 451;
+    Date date = {year, (h + l - 7 * m + 114) / 31, (h + l - 7 * m + 114) % 31 + 1};
+
+    return date;
+}
+
+// Saturday holidays are observed on Friday, Sunday holidays on Monday
+static long observed(Date date)
+{
+    long day = daysFromCivil(date);
+    int weekday = dayOfWeek(date);
+    if (weekday == 6)
+        return day - 1;
+    if (weekday == 0)
+        return day + 1;
+
+    return day;
+}
+
+static void setClosed(bool *closed, long day, bool isClosed)
+{
+    if (day >= firstCalendarDay && day < firstCalendarDay + nCalendarDays)
+        closed[day - firstCalendarDay] = isClosed;
+
+    return;
+}
+
+// NYSE holiday rules; CBOE follows the same schedule for equity and index options
+static void markHolidays(bool *closed, int year)
+{
+    // New Year's Day is not observed on the Friday before when it is a Saturday
+    Date newYear = {year, 1, 1};
+    if (dayOfWeek(newYear) != 6)
+        setClosed(closed, observed(newYear), true);
+    setClosed(closed, daysFromCivil(nthWeekdayOfMonth(year, 1, 1, 3)), true); // Martin Luther King Jr. Day
+    setClosed(closed, daysFromCivil(nthWeekdayOfMonth(year, 2, 1, 3)), true); // Washington's Birthday
+    setClosed(closed, daysFromCivil(easterSunday(year)) - 2, true); // Good Friday
+    setClosed(closed, daysFromCivil(nthWeekdayOfMonth(year, 5, 1, 0)), true); // Memorial Day
+    if (year >= 2022)
+        setClosed(closed, observed((Date){year, 6, 19}), true); // Juneteenth
+    setClosed(closed, observed((Date){year, 7, 4}), true); // Independence Day
+    setClosed(closed, daysFromCivil(nthWeekdayOfMonth(year, 9, 1, 1)), true); // Labor Day
+    setClosed(closed, daysFromCivil(nthWeekdayOfMonth(year, 11, 4, 4)), true); // Thanksgiving
+    setClosed(closed, observed((Date){year, 12, 25}), true); // Christmas
+
+    return;
+}
+
+// Lines of ~/.optionsnumerics/on_holidays.txt are "yyyy-mm-dd" for an extra
+// closure or "yyyy-mm-dd open" to trade on a rule holiday; # starts a comment
+static void loadHolidayOverrides(bool *closed)
+{
+    char holidaysFile[FILENAME_MAX] = {0};
+    char *home = getenv("HOME");
+    if (home == NULL || strlen(home) == 0)
+        return;
+    snprintf(holidaysFile, FILENAME_MAX, "%s/%s/%s", home, ON_OPTIONS_DIR, ON_HOLIDAYS_FILENAME);
+
+    FILE *f = fopen(holidaysFile, "r");
+    if (f == NULL)
+        return;
+
+    char line[ON_BUFFERED_LINE_LENGTH] = {0};
+    while (fgets(line, ON_BUFFERED_LINE_LENGTH, f) != NULL)
+    {
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        Date date = {0};
+        char keyword[8] = {0};
+        int n = sscanf(line, "%d-%d-%d %7s", &date.year, &date.month, &date.day, keyword);
+        if (n < 3 || date.month < 1 || date.month > 12 || date.day < 1 || date.day > 31)
+            continue;
+        setClosed(closed, daysFromCivil(date), !(n == 4 && strcasecmp(keyword, "open") == 0));
+    }
+    fclose(f);
+
+    return;
+}
+
+static void buildTradingDayIndex(void)
+{
+    firstCalendarDay = daysFromCivil((Date){CALENDAR_FIRST_YEAR, 1, 1});
+    nCalendarDays = daysFromCivil((Date){CALENDAR_LAST_YEAR + 1, 1, 1}) - firstCalendarDay;
+
+    bool *closed = calloc(nCalendarDays, sizeof *closed);
+    int *index = malloc((nCalendarDays + 1) * sizeof *index);
+    if (closed == NULL || index == NULL)
+    {
+        free(closed);
+        free(index);
+        return;
+    }
+
+    for (int year = CALENDAR_FIRST_YEAR; year <= CALENDAR_LAST_YEAR; year++)
+        markHolidays(closed, year);
+    for (size_t i = 0; i < sizeof specialClosures / sizeof specialClosures[0]; i++)
+        setClosed(closed, daysFromCivil(specialClosures[i]), true);
+    loadHolidayOverrides(closed);
+
+    // Prefix sums of trading days, weekends included as closed
+    index[0] = 0;
+    for (long i = 0; i < nCalendarDays; i++)
+    {
+        int weekday = dayOfWeek(civilFromDays(firstCalendarDay + i));
+        bool trading = weekday != 0 && weekday != 6 && !closed[i];
+        index[i + 1] = index[i] + (trading ? 1 : 0);
+    }
+    free(closed);
+    tradingDaysBefore = index;
+
+    return;
+}
+
+static bool calendarCovers(long day)
+{
+    pthread_once(&calendarOnce, buildTradingDayIndex);
+
+    return tradingDaysBefore != NULL && day >= firstCalendarDay && day < firstCalendarDay + nCalendarDays;
+}
+
+bool isTradingDay(Date date)
+{
+    long day = daysFromCivil(date);
+    if (!calendarCovers(day))
+        return weekdaysBetween(date, date) == 1;
+
+    return tradingDaysBefore[day - firstCalendarDay + 1] > tradingDaysBefore[day - firstCalendarDay];
+}
+
+// Not counting weekends and exchange holidays; weekends only outside the
+// calendar's years
+int tradingDaysBetween(Date asOf, Date expiry)
+{
+    long first = daysFromCivil(asOf);
+    long last = daysFromCivil(expiry);
+    if (last < first)
+        return 0;
+    if (!calendarCovers(first) || !calendarCovers(last))
+        return weekdaysBetween(asOf, expiry);
+
+    return tradingDaysBefore[last - firstCalendarDay + 1] - tradingDaysBefore[first - firstCalendarDay];
+}
+
 int tradingDaysToExpiry(Date date)
 {
-    int trading_days = 0;
-    time_t now;
-    struct tm expiry_tm;
-    struct tm *now_tm;
-
-    // Set the expiry date using the input year, month, and day
-    expiry_tm.tm_year = date.year - 1900;
-    expiry_tm.tm_mon = date.month - 1;
-    expiry_tm.tm_mday = date.day;
-    expiry_tm.tm_hour = 0;
-    expiry_tm.tm_min = 0;
-    expiry_tm.tm_sec = 0;
-    // First try by ChatGPT did not initialize tm_yday. It corrected this when I pointed it out.
-    expiry_tm.tm_isdst = -1;
-    mktime(&expiry_tm);
-
-    time(&now);
-    now_tm = localtime(&now);
-
-    // go through each date between now and expiry,
-    // counting the trading days
-    while (now_tm->tm_year < expiry_tm.tm_year ||
-           (now_tm->tm_year == expiry_tm.tm_year &&
-            now_tm->tm_yday <= expiry_tm.tm_yday))
+    return tradingDaysBetween(todaysDate(), date);
+}
+
+// Intraday time
+
+// Early closes at 13:00: the day after Thanksgiving, and July 3 and
+// December 24 when they are trading days
+static bool isEarlyClose(Date date)
+{
+    if (date.month == 11)
+        return daysFromCivil(date) == daysFromCivil(nthWeekdayOfMonth(date.year, 11, 4, 4)) + 1;
+    if ((date.month == 7 && date.day == 3) || (date.month == 12 && date.day == 24))
+        return isTradingDay(date);
+
+    return false;
+}
+
+int sessionMinutes(Date date)
+{
+    if (!isTradingDay(date))
+        return 0;
+
+    return (isEarlyClose(date) ? MARKET_EARLY_CLOSE_MINUTE : MARKET_CLOSE_MINUTE) - MARKET_OPEN_MINUTE;
+}
+
+// New York time from UTC, with US daylight saving time (since 2007) from 02:00
+// on the second Sunday in March to 02:00 on the first Sunday in November
+void easternTime(time_t utc, Date *date, int *minuteOfDay)
+{
+    long seconds = (long)utc;
+    long days = seconds >= 0 ? seconds / 86400 : -((-seconds + 86399) / 86400);
+    int year = civilFromDays(days).year;
+    long dstStart = daysFromCivil(nthWeekdayOfMonth(year, 3, 0, 2)) * 86400 + 7 * 3600;
+    long dstEnd = daysFromCivil(nthWeekdayOfMonth(year, 11, 0, 1)) * 86400 + 6 * 3600;
+    long local = seconds - (seconds >= dstStart && seconds < dstEnd ? 4 : 5) * 3600;
+    long localDays = local >= 0 ? local / 86400 : -((-local + 86399) / 86400);
+
+    *date = civilFromDays(localDays);
+    *minuteOfDay = (int)((local - localDays * 86400) / 60);
+
+    return;
+}
+
+// Early closes from day first through day last
+static int earlyClosesBetween(long first, long last)
+{
+    int n = 0;
+    Date from = civilFromDays(first);
+    Date to = civilFromDays(last);
+    for (int year = from.year; year <= to.year; year++)
     {
-        // if not a weekend
-        if (now_tm->tm_wday != 0 && now_tm->tm_wday != 6)
-        {
-            trading_days++;
-        }
-        now_tm->tm_mday++;
-        mktime(now_tm);
+        long candidates[3] = {
+            daysFromCivil((Date){year, 7, 3}),
+            daysFromCivil(nthWeekdayOfMonth(year, 11, 4, 4)) + 1,
+            daysFromCivil((Date){year, 12, 24})
+        };
+        for (int c = 0; c < 3; c++)
+            if (candidates[c] >= first && candidates[c] <= last && isEarlyClose(civilFromDays(candidates[c])))
+                n++;
     }
-    return trading_days;
+
+    return n;
 }
 
-// If date is not a Friday, advances date to the next Friday
-// Returns the date difference in days
-int makeSureItsAFriday(Date *date)
+double tradingYearsBetween(time_t asOf, Date expiry)
 {
+    Date today = {0};
+    int minuteOfDay = 0;
+    easternTime(asOf, &today, &minuteOfDay);
 
-    if (date == NULL)
-        return -1;
+    long first = daysFromCivil(today);
+    long last = daysFromCivil(expiry);
+    if (last < first)
+        return 0.0;
 
-    struct tm d = {0};
-    d.tm_year = date->year - 1900;
-    d.tm_mon = date->month - 1;
-    d.tm_mday = date->day;
+    // Rest of today's session
+    int close = MARKET_OPEN_MINUTE + sessionMinutes(today);
+    long minutes = close - (minuteOfDay > MARKET_OPEN_MINUTE ? minuteOfDay : MARKET_OPEN_MINUTE);
+    if (minutes < 0)
+        minutes = 0;
 
-    int days = 0;
-    while (d.tm_wday != 5)
+    // Whole sessions through the close on expiry
+    if (last > first)
     {
-        d.tm_mday += 1;
-        days++;
-        mktime(&d);
+        Date tomorrow = civilFromDays(first + 1);
+        minutes += (long)tradingDaysBetween(tomorrow, expiry) * MARKET_SESSION_MINUTES;
+        minutes -= (long)earlyClosesBetween(first + 1, last) * (MARKET_CLOSE_MINUTE - MARKET_EARLY_CLOSE_MINUTE);
     }
-    date->year = d.tm_year + 1900;
-    date->month = d.tm_mon + 1;
-    date->day = d.tm_mday;
 
-    return days;
+    return (double)minutes / ((double)OPTIONS_TRADING_DAYS_PER_YEAR * MARKET_SESSION_MINUTES);
 }
 
-int advanceN3rdFridaysOfTheMonth(Date *date, int n)
+// Per-thread cache of recent expiries, valid for the minute they were computed in
+#define TRADING_YEARS_CACHE_SIZE 64
+
+typedef struct {
+    long expiryDay;
+    long asOfMinute;
+    double years;
+} TradingYearsCacheEntry;
+
+static _Thread_local TradingYearsCacheEntry tradingYearsCache[TRADING_YEARS_CACHE_SIZE];
+
+double tradingYearsToExpiry(Date expiry)
+{
+    time_t now = time(NULL);
+    long asOfMinute = (long)now / 60 + 1;
+    long expiryDay = daysFromCivil(expiry);
+
+    TradingYearsCacheEntry *entry = &tradingYearsCache[(unsigned long)expiryDay % TRADING_YEARS_CACHE_SIZE];
+    if (entry->asOfMinute != asOfMinute || entry->expiryDay != expiryDay)
+    {
+        entry->expiryDay = expiryDay;
+        entry->asOfMinute = asOfMinute;
+        entry->years = tradingYearsBetween((time_t)(asOfMinute - 1) * 60, expiry);
+    }
+
+    return entry->years;
+}
+
+// Monthly and weekly options expiring on an exchange holiday expire on the
+// trading day before
+static long expiryOnOrBefore(long day)
+{
+    while (!isTradingDay(civilFromDays(day)))
+        day--;
+
+    return day;
+}
+
+// If date is not a Friday, advances date to the next Friday, or to the
+// trading day before it if that Friday is an exchange holiday.
+// Returns the date difference in days
+int makeSureItsAFriday(Date *date)
 {
     if (date == NULL)
-        return ON_MISSING_ARG_POINTER;
+        return -1;
 
-    struct tm day = {0};
-    day.tm_year = date->year - 1900;
-    day.tm_mon = date->month - 1;
-    day.tm_mday = date->day;
+    long day = daysFromCivil(*date);
+    long friday = day + (5 - dayOfWeek(*date) + 7) % 7;
+    long expiry = expiryOnOrBefore(friday);
+    *date = civilFromDays(expiry);
 
-    struct tm firstOfTheMonth = {0};
-    firstOfTheMonth.tm_year = date->year - 1900;
-    firstOfTheMonth.tm_mon = date->month - 1;
-    firstOfTheMonth.tm_mday = 0;
+    return (int)(expiry - day);
+}
 
-    int nFridays = 0;
-    do
-    {
-        firstOfTheMonth.tm_mday = firstOfTheMonth.tm_mday + 1;
-        (void)timegm(&firstOfTheMonth);
-        if (firstOfTheMonth.tm_wday == 5)
-            nFridays++;
-    } while (nFridays < 3);
+// Moves date n monthly expiries (third Fridays, or the trading day before
+// if that is a holiday) ahead, or back for negative n
+int advanceN3rdFridaysOfTheMonth(Date *date, int n)
+{
+    if (date == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    Date thirdFriday = nthWeekdayOfMonth(date->year, date->month, 5, 3);
 
     int nMonths = n;
-    if (nMonths < 0 && day.tm_mday > firstOfTheMonth.tm_mday)
+    if (nMonths < 0 && date->day > thirdFriday.day)
         nMonths++;
-    else if (nMonths > 0 && day.tm_mday < firstOfTheMonth.tm_mday)
+    else if (nMonths > 0 && date->day < thirdFriday.day)
         nMonths--;
 
-    firstOfTheMonth.tm_mon = firstOfTheMonth.tm_mon + nMonths;
-    firstOfTheMonth.tm_mday = 0;
-    nFridays = 0;
-    do
-    {
-        firstOfTheMonth.tm_mday = firstOfTheMonth.tm_mday + 1;
-        (void)mktime(&firstOfTheMonth);
-        if (firstOfTheMonth.tm_wday == 5)
-            nFridays++;
-    } while (nFridays < 3);
-
-    date->year = firstOfTheMonth.tm_year + 1900;
-    date->month = firstOfTheMonth.tm_mon + 1;
-    date->day = firstOfTheMonth.tm_mday;
+    long months = (long)date->year * 12 + (date->month - 1) + nMonths;
+    long year = months >= 0 ? months / 12 : -((-months + 11) / 12);
+    thirdFriday = nthWeekdayOfMonth((int)year, (int)(months - 12 * year) + 1, 5, 3);
+    *date = civilFromDays(expiryOnOrBefore(daysFromCivil(thirdFriday)));
 
     return ON_OK;
 }
@@ -17,8 +17,21 @@
 #ifndef _ON_OPTIONTIMING_H
 #define _ON_OPTIONTIMING_H
 
+#include <stdbool.h>
+#include <time.h>
+
 #define OPTIONS_TRADING_DAYS_PER_YEAR 251
 
+// Years covered by the exchange holiday calendar; weekends only outside
+#define CALENDAR_FIRST_YEAR 2000
+#define CALENDAR_LAST_YEAR 2060
+
+// Regular session in minutes after midnight New York time
+#define MARKET_OPEN_MINUTE (9 * 60 + 30)
+#define MARKET_CLOSE_MINUTE (16 * 60)
+#define MARKET_EARLY_CLOSE_MINUTE (13 * 60)
+#define MARKET_SESSION_MINUTES (MARKET_CLOSE_MINUTE - MARKET_OPEN_MINUTE)
+
 typedef struct date
 {
     int year;
@@ -26,8 +39,36 @@ typedef struct date
     int day;    
 } Date;
 
+// Calendar arithmetic on day numbers, without libc time functions
+// Days since 1970-01-01 (negative before)
+long daysFromCivil(Date date);
+Date civilFromDays(long days);
+// 0 for Sunday to 6 for Saturday
+int dayOfWeek(Date date);
+// Monday to Friday from "from" through "to" inclusive, 0 if to is before from
+int weekdaysBetween(Date from, Date to);
+
+// Local date now
+Date todaysDate(void);
+// NYSE trading days: weekdays other than exchange holidays, with additions
+// and removals from ON_HOLIDAYS_FILENAME in the options directory.
+// The calendar is built on first use.
+bool isTradingDay(Date date);
+// Trading days from asOf through expiry, counting both if they are trading days
+int tradingDaysBetween(Date asOf, Date expiry);
+// Trading days from today through date
 int tradingDaysToExpiry(Date date);
 
+// Minutes in the session on date (shorter on early closes), 0 if closed
+int sessionMinutes(Date date);
+// New York date and minutes after midnight at utc
+void easternTime(time_t utc, Date *date, int *minuteOfDay);
+// Years of OPTIONS_TRADING_DAYS_PER_YEAR full sessions from asOf (UTC) to the
+// close on expiry, counting only minutes while the market is open
+double tradingYearsBetween(time_t asOf, Date expiry);
+// Same from now, computed once per expiry per minute on each thread
+double tradingYearsToExpiry(Date expiry);
+
 int makeSureItsAFriday(Date *date);
 
 int advanceN3rdFridaysOfTheMonth(Date *date, int n);
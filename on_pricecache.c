@@ -0,0 +1,421 @@
+/*
+    Options Numerics: on_pricecache.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_pricecache.h"
+#include "on_config.h"
+#include "on_status.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t nBars;
+    int64_t firstDay;
+    int64_t lastDay;
+} PriceCacheHeader;
+
+// Integer columns are int64_t on disk whatever the width of time_t and long;
+// where those are 64 bits wide, as on LP64 systems, every column can be used
+// in place from a mapping of the file
+#define PRICE_CACHE_CHUNK 512
+#define PRICE_CACHE_COLUMNS 8
+#define PRICE_CACHE_MAPPABLE (sizeof(time_t) == sizeof(int64_t) && sizeof(long) == sizeof(int64_t))
+#define PRICE_CACHE_TICKER_LENGTH 256
+
+long priceDataDay(time_t t)
+{
+    // Polygon.IO daily bars start at midnight New York time, which is
+    // 04:00 or 05:00 UTC on the same date
+    long seconds = (long)t;
+
+    return seconds >= 0 ? seconds / 86400 : -((-seconds + 86399) / 86400);
+}
+
+// Reallocates one column, leaving it as it was on failure
+#define RESERVE_COLUMN(column, n) \
+    do { \
+        void *p = realloc((column), (n) * sizeof *(column)); \
+        if (p == NULL) \
+            return ON_HEAP_MEMORY_ERROR; \
+        (column) = p; \
+    } while (0)
+
+int priceDataReserve(PriceData *data, size_t n)
+{
+    if (data == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    // Mapped columns are read-only: copy them to the heap before growing
+    if (data->mapping != NULL)
+    {
+        PriceData copy = {0};
+        int status = priceDataReserve(&copy, n > data->nPrices ? n : data->nPrices);
+        if (status != ON_OK)
+        {
+            freePriceData(&copy);
+            return status;
+        }
+        copy.nPrices = data->nPrices;
+        memcpy(copy.times, data->times, data->nPrices * sizeof *copy.times);
+        memcpy(copy.opens, data->opens, data->nPrices * sizeof *copy.opens);
+        memcpy(copy.highs, data->highs, data->nPrices * sizeof *copy.highs);
+        memcpy(copy.lows, data->lows, data->nPrices * sizeof *copy.lows);
+        memcpy(copy.closes, data->closes, data->nPrices * sizeof *copy.closes);
+        memcpy(copy.volumes, data->volumes, data->nPrices * sizeof *copy.volumes);
+        memcpy(copy.vwaps, data->vwaps, data->nPrices * sizeof *copy.vwaps);
+        memcpy(copy.nTransactions, data->nTransactions, data->nPrices * sizeof *copy.nTransactions);
+        freePriceData(data);
+        *data = copy;
+    }
+
+    size_t size = n > 0 ? n : 1;
+    RESERVE_COLUMN(data->times, size);
+    RESERVE_COLUMN(data->opens, size);
+    RESERVE_COLUMN(data->highs, size);
+    RESERVE_COLUMN(data->lows, size);
+    RESERVE_COLUMN(data->closes, size);
+    RESERVE_COLUMN(data->volumes, size);
+    RESERVE_COLUMN(data->vwaps, size);
+    RESERVE_COLUMN(data->nTransactions, size);
+
+    return ON_OK;
+}
+
+// Index of the first bar on or after day; bars are in time order
+static size_t priceDataFind(const PriceData *data, long day)
+{
+    size_t lo = 0;
+    size_t hi = data->nPrices;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (priceDataDay(data->times[mid]) < day)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+int priceDataAppend(PriceData *to, const PriceData *from, long firstDay, long lastDay)
+{
+    if (to == NULL || from == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    size_t first = priceDataFind(from, firstDay);
+    size_t last = lastDay < firstDay ? first : priceDataFind(from, lastDay + 1);
+    size_t n = last - first;
+    if (n == 0)
+        return ON_OK;
+
+    int status = priceDataReserve(to, to->nPrices + n);
+    if (status != ON_OK)
+        return status;
+
+    size_t i = to->nPrices;
+    memcpy(to->times + i, from->times + first, n * sizeof *to->times);
+    memcpy(to->opens + i, from->opens + first, n * sizeof *to->opens);
+    memcpy(to->highs + i, from->highs + first, n * sizeof *to->highs);
+    memcpy(to->lows + i, from->lows + first, n * sizeof *to->lows);
+    memcpy(to->closes + i, from->closes + first, n * sizeof *to->closes);
+    memcpy(to->volumes + i, from->volumes + first, n * sizeof *to->volumes);
+    memcpy(to->vwaps + i, from->vwaps + first, n * sizeof *to->vwaps);
+    memcpy(to->nTransactions + i, from->nTransactions + first, n * sizeof *to->nTransactions);
+    to->nPrices += n;
+
+    return ON_OK;
+}
+
+int priceDataSlice(PriceData *data, long firstDay, long lastDay)
+{
+    if (data == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    size_t first = priceDataFind(data, firstDay);
+    size_t last = lastDay < firstDay ? first : priceDataFind(data, lastDay + 1);
+    size_t n = last - first;
+
+    // Narrow a mapping in place; heap columns keep their start for free()
+    if (data->mapping != NULL)
+    {
+        data->times += first;
+        data->opens += first;
+        data->highs += first;
+        data->lows += first;
+        data->closes += first;
+        data->volumes += first;
+        data->vwaps += first;
+        data->nTransactions += first;
+    }
+    else if (first > 0 && n > 0)
+    {
+        memmove(data->times, data->times + first, n * sizeof *data->times);
+        memmove(data->opens, data->opens + first, n * sizeof *data->opens);
+        memmove(data->highs, data->highs + first, n * sizeof *data->highs);
+        memmove(data->lows, data->lows + first, n * sizeof *data->lows);
+        memmove(data->closes, data->closes + first, n * sizeof *data->closes);
+        memmove(data->volumes, data->volumes + first, n * sizeof *data->volumes);
+        memmove(data->vwaps, data->vwaps + first, n * sizeof *data->vwaps);
+        memmove(data->nTransactions, data->nTransactions + first, n * sizeof *data->nTransactions);
+    }
+    data->nPrices = n;
+
+    return ON_OK;
+}
+
+void freePriceData(PriceData *data)
+{
+    if (data == NULL)
+        return;
+
+    if (data->mapping != NULL)
+    {
+        munmap(data->mapping, data->mappingSize);
+        memset(data, 0, sizeof *data);
+        return;
+    }
+
+    free(data->times);
+    free(data->opens);
+    free(data->highs);
+    free(data->lows);
+    free(data->closes);
+    free(data->volumes);
+    free(data->vwaps);
+    free(data->nTransactions);
+    memset(data, 0, sizeof *data);
+
+    return;
+}
+
+// ~/.optionsnumerics/cache/<ticker>.bars, with characters other than letters
+// and digits (e.g. the colon in option tickers) replaced by underscores
+static int priceCacheFilename(const char *ticker, char *filename)
+{
+    char *home = getenv("HOME");
+    if (home == NULL || strlen(home) == 0 || ticker == NULL || strlen(ticker) == 0)
+        return ON_FILE_READ_ERROR;
+
+    char name[PRICE_CACHE_TICKER_LENGTH] = {0};
+    size_t i = 0;
+    for (; ticker[i] != '\0' && i < PRICE_CACHE_TICKER_LENGTH - 1; i++)
+        name[i] = isalnum((unsigned char)ticker[i]) ? ticker[i] : '_';
+    name[i] = '\0';
+
+    snprintf(filename, FILENAME_MAX, "%s/%s/%s/%s.bars", home, ON_OPTIONS_DIR, ON_PRICE_CACHE_DIR, name);
+
+    return ON_OK;
+}
+
+// Column c of a file of n bars
+static const void *priceCacheColumn(const void *mapping, size_t n, int c)
+{
+    return (const char *)mapping + sizeof(PriceCacheHeader) + (size_t)c * n * sizeof(int64_t);
+}
+
+int priceCacheLoad(const char *ticker, PriceData *data, long *firstDay, long *lastDay)
+{
+    if (data == NULL || firstDay == NULL || lastDay == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    memset(data, 0, sizeof *data);
+    *firstDay = 0;
+    *lastDay = -1;
+
+    char filename[FILENAME_MAX] = {0};
+    if (priceCacheFilename(ticker, filename) != ON_OK)
+        return ON_OK;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return ON_OK;
+    struct stat st = {0};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PriceCacheHeader))
+    {
+        close(fd);
+        return ON_OK;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return ON_OK;
+
+    // A damaged or outdated cache is ignored, and replaced on the next save
+    PriceCacheHeader header = {0};
+    memcpy(&header, mapping, sizeof header);
+    size_t n = header.nBars;
+    bool valid = memcmp(header.magic, PRICE_CACHE_MAGIC, sizeof PRICE_CACHE_MAGIC) == 0
+        && header.version == PRICE_CACHE_VERSION
+        && header.lastDay >= header.firstDay
+        && size >= sizeof header + PRICE_CACHE_COLUMNS * n * sizeof(int64_t);
+    if (!valid)
+    {
+        munmap(mapping, size);
+        return ON_OK;
+    }
+
+    if (PRICE_CACHE_MAPPABLE)
+    {
+        data->mapping = mapping;
+        data->mappingSize = size;
+        data->times = (time_t *)priceCacheColumn(mapping, n, 0);
+        data->nTransactions = (long *)priceCacheColumn(mapping, n, 7);
+    }
+    else if (priceDataReserve(data, n) == ON_OK)
+    {
+        const int64_t *times = priceCacheColumn(mapping, n, 0);
+        const int64_t *counts = priceCacheColumn(mapping, n, 7);
+        for (size_t i = 0; i < n; i++)
+        {
+            data->times[i] = (time_t)times[i];
+            data->nTransactions[i] = (long)counts[i];
+        }
+    }
+    else
+    {
+        freePriceData(data);
+        munmap(mapping, size);
+        return ON_HEAP_MEMORY_ERROR;
+    }
+    double **columns[] = {&data->opens, &data->highs, &data->lows, &data->closes, &data->volumes, &data->vwaps};
+    for (int c = 0; c < 6; c++)
+    {
+        if (PRICE_CACHE_MAPPABLE)
+            *columns[c] = (double *)priceCacheColumn(mapping, n, c + 1);
+        else
+            memcpy(*columns[c], priceCacheColumn(mapping, n, c + 1), n * sizeof(double));
+    }
+    data->nPrices = n;
+    if (!PRICE_CACHE_MAPPABLE)
+        munmap(mapping, size);
+
+    *firstDay = (long)header.firstDay;
+    *lastDay = (long)header.lastDay;
+
+    return ON_OK;
+}
+
+static bool writeColumn(FILE *f, const void *column, size_t size, size_t n)
+{
+    return fwrite(column, size, n, f) == n;
+}
+
+static bool writeTimesColumn(FILE *f, const time_t *column, size_t n)
+{
+    int64_t buffer[PRICE_CACHE_CHUNK];
+    for (size_t i = 0; i < n; i += PRICE_CACHE_CHUNK)
+    {
+        size_t m = n - i < PRICE_CACHE_CHUNK ? n - i : PRICE_CACHE_CHUNK;
+        for (size_t j = 0; j < m; j++)
+            buffer[j] = (int64_t)column[i + j];
+        if (fwrite(buffer, sizeof *buffer, m, f) != m)
+            return false;
+    }
+
+    return true;
+}
+
+static bool writeCountsColumn(FILE *f, const long *column, size_t n)
+{
+    int64_t buffer[PRICE_CACHE_CHUNK];
+    for (size_t i = 0; i < n; i += PRICE_CACHE_CHUNK)
+    {
+        size_t m = n - i < PRICE_CACHE_CHUNK ? n - i : PRICE_CACHE_CHUNK;
+        for (size_t j = 0; j < m; j++)
+            buffer[j] = (int64_t)column[i + j];
+        if (fwrite(buffer, sizeof *buffer, m, f) != m)
+            return false;
+    }
+
+    return true;
+}
+
+int priceCacheSave(const char *ticker, const PriceData *data, long firstDay, long lastDay)
+{
+    if (ticker == NULL || data == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    if (lastDay < firstDay)
+        return ON_OK;
+
+    char *home = getenv("HOME");
+    if (home == NULL || access(home, F_OK) != 0)
+        return ON_FILE_WRITE_ERROR;
+
+    char filename[FILENAME_MAX] = {0};
+    snprintf(filename, FILENAME_MAX, "%s/%s", home, ON_OPTIONS_DIR);
+    if (access(filename, F_OK))
+        if (mkdir(filename, 0700))
+            return ON_FILE_WRITE_ERROR;
+    snprintf(filename, FILENAME_MAX, "%s/%s/%s", home, ON_OPTIONS_DIR, ON_PRICE_CACHE_DIR);
+    if (access(filename, F_OK))
+        if (mkdir(filename, 0700))
+            return ON_FILE_WRITE_ERROR;
+
+    if (priceCacheFilename(ticker, filename) != ON_OK)
+        return ON_FILE_WRITE_ERROR;
+
+    size_t first = priceDataFind(data, firstDay);
+    size_t last = priceDataFind(data, lastDay + 1);
+    size_t n = last - first;
+
+    PriceCacheHeader header = {0};
+    memcpy(header.magic, PRICE_CACHE_MAGIC, sizeof PRICE_CACHE_MAGIC);
+    header.version = PRICE_CACHE_VERSION;
+    header.nBars = (uint32_t)n;
+    header.firstDay = firstDay;
+    header.lastDay = lastDay;
+
+    // Write a new file and rename it over the old so readers never see a partial cache
+    char tempFilename[FILENAME_MAX + 4] = {0};
+    snprintf(tempFilename, sizeof tempFilename, "%s.tmp", filename);
+    FILE *f = fopen(tempFilename, "wb");
+    if (f == NULL)
+        return ON_FILE_WRITE_ERROR;
+
+    bool written = fwrite(&header, sizeof header, 1, f) == 1;
+    if (written && n > 0)
+        written = writeTimesColumn(f, data->times + first, n)
+            && writeColumn(f, data->opens + first, sizeof *data->opens, n)
+            && writeColumn(f, data->highs + first, sizeof *data->highs, n)
+            && writeColumn(f, data->lows + first, sizeof *data->lows, n)
+            && writeColumn(f, data->closes + first, sizeof *data->closes, n)
+            && writeColumn(f, data->volumes + first, sizeof *data->volumes, n)
+            && writeColumn(f, data->vwaps + first, sizeof *data->vwaps, n)
+            && writeCountsColumn(f, data->nTransactions + first, n);
+    if (fclose(f) != 0)
+        written = false;
+
+    if (!written || rename(tempFilename, filename) != 0)
+    {
+        remove(tempFilename);
+        return ON_FILE_WRITE_ERROR;
+    }
+
+    return ON_OK;
+}
@@ -0,0 +1,55 @@
+/*
+    Options Numerics: on_pricecache.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_PRICECACHE_H
+#define _ON_PRICECACHE_H
+
+#include "on_data.h"
+
+#include <time.h>
+
+// Daily bars are kept one file per ticker in ~/.optionsnumerics/cache, with a
+// 32-byte header giving the range of days covered followed by one array of
+// 8-byte values per column: times, opens, highs, lows, closes, volumes, vwaps
+// and trade counts, in native byte order. Days in the range without a bar are
+// known to have had no trading.
+#define PRICE_CACHE_MAGIC "ONBARS"
+#define PRICE_CACHE_VERSION 1
+// A cached close differing from a fresh one by more than this fraction means
+// the bars were adjusted, e.g. for a split, after they were cached
+#define PRICE_CACHE_CLOSE_TOLERANCE 1e-4
+
+// Day number (see daysFromCivil()) of a daily bar starting at t
+long priceDataDay(time_t t);
+
+// Resizes each column for n bars; nPrices is unchanged
+int priceDataReserve(PriceData *data, size_t n);
+// Appends bars of from on days firstDay through lastDay
+int priceDataAppend(PriceData *to, const PriceData *from, long firstDay, long lastDay);
+// Keeps only the bars on days firstDay through lastDay, without copying if mapped
+int priceDataSlice(PriceData *data, long firstDay, long lastDay);
+// Frees the columns or unmaps the file
+void freePriceData(PriceData *data);
+
+// The columns of data point straight into a shared, read-only mapping of the
+// file, so the pages are loaded on demand and shared between processes; they are
+// copied to the heap before data grows. Sets *lastDay < *firstDay and returns
+// ON_OK with no bars if there is no cache.
+int priceCacheLoad(const char *ticker, PriceData *data, long *firstDay, long *lastDay);
+// Writes the bars of data on days firstDay through lastDay, replacing the cache
+int priceCacheSave(const char *ticker, const PriceData *data, long firstDay, long lastDay);
+
+#endif // _ON_PRICECACHE_H
@@ -0,0 +1,415 @@
+/*
+    Options Numerics: on_remote.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_remote.h"
+#include "on_status.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static pthread_once_t sessionOnce = PTHREAD_ONCE_INIT;
+static CURLSH *share = NULL;
+static pthread_mutex_t shareLocks[CURL_LOCK_DATA_LAST];
+// Each thread's easy handle and response buffer, freed when the thread exits
+typedef struct remoteThreadSession
+{
+    CURL *curl;
+    CurlData buffer;
+} RemoteThreadSession;
+static pthread_key_t handleKey;
+static bool sessionReady = false;
+
+// Ignores implausible Content-Length headers
+#define REMOTE_MAX_SIZE_HINT (64 * 1024 * 1024)
+
+static void lockShare(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void)handle;
+    (void)access;
+    (void)userptr;
+    pthread_mutex_lock(&shareLocks[data]);
+
+    return;
+}
+
+static void unlockShare(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+    (void)userptr;
+    pthread_mutex_unlock(&shareLocks[data]);
+
+    return;
+}
+
+static void freeThreadSession(void *session)
+{
+    RemoteThreadSession *threadSession = (RemoteThreadSession *)session;
+    if (threadSession->curl != NULL)
+        curl_easy_cleanup(threadSession->curl);
+    curlDataFree(&threadSession->buffer);
+    free(threadSession);
+
+    return;
+}
+
+static void initSession(void)
+{
+    if (pthread_key_create(&handleKey, freeThreadSession) != 0)
+        return;
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&shareLocks[i], NULL);
+
+    share = curl_share_init();
+    if (share != NULL)
+    {
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+    sessionReady = true;
+
+    return;
+}
+
+int remoteSessionInit(void)
+{
+    pthread_once(&sessionOnce, initSession);
+
+    return sessionReady ? ON_OK : ON_REST_LIBCURL_ERROR;
+}
+
+static RemoteThreadSession *threadSession(void)
+{
+    if (remoteSessionInit() != ON_OK)
+        return NULL;
+
+    RemoteThreadSession *session = pthread_getspecific(handleKey);
+    if (session == NULL)
+    {
+        session = calloc(1, sizeof *session);
+        if (session == NULL)
+            return NULL;
+        pthread_setspecific(handleKey, session);
+    }
+
+    return session;
+}
+
+CURL *remoteSessionHandle(void)
+{
+    RemoteThreadSession *session = threadSession();
+    if (session == NULL)
+        return NULL;
+
+    CURL *curl = session->curl;
+    if (curl == NULL)
+    {
+        curl = curl_easy_init();
+        if (curl == NULL)
+            return NULL;
+        session->curl = curl;
+    }
+    else
+        // Options from the last request go; connections and caches stay
+        curl_easy_reset(curl);
+
+    if (share != NULL)
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+
+    return curl;
+}
+
+CurlData *remoteSessionBuffer(void)
+{
+    RemoteThreadSession *session = threadSession();
+    if (session == NULL)
+        return NULL;
+
+    curlDataClear(&session->buffer);
+
+    return &session->buffer;
+}
+
+void remoteSessionCleanup(void)
+{
+    if (!sessionReady)
+        return;
+
+    RemoteThreadSession *session = pthread_getspecific(handleKey);
+    if (session != NULL)
+    {
+        pthread_setspecific(handleKey, NULL);
+        freeThreadSession(session);
+    }
+
+    // Left for the process to release if another thread still has a handle
+    if (share != NULL && curl_share_cleanup(share) == CURLSHE_OK)
+        share = NULL;
+
+    return;
+}
+
+int curlDataReserve(CurlData *data, size_t n)
+{
+    if (data == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    // Room for the terminating NUL too
+    size_t needed = data->size + n + 1;
+    if (needed <= data->capacity)
+        return ON_OK;
+
+    size_t capacity = data->capacity > 0 ? data->capacity : 4096;
+    while (capacity < needed)
+        capacity *= 2;
+    char *response = realloc(data->response, capacity);
+    if (response == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    data->response = response;
+    data->capacity = capacity;
+
+    return ON_OK;
+}
+
+int curlDataAppend(CurlData *data, const char *bytes, size_t n)
+{
+    int status = curlDataReserve(data, n);
+    if (status != ON_OK)
+        return status;
+
+    memcpy(data->response + data->size, bytes, n);
+    data->size += n;
+    data->response[data->size] = '\0';
+
+    return ON_OK;
+}
+
+void curlDataClear(CurlData *data)
+{
+    if (data == NULL)
+        return;
+
+    data->size = 0;
+    if (data->response != NULL)
+        data->response[0] = '\0';
+
+    return;
+}
+
+void curlDataFree(CurlData *data)
+{
+    if (data == NULL)
+        return;
+
+    free(data->response);
+    memset(data, 0, sizeof *data);
+
+    return;
+}
+
+static size_t remoteWriteCallback(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    size_t realsize = size * nmemb;
+    if (curlDataAppend((CurlData *)userdata, data, realsize) != ON_OK)
+        return 0;
+
+    return realsize;
+}
+
+static size_t remoteHeaderCallback(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    size_t realsize = size * nmemb;
+    const char *name = "content-length:";
+    size_t nameLength = strlen(name);
+    if (realsize > nameLength && strncasecmp(data, name, nameLength) == 0)
+    {
+        // The header is not NUL-terminated
+        char value[32] = {0};
+        size_t valueLength = realsize - nameLength < sizeof value - 1 ? realsize - nameLength : sizeof value - 1;
+        memcpy(value, data + nameLength, valueLength);
+        long long contentLength = strtoll(value, NULL, 10);
+        // A compressed body is longer once decoded; the buffer grows from there
+        if (contentLength > 0 && contentLength <= REMOTE_MAX_SIZE_HINT)
+            curlDataReserve((CurlData *)userdata, (size_t)contentLength);
+    }
+
+    return realsize;
+}
+
+void remoteReceiveInto(CURL *curl, CurlData *data)
+{
+    curlDataClear(data);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, remoteWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, remoteHeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, data);
+
+    return;
+}
+
+static double monotonicSeconds(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+int remotePerformAll(RemoteRequest *requests, size_t nRequests, int maxConcurrent, double requestsPerSecond)
+{
+    if (requests == NULL && nRequests > 0)
+        return ON_MISSING_ARG_POINTER;
+    if (nRequests == 0)
+        return ON_OK;
+    if (remoteSessionInit() != ON_OK)
+        return ON_REST_LIBCURL_ERROR;
+
+    if (maxConcurrent < 1)
+        maxConcurrent = 1;
+    if ((size_t)maxConcurrent > nRequests)
+        maxConcurrent = (int)nRequests;
+
+    CURLM *multi = curl_multi_init();
+    // One easy handle per slot, reused as requests finish, and the request
+    // each slot is working on (NULL if free)
+    CURL **slots = calloc(maxConcurrent, sizeof *slots);
+    RemoteRequest **active = calloc(maxConcurrent, sizeof *active);
+    if (multi == NULL || slots == NULL || active == NULL)
+    {
+        if (multi != NULL)
+            curl_multi_cleanup(multi);
+        free(slots);
+        free(active);
+        return ON_HEAP_MEMORY_ERROR;
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    for (size_t i = 0; i < nRequests; i++)
+    {
+        memset(&requests[i].response, 0, sizeof requests[i].response);
+        requests[i].httpCode = 0;
+        requests[i].status = ON_REST_LIBCURL_ERROR;
+    }
+
+    size_t next = 0;
+    size_t finished = 0;
+    int inFlight = 0;
+    double interval = requestsPerSecond > 0.0 ? 1.0 / requestsPerSecond : 0.0;
+    double nextStart = monotonicSeconds();
+    int status = ON_OK;
+
+    while (finished < nRequests)
+    {
+        // Start requests in free slots as the rate limit allows
+        double now = monotonicSeconds();
+        for (int s = 0; s < maxConcurrent && next < nRequests && now >= nextStart; s++)
+        {
+            if (active[s] != NULL)
+                continue;
+            if (slots[s] == NULL)
+                slots[s] = curl_easy_init();
+            else
+                curl_easy_reset(slots[s]);
+            CURL *curl = slots[s];
+            RemoteRequest *request = &requests[next++];
+            if (curl == NULL)
+            {
+                finished++;
+                if (request->onComplete != NULL)
+                    request->onComplete(request, request->userdata);
+                continue;
+            }
+            if (share != NULL)
+                curl_easy_setopt(curl, CURLOPT_SHARE, share);
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+            curl_easy_setopt(curl, CURLOPT_URL, request->url);
+            if (request->headers != NULL)
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+            remoteReceiveInto(curl, &request->response);
+            curl_multi_add_handle(multi, curl);
+            active[s] = request;
+            inFlight++;
+            if (interval > 0.0)
+                nextStart = (nextStart > now ? nextStart : now) + interval;
+        }
+
+        int running = 0;
+        CURLMcode mc = curl_multi_perform(multi, &running);
+        if (mc != CURLM_OK)
+        {
+            status = ON_REST_LIBCURL_ERROR;
+            break;
+        }
+
+        CURLMsg *msg = NULL;
+        int nMessages = 0;
+        while ((msg = curl_multi_info_read(multi, &nMessages)) != NULL)
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            int s = 0;
+            while (s < maxConcurrent && slots[s] != msg->easy_handle)
+                s++;
+            if (s == maxConcurrent)
+                continue;
+            RemoteRequest *request = active[s];
+            request->status = msg->data.result == CURLE_OK ? ON_OK : ON_REST_LIBCURL_ERROR;
+            curl_easy_getinfo(slots[s], CURLINFO_RESPONSE_CODE, &request->httpCode);
+            curl_multi_remove_handle(multi, slots[s]);
+            active[s] = NULL;
+            inFlight--;
+            finished++;
+            if (request->onComplete != NULL)
+                request->onComplete(request, request->userdata);
+        }
+
+        if (finished < nRequests)
+        {
+            // Wake for network activity, or when the next request may start
+            int timeoutMs = 100;
+            if (next < nRequests && inFlight < maxConcurrent)
+            {
+                double wait = nextStart - monotonicSeconds();
+                timeoutMs = wait > 0.0 ? (int)(wait * 1000.0) + 1 : 0;
+            }
+            if (timeoutMs > 0)
+                curl_multi_poll(multi, NULL, 0, timeoutMs, NULL);
+        }
+    }
+
+    for (int s = 0; s < maxConcurrent; s++)
+    {
+        if (slots[s] == NULL)
+            continue;
+        if (active[s] != NULL)
+            curl_multi_remove_handle(multi, slots[s]);
+        curl_easy_cleanup(slots[s]);
+    }
+    free(slots);
+    free(active);
+    curl_multi_cleanup(multi);
+
+    return status;
+}
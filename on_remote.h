@@ -21,20 +21,34 @@
 #include "on_dataproviders.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/types.h>
 
 #include <curl/curl.h>
 
+// Response body, kept NUL-terminated. The memory grows geometrically and is
+// kept when the buffer is cleared, so a reused buffer stops allocating once it
+// has held the largest response.
 typedef struct curlData
 {
     char *response;
     size_t size;
+    size_t capacity;
 } CurlData;
 
+// Room for n more bytes
+int curlDataReserve(CurlData *data, size_t n);
+int curlDataAppend(CurlData *data, const char *bytes, size_t n);
+// Empties the buffer, keeping its memory
+void curlDataClear(CurlData *data);
+void curlDataFree(CurlData *data);
+// Clears data and has curl write the response body into it, reserving room for
+// the Content-Length up front
+void remoteReceiveInto(CURL *curl, CurlData *data);
+
 typedef struct wssData
 {
-    char *frame;
-    size_t size;
+    CurlData frame;
     CURL *curl;
     bool connected;
     bool authenticated;
@@ -43,5 +57,36 @@ typedef struct wssData
     ScreenState *screen;
 } WssData;
 
+// REST requests share DNS lookups, TLS sessions and open connections for the
+// life of the process, and each thread reuses one easy handle so that
+// keep-alive connections are not closed between requests
+int remoteSessionInit(void);
+// The calling thread's easy handle, reset for a new request. Do not clean it up.
+CURL *remoteSessionHandle(void);
+// The calling thread's response buffer, cleared; its contents last until the
+// thread's next request. Do not free it.
+CurlData *remoteSessionBuffer(void);
+// Releases the calling thread's handle and the shared caches
+void remoteSessionCleanup(void);
+
+// One GET for remotePerformAll()
+typedef struct remoteRequest
+{
+    const char *url;
+    struct curl_slist *headers; // Optional, caller owned
+    // Called on the calling thread as the request finishes, if not NULL
+    void (*onComplete)(struct remoteRequest *request, void *userdata);
+    void *userdata;
+    // Results: free the response with curlDataFree()
+    CurlData response;
+    long httpCode;
+    int status; // ON_OK or ON_REST_LIBCURL_ERROR
+} RemoteRequest;
+
+// Performs the requests concurrently over the shared session, with at most
+// maxConcurrent in flight and starting at most requestsPerSecond (0 for no
+// limit). Returns when all have finished.
+int remotePerformAll(RemoteRequest *requests, size_t nRequests, int maxConcurrent, double requestsPerSecond);
+
 
 #endif // _ON_REMOTE_H
@@ -0,0 +1,214 @@
+/*
+    Options Numerics: on_responsecache.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_responsecache.h"
+#include "on_config.h"
+#include "on_status.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define RESPONSE_CACHE_SUBDIR "responses"
+
+typedef struct {
+    char *key;
+    char *body;
+    time_t stored;
+} ResponseCacheEntry;
+
+static ResponseCacheEntry entries[RESPONSE_CACHE_ENTRIES];
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// FNV-1a
+static uint64_t hashKey(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *c = (const unsigned char *)key; *c != '\0'; c++)
+    {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Files are named for the hash of the key and start with the key on its own line
+static int responseCacheFilename(const char *key, char *filename, int makeDirectories)
+{
+    char *home = getenv("HOME");
+    if (home == NULL || strlen(home) == 0)
+        return ON_FILE_READ_ERROR;
+
+    if (makeDirectories)
+    {
+        const char *subdirs[] = {"", "/" ON_PRICE_CACHE_DIR, "/" ON_PRICE_CACHE_DIR "/" RESPONSE_CACHE_SUBDIR};
+        for (int i = 0; i < 3; i++)
+        {
+            snprintf(filename, FILENAME_MAX, "%s/%s%s", home, ON_OPTIONS_DIR, subdirs[i]);
+            if (access(filename, F_OK))
+                if (mkdir(filename, 0700))
+                    return ON_FILE_WRITE_ERROR;
+        }
+    }
+
+    snprintf(filename, FILENAME_MAX, "%s/%s/%s/%s/%016llx.json", home, ON_OPTIONS_DIR, ON_PRICE_CACHE_DIR, RESPONSE_CACHE_SUBDIR, (unsigned long long)hashKey(key));
+
+    return ON_OK;
+}
+
+static ResponseCacheEntry *findEntry(const char *key)
+{
+    for (int i = 0; i < RESPONSE_CACHE_ENTRIES; i++)
+        if (entries[i].key != NULL && strcmp(entries[i].key, key) == 0)
+            return &entries[i];
+
+    return NULL;
+}
+
+// Keeps key in memory, replacing the oldest entry when full
+static void remember(const char *key, const char *body, time_t stored)
+{
+    ResponseCacheEntry *entry = findEntry(key);
+    if (entry == NULL)
+    {
+        entry = &entries[0];
+        for (int i = 0; i < RESPONSE_CACHE_ENTRIES && entry->key != NULL; i++)
+            if (entries[i].key == NULL || entries[i].stored < entry->stored)
+                entry = &entries[i];
+        free(entry->key);
+        entry->key = strdup(key);
+    }
+    free(entry->body);
+    entry->body = strdup(body);
+    entry->stored = stored;
+    if (entry->key == NULL || entry->body == NULL)
+    {
+        free(entry->key);
+        free(entry->body);
+        memset(entry, 0, sizeof *entry);
+    }
+
+    return;
+}
+
+static char *loadFromDisk(const char *key, double ttlSeconds, time_t now)
+{
+    char filename[FILENAME_MAX] = {0};
+    if (responseCacheFilename(key, filename, 0) != ON_OK)
+        return NULL;
+
+    struct stat st = {0};
+    if (stat(filename, &st) != 0 || difftime(now, st.st_mtime) > ttlSeconds)
+        return NULL;
+
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return NULL;
+
+    size_t keyLength = strlen(key);
+    size_t size = (size_t)st.st_size;
+    char *contents = malloc(size + 1);
+    if (contents == NULL || fread(contents, 1, size, f) != size)
+    {
+        free(contents);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    contents[size] = '\0';
+
+    // Another key with the same hash
+    if (size <= keyLength || strncmp(contents, key, keyLength) != 0 || contents[keyLength] != '\n')
+    {
+        free(contents);
+        return NULL;
+    }
+
+    char *body = strdup(contents + keyLength + 1);
+    free(contents);
+    if (body != NULL)
+        remember(key, body, st.st_mtime);
+
+    return body;
+}
+
+char *responseCacheGet(const char *key, double ttlSeconds)
+{
+    if (key == NULL || ttlSeconds <= 0.0)
+        return NULL;
+
+    time_t now = time(NULL);
+    char *body = NULL;
+
+    pthread_mutex_lock(&cacheMutex);
+    ResponseCacheEntry *entry = findEntry(key);
+    if (entry != NULL && difftime(now, entry->stored) <= ttlSeconds)
+        body = strdup(entry->body);
+    else
+        body = loadFromDisk(key, ttlSeconds, now);
+    pthread_mutex_unlock(&cacheMutex);
+
+    return body;
+}
+
+int responseCachePut(const char *key, const char *body)
+{
+    if (key == NULL || body == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    pthread_mutex_lock(&cacheMutex);
+    remember(key, body, time(NULL));
+    pthread_mutex_unlock(&cacheMutex);
+
+    char filename[FILENAME_MAX] = {0};
+    if (responseCacheFilename(key, filename, 1) != ON_OK)
+        return ON_FILE_WRITE_ERROR;
+
+    // Replace the file whole so that readers never see part of it
+    char tempFilename[FILENAME_MAX + 4] = {0};
+    snprintf(tempFilename, sizeof tempFilename, "%s.tmp", filename);
+    FILE *f = fopen(tempFilename, "w");
+    if (f == NULL)
+        return ON_FILE_WRITE_ERROR;
+    int written = fprintf(f, "%s\n%s", key, body) >= 0;
+    if (fclose(f) != 0 || !written || rename(tempFilename, filename) != 0)
+    {
+        remove(tempFilename);
+        return ON_FILE_WRITE_ERROR;
+    }
+
+    return ON_OK;
+}
+
+void responseCacheFree(void)
+{
+    pthread_mutex_lock(&cacheMutex);
+    for (int i = 0; i < RESPONSE_CACHE_ENTRIES; i++)
+    {
+        free(entries[i].key);
+        free(entries[i].body);
+        memset(&entries[i], 0, sizeof entries[i]);
+    }
+    pthread_mutex_unlock(&cacheMutex);
+
+    return;
+}
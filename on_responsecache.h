@@ -0,0 +1,32 @@
+/*
+    Options Numerics: on_responsecache.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_RESPONSECACHE_H
+#define _ON_RESPONSECACHE_H
+
+#include <stddef.h>
+
+// Responses for slow-moving reference data, kept in memory and in
+// ~/.optionsnumerics/cache/responses. Keys must not contain API tokens.
+#define RESPONSE_CACHE_ENTRIES 64
+
+// Copy of the body stored for key no more than ttlSeconds ago, or NULL; free it
+char *responseCacheGet(const char *key, double ttlSeconds);
+int responseCachePut(const char *key, const char *body);
+// Forgets the in-memory entries (the files stay)
+void responseCacheFree(void);
+
+#endif // _ON_RESPONSECACHE_H
@@ -0,0 +1,530 @@
+/*
+    Options Numerics: on_simd.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_simd.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ON_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Atomic as the pricing functions may run on several threads at once
+static atomic_int detectedLevel = -1;
+static atomic_int levelInUse = -1;
+
+SimdLevel simdDetectedLevel(void)
+{
+    if (detectedLevel < 0)
+    {
+        int level = SIMD_SCALAR;
+#ifdef ON_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            level = SIMD_AVX512;
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            level = SIMD_AVX2;
+#endif
+        detectedLevel = level;
+    }
+
+    return (SimdLevel)detectedLevel;
+}
+
+SimdLevel simdLevel(void)
+{
+    if (levelInUse < 0)
+        levelInUse = simdDetectedLevel();
+
+    return (SimdLevel)levelInUse;
+}
+
+SimdLevel simdSetLevel(SimdLevel level)
+{
+    SimdLevel detected = simdDetectedLevel();
+    levelInUse = level < detected ? level : detected;
+
+    return (SimdLevel)levelInUse;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SIMD_AVX512:
+            return "AVX-512";
+        case SIMD_AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+static void rollbackLevelScalar(double *p, const double *exercise, int n, double p0, double p1)
+{
+    double continuation = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        continuation = p0 * p[i + 1] + p1 * p[i];
+        p[i] = continuation > exercise[i] ? continuation : exercise[i];
+    }
+}
+
+#ifdef ON_SIMD_X86
+// Each vector of p[i..] is computed from p[i..] and p[i + 1..] before it is
+// stored, and the next vector only reads values at or after its own start,
+// so the level can be updated in place
+__attribute__((target("avx2,fma")))
+static void rollbackLevelAvx2(double *p, const double *exercise, int n, double p0, double p1)
+{
+    __m256d vp0 = _mm256_set1_pd(p0);
+    __m256d vp1 = _mm256_set1_pd(p1);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d here = _mm256_loadu_pd(p + i);
+        __m256d next = _mm256_loadu_pd(p + i + 1);
+        __m256d continuation = _mm256_fmadd_pd(vp0, next, _mm256_mul_pd(vp1, here));
+        _mm256_storeu_pd(p + i, _mm256_max_pd(continuation, _mm256_loadu_pd(exercise + i)));
+    }
+    rollbackLevelScalar(p + i, exercise + i, n - i, p0, p1);
+}
+
+__attribute__((target("avx512f")))
+static void rollbackLevelAvx512(double *p, const double *exercise, int n, double p0, double p1)
+{
+    __m512d vp0 = _mm512_set1_pd(p0);
+    __m512d vp1 = _mm512_set1_pd(p1);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d here = _mm512_loadu_pd(p + i);
+        __m512d next = _mm512_loadu_pd(p + i + 1);
+        __m512d continuation = _mm512_fmadd_pd(vp0, next, _mm512_mul_pd(vp1, here));
+        _mm512_storeu_pd(p + i, _mm512_max_pd(continuation, _mm512_loadu_pd(exercise + i)));
+    }
+    rollbackLevelScalar(p + i, exercise + i, n - i, p0, p1);
+}
+#endif
+
+void simdRollbackLevel(double *p, const double *exercise, int n, double p0, double p1)
+{
+#ifdef ON_SIMD_X86
+    switch (simdLevel())
+    {
+        case SIMD_AVX512:
+            rollbackLevelAvx512(p, exercise, n, p0, p1);
+            return;
+        case SIMD_AVX2:
+            rollbackLevelAvx2(p, exercise, n, p0, p1);
+            return;
+        default:
+            break;
+    }
+#endif
+    rollbackLevelScalar(p, exercise, n, p0, p1);
+}
+
+// Elementwise functions.
+// exp and log are the Cephes rational approximations, valid to about 1 ulp
+// over the ranges checked below; anything else (NaN, infinities, overflow,
+// denormals) is handed to libm one vector at a time.
+// The normal cdf is Hart's double precision algorithm as given by
+// West (2005), "Better approximations to cumulative normal functions".
+
+typedef enum simdFunction
+{
+    SIMD_EXP,
+    SIMD_LOG,
+    SIMD_NORMAL_CDF
+} SimdFunction;
+
+#define EXP_MIN_ARG -708.0
+#define EXP_MAX_ARG 709.0
+#define EXP_C1 6.93145751953125E-1
+#define EXP_C2 1.42860682030941723212E-6
+#define EXP_P0 1.26177193074810590878E-4
+#define EXP_P1 3.02994407707441961300E-2
+#define EXP_P2 9.99999999999999999910E-1
+#define EXP_Q0 3.00198505138664455042E-6
+#define EXP_Q1 2.52448340349684104192E-3
+#define EXP_Q2 2.27265548208155028766E-1
+#define EXP_Q3 2.00000000000000000009E0
+
+#define LOG_SQRTH 0.70710678118654752440
+#define LOG_C1 0.693359375
+#define LOG_C2 -2.121944400546905827679e-4
+#define LOG_P0 1.01875663804580931796E-4
+#define LOG_P1 4.97494994976747001425E-1
+#define LOG_P2 4.70579119878881725854E0
+#define LOG_P3 1.44989225341610930846E1
+#define LOG_P4 1.79368678507819816313E1
+#define LOG_P5 7.70838733755885391666E0
+#define LOG_Q0 1.12873587189167450590E1
+#define LOG_Q1 4.52279145837532221105E1
+#define LOG_Q2 8.29875266912776603211E1
+#define LOG_Q3 7.11544750618563894466E1
+#define LOG_Q4 2.31251620126765340583E1
+
+// cdf(-x) is zero to double precision for x beyond CDF_ZERO_ARG
+#define CDF_ZERO_ARG 37.0
+#define CDF_RATIONAL_MAX_ARG 7.07106781186547
+#define CDF_N0 3.52624965998911E-02
+#define CDF_N1 0.700383064443688
+#define CDF_N2 6.37396220353165
+#define CDF_N3 33.912866078383
+#define CDF_N4 112.079291497871
+#define CDF_N5 221.213596169931
+#define CDF_N6 220.206867912376
+#define CDF_D0 8.83883476483184E-02
+#define CDF_D1 1.75566716318264
+#define CDF_D2 16.064177579207
+#define CDF_D3 86.7807322029461
+#define CDF_D4 296.564248779674
+#define CDF_D5 637.333633378831
+#define CDF_D6 793.826512519948
+#define CDF_D7 440.413735824752
+#define CDF_SQRT_2PI 2.506628274631
+
+static double applyScalar(SimdFunction f, double x)
+{
+    switch (f)
+    {
+        case SIMD_EXP:
+            return exp(x);
+        case SIMD_LOG:
+            return log(x);
+        default:
+            return 0.5 * erfc(-x * M_SQRT1_2);
+    }
+}
+
+static void mapScalar(SimdFunction f, const double *x, double *y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        y[i] = applyScalar(f, x[i]);
+}
+
+#ifdef ON_SIMD_X86
+// Assumes EXP_MIN_ARG <= x <= EXP_MAX_ARG
+__attribute__((target("avx2,fma")))
+static inline __m256d expKernelAvx2(__m256d x)
+{
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(M_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(EXP_C1), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(EXP_C2), r);
+    __m256d rr = _mm256_mul_pd(r, r);
+    __m256d px = _mm256_fmadd_pd(_mm256_set1_pd(EXP_P0), rr, _mm256_set1_pd(EXP_P1));
+    px = _mm256_mul_pd(r, _mm256_fmadd_pd(px, rr, _mm256_set1_pd(EXP_P2)));
+    __m256d qx = _mm256_fmadd_pd(_mm256_set1_pd(EXP_Q0), rr, _mm256_set1_pd(EXP_Q1));
+    qx = _mm256_fmadd_pd(qx, rr, _mm256_set1_pd(EXP_Q2));
+    qx = _mm256_fmadd_pd(qx, rr, _mm256_set1_pd(EXP_Q3));
+    __m256d e = _mm256_div_pd(px, _mm256_sub_pd(qx, px));
+    e = _mm256_fmadd_pd(_mm256_set1_pd(2.0), e, _mm256_set1_pd(1.0));
+    // 2^n from the exponent bits
+    __m256i biased = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n)), _mm256_set1_epi64x(1023));
+
+    return _mm256_mul_pd(e, _mm256_castsi256_pd(_mm256_slli_epi64(biased, 52)));
+}
+
+// Assumes x is positive, finite and normal
+__attribute__((target("avx2,fma")))
+static inline __m256d logKernelAvx2(__m256d x)
+{
+    // frexp(): x = m * 2^e with 0.5 <= m < 1
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256i exponentBits = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(bits, 52), _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+    __m256d e = _mm256_cvtepi32_pd(_mm_sub_epi32(_mm256_castsi256_si128(exponentBits), _mm_set1_epi32(1022)));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)), _mm256_set1_epi64x(0x3FE0000000000000LL)));
+
+    __m256d small = _mm256_cmp_pd(m, _mm256_set1_pd(LOG_SQRTH), _CMP_LT_OQ);
+    e = _mm256_sub_pd(e, _mm256_and_pd(small, _mm256_set1_pd(1.0)));
+    m = _mm256_sub_pd(_mm256_add_pd(m, _mm256_and_pd(small, m)), _mm256_set1_pd(1.0));
+
+    __m256d z = _mm256_mul_pd(m, m);
+    __m256d p = _mm256_fmadd_pd(_mm256_set1_pd(LOG_P0), m, _mm256_set1_pd(LOG_P1));
+    p = _mm256_fmadd_pd(p, m, _mm256_set1_pd(LOG_P2));
+    p = _mm256_fmadd_pd(p, m, _mm256_set1_pd(LOG_P3));
+    p = _mm256_fmadd_pd(p, m, _mm256_set1_pd(LOG_P4));
+    p = _mm256_fmadd_pd(p, m, _mm256_set1_pd(LOG_P5));
+    __m256d q = _mm256_add_pd(m, _mm256_set1_pd(LOG_Q0));
+    q = _mm256_fmadd_pd(q, m, _mm256_set1_pd(LOG_Q1));
+    q = _mm256_fmadd_pd(q, m, _mm256_set1_pd(LOG_Q2));
+    q = _mm256_fmadd_pd(q, m, _mm256_set1_pd(LOG_Q3));
+    q = _mm256_fmadd_pd(q, m, _mm256_set1_pd(LOG_Q4));
+
+    __m256d y = _mm256_mul_pd(m, _mm256_div_pd(_mm256_mul_pd(z, p), q));
+    y = _mm256_fmadd_pd(e, _mm256_set1_pd(LOG_C2), y);
+    y = _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z, y);
+
+    return _mm256_fmadd_pd(e, _mm256_set1_pd(LOG_C1), _mm256_add_pd(m, y));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d normalCdfKernelAvx2(__m256d x)
+{
+    __m256d ax = _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+    __m256d arg = _mm256_max_pd(_mm256_mul_pd(_mm256_set1_pd(-0.5), _mm256_mul_pd(ax, ax)), _mm256_set1_pd(EXP_MIN_ARG));
+    __m256d e = expKernelAvx2(arg);
+
+    __m256d num = _mm256_fmadd_pd(_mm256_set1_pd(CDF_N0), ax, _mm256_set1_pd(CDF_N1));
+    num = _mm256_fmadd_pd(num, ax, _mm256_set1_pd(CDF_N2));
+    num = _mm256_fmadd_pd(num, ax, _mm256_set1_pd(CDF_N3));
+    num = _mm256_fmadd_pd(num, ax, _mm256_set1_pd(CDF_N4));
+    num = _mm256_fmadd_pd(num, ax, _mm256_set1_pd(CDF_N5));
+    num = _mm256_fmadd_pd(num, ax, _mm256_set1_pd(CDF_N6));
+    __m256d den = _mm256_fmadd_pd(_mm256_set1_pd(CDF_D0), ax, _mm256_set1_pd(CDF_D1));
+    den = _mm256_fmadd_pd(den, ax, _mm256_set1_pd(CDF_D2));
+    den = _mm256_fmadd_pd(den, ax, _mm256_set1_pd(CDF_D3));
+    den = _mm256_fmadd_pd(den, ax, _mm256_set1_pd(CDF_D4));
+    den = _mm256_fmadd_pd(den, ax, _mm256_set1_pd(CDF_D5));
+    den = _mm256_fmadd_pd(den, ax, _mm256_set1_pd(CDF_D6));
+    den = _mm256_fmadd_pd(den, ax, _mm256_set1_pd(CDF_D7));
+    __m256d c = _mm256_div_pd(_mm256_mul_pd(e, num), den);
+
+    // Continued fraction in the tail, only when needed
+    __m256d tail = _mm256_cmp_pd(ax, _mm256_set1_pd(CDF_RATIONAL_MAX_ARG), _CMP_NLT_UQ);
+    if (_mm256_movemask_pd(tail) != 0)
+    {
+        __m256d b = _mm256_add_pd(ax, _mm256_set1_pd(0.65));
+        b = _mm256_add_pd(ax, _mm256_div_pd(_mm256_set1_pd(4.0), b));
+        b = _mm256_add_pd(ax, _mm256_div_pd(_mm256_set1_pd(3.0), b));
+        b = _mm256_add_pd(ax, _mm256_div_pd(_mm256_set1_pd(2.0), b));
+        b = _mm256_add_pd(ax, _mm256_div_pd(_mm256_set1_pd(1.0), b));
+        __m256d cf = _mm256_div_pd(e, _mm256_mul_pd(b, _mm256_set1_pd(CDF_SQRT_2PI)));
+        c = _mm256_blendv_pd(c, cf, tail);
+        c = _mm256_andnot_pd(_mm256_cmp_pd(ax, _mm256_set1_pd(CDF_ZERO_ARG), _CMP_GT_OQ), c);
+    }
+
+    __m256d positive = _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GT_OQ);
+    c = _mm256_blendv_pd(c, _mm256_sub_pd(_mm256_set1_pd(1.0), c), positive);
+
+    // NaN in, NaN out
+    return _mm256_blendv_pd(c, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d applyAvx2(SimdFunction f, __m256d x)
+{
+    int inRange = 0;
+    switch (f)
+    {
+        case SIMD_EXP:
+            inRange = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(x, _mm256_set1_pd(EXP_MIN_ARG), _CMP_GE_OQ), _mm256_cmp_pd(x, _mm256_set1_pd(EXP_MAX_ARG), _CMP_LE_OQ))) == 0xF;
+            if (inRange)
+                return expKernelAvx2(x);
+            break;
+        case SIMD_LOG:
+            inRange = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(x, _mm256_set1_pd(DBL_MIN), _CMP_GE_OQ), _mm256_cmp_pd(x, _mm256_set1_pd(INFINITY), _CMP_LT_OQ))) == 0xF;
+            if (inRange)
+                return logKernelAvx2(x);
+            break;
+        default:
+            return normalCdfKernelAvx2(x);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, x);
+    mapScalar(f, lanes, lanes, 4);
+
+    return _mm256_loadu_pd(lanes);
+}
+
+__attribute__((target("avx2,fma")))
+static void mapAvx2(SimdFunction f, const double *x, double *y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(y + i, applyAvx2(f, _mm256_loadu_pd(x + i)));
+    if (i < n)
+    {
+        // Pad the last partial vector with a value valid for every function
+        double lanes[4] = {1.0, 1.0, 1.0, 1.0};
+        memcpy(lanes, x + i, (n - i) * sizeof *lanes);
+        _mm256_storeu_pd(lanes, applyAvx2(f, _mm256_loadu_pd(lanes)));
+        memcpy(y + i, lanes, (n - i) * sizeof *lanes);
+    }
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d expKernelAvx512(__m512d x)
+{
+    __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(M_LOG2E)), _MM_FROUND_TO_NEAREST_INT);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(EXP_C1), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(EXP_C2), r);
+    __m512d rr = _mm512_mul_pd(r, r);
+    __m512d px = _mm512_fmadd_pd(_mm512_set1_pd(EXP_P0), rr, _mm512_set1_pd(EXP_P1));
+    px = _mm512_mul_pd(r, _mm512_fmadd_pd(px, rr, _mm512_set1_pd(EXP_P2)));
+    __m512d qx = _mm512_fmadd_pd(_mm512_set1_pd(EXP_Q0), rr, _mm512_set1_pd(EXP_Q1));
+    qx = _mm512_fmadd_pd(qx, rr, _mm512_set1_pd(EXP_Q2));
+    qx = _mm512_fmadd_pd(qx, rr, _mm512_set1_pd(EXP_Q3));
+    __m512d e = _mm512_div_pd(px, _mm512_sub_pd(qx, px));
+    e = _mm512_fmadd_pd(_mm512_set1_pd(2.0), e, _mm512_set1_pd(1.0));
+
+    return _mm512_scalef_pd(e, n);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d logKernelAvx512(__m512d x)
+{
+    __m512d e = _mm512_add_pd(_mm512_getexp_pd(x), _mm512_set1_pd(1.0));
+    __m512d m = _mm512_getmant_pd(x, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src);
+
+    __mmask8 small = _mm512_cmp_pd_mask(m, _mm512_set1_pd(LOG_SQRTH), _CMP_LT_OQ);
+    e = _mm512_mask_sub_pd(e, small, e, _mm512_set1_pd(1.0));
+    m = _mm512_mask_add_pd(m, small, m, m);
+    m = _mm512_sub_pd(m, _mm512_set1_pd(1.0));
+
+    __m512d z = _mm512_mul_pd(m, m);
+    __m512d p = _mm512_fmadd_pd(_mm512_set1_pd(LOG_P0), m, _mm512_set1_pd(LOG_P1));
+    p = _mm512_fmadd_pd(p, m, _mm512_set1_pd(LOG_P2));
+    p = _mm512_fmadd_pd(p, m, _mm512_set1_pd(LOG_P3));
+    p = _mm512_fmadd_pd(p, m, _mm512_set1_pd(LOG_P4));
+    p = _mm512_fmadd_pd(p, m, _mm512_set1_pd(LOG_P5));
+    __m512d q = _mm512_add_pd(m, _mm512_set1_pd(LOG_Q0));
+    q = _mm512_fmadd_pd(q, m, _mm512_set1_pd(LOG_Q1));
+    q = _mm512_fmadd_pd(q, m, _mm512_set1_pd(LOG_Q2));
+    q = _mm512_fmadd_pd(q, m, _mm512_set1_pd(LOG_Q3));
+    q = _mm512_fmadd_pd(q, m, _mm512_set1_pd(LOG_Q4));
+
+    __m512d y = _mm512_mul_pd(m, _mm512_div_pd(_mm512_mul_pd(z, p), q));
+    y = _mm512_fmadd_pd(e, _mm512_set1_pd(LOG_C2), y);
+    y = _mm512_fnmadd_pd(_mm512_set1_pd(0.5), z, y);
+
+    return _mm512_fmadd_pd(e, _mm512_set1_pd(LOG_C1), _mm512_add_pd(m, y));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d normalCdfKernelAvx512(__m512d x)
+{
+    __m512d ax = _mm512_abs_pd(x);
+    __m512d arg = _mm512_max_pd(_mm512_mul_pd(_mm512_set1_pd(-0.5), _mm512_mul_pd(ax, ax)), _mm512_set1_pd(EXP_MIN_ARG));
+    __m512d e = expKernelAvx512(arg);
+
+    __m512d num = _mm512_fmadd_pd(_mm512_set1_pd(CDF_N0), ax, _mm512_set1_pd(CDF_N1));
+    num = _mm512_fmadd_pd(num, ax, _mm512_set1_pd(CDF_N2));
+    num = _mm512_fmadd_pd(num, ax, _mm512_set1_pd(CDF_N3));
+    num = _mm512_fmadd_pd(num, ax, _mm512_set1_pd(CDF_N4));
+    num = _mm512_fmadd_pd(num, ax, _mm512_set1_pd(CDF_N5));
+    num = _mm512_fmadd_pd(num, ax, _mm512_set1_pd(CDF_N6));
+    __m512d den = _mm512_fmadd_pd(_mm512_set1_pd(CDF_D0), ax, _mm512_set1_pd(CDF_D1));
+    den = _mm512_fmadd_pd(den, ax, _mm512_set1_pd(CDF_D2));
+    den = _mm512_fmadd_pd(den, ax, _mm512_set1_pd(CDF_D3));
+    den = _mm512_fmadd_pd(den, ax, _mm512_set1_pd(CDF_D4));
+    den = _mm512_fmadd_pd(den, ax, _mm512_set1_pd(CDF_D5));
+    den = _mm512_fmadd_pd(den, ax, _mm512_set1_pd(CDF_D6));
+    den = _mm512_fmadd_pd(den, ax, _mm512_set1_pd(CDF_D7));
+    __m512d c = _mm512_div_pd(_mm512_mul_pd(e, num), den);
+
+    __mmask8 tail = _mm512_cmp_pd_mask(ax, _mm512_set1_pd(CDF_RATIONAL_MAX_ARG), _CMP_NLT_UQ);
+    if (tail != 0)
+    {
+        __m512d b = _mm512_add_pd(ax, _mm512_set1_pd(0.65));
+        b = _mm512_add_pd(ax, _mm512_div_pd(_mm512_set1_pd(4.0), b));
+        b = _mm512_add_pd(ax, _mm512_div_pd(_mm512_set1_pd(3.0), b));
+        b = _mm512_add_pd(ax, _mm512_div_pd(_mm512_set1_pd(2.0), b));
+        b = _mm512_add_pd(ax, _mm512_div_pd(_mm512_set1_pd(1.0), b));
+        __m512d cf = _mm512_div_pd(e, _mm512_mul_pd(b, _mm512_set1_pd(CDF_SQRT_2PI)));
+        c = _mm512_mask_blend_pd(tail, c, cf);
+        c = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(ax, _mm512_set1_pd(CDF_ZERO_ARG), _CMP_GT_OQ), c, _mm512_setzero_pd());
+    }
+
+    __mmask8 positive = _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_GT_OQ);
+    c = _mm512_mask_sub_pd(c, positive, _mm512_set1_pd(1.0), c);
+
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), c, x);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d applyAvx512(SimdFunction f, __m512d x)
+{
+    __mmask8 inRange = 0;
+    switch (f)
+    {
+        case SIMD_EXP:
+            inRange = _mm512_cmp_pd_mask(x, _mm512_set1_pd(EXP_MIN_ARG), _CMP_GE_OQ) & _mm512_cmp_pd_mask(x, _mm512_set1_pd(EXP_MAX_ARG), _CMP_LE_OQ);
+            if (inRange == 0xFF)
+                return expKernelAvx512(x);
+            break;
+        case SIMD_LOG:
+            inRange = _mm512_cmp_pd_mask(x, _mm512_set1_pd(DBL_MIN), _CMP_GE_OQ) & _mm512_cmp_pd_mask(x, _mm512_set1_pd(INFINITY), _CMP_LT_OQ);
+            if (inRange == 0xFF)
+                return logKernelAvx512(x);
+            break;
+        default:
+            return normalCdfKernelAvx512(x);
+    }
+
+    double lanes[8];
+    _mm512_storeu_pd(lanes, x);
+    mapScalar(f, lanes, lanes, 8);
+
+    return _mm512_loadu_pd(lanes);
+}
+
+__attribute__((target("avx512f")))
+static void mapAvx512(SimdFunction f, const double *x, double *y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm512_storeu_pd(y + i, applyAvx512(f, _mm512_loadu_pd(x + i)));
+    if (i < n)
+    {
+        double lanes[8] = {1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+        memcpy(lanes, x + i, (n - i) * sizeof *lanes);
+        _mm512_storeu_pd(lanes, applyAvx512(f, _mm512_loadu_pd(lanes)));
+        memcpy(y + i, lanes, (n - i) * sizeof *lanes);
+    }
+}
+#endif
+
+static void map(SimdFunction f, const double *x, double *y, size_t n)
+{
+#ifdef ON_SIMD_X86
+    switch (simdLevel())
+    {
+        case SIMD_AVX512:
+            mapAvx512(f, x, y, n);
+            return;
+        case SIMD_AVX2:
+            mapAvx2(f, x, y, n);
+            return;
+        default:
+            break;
+    }
+#endif
+    mapScalar(f, x, y, n);
+}
+
+void simdExp(const double *x, double *y, size_t n)
+{
+    map(SIMD_EXP, x, y, n);
+}
+
+void simdLog(const double *x, double *y, size_t n)
+{
+    map(SIMD_LOG, x, y, n);
+}
+
+void simdNormalCdf(const double *x, double *y, size_t n)
+{
+    map(SIMD_NORMAL_CDF, x, y, n);
+}
@@ -0,0 +1,48 @@
+/*
+    Options Numerics: on_simd.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_SIMD_H
+#define _ON_SIMD_H
+
+#include <stddef.h>
+
+typedef enum simdLevel
+{
+    SIMD_SCALAR = 0,
+    SIMD_AVX2,
+    SIMD_AVX512
+} SimdLevel;
+
+// Best instruction set supported by this CPU, detected on first call
+SimdLevel simdDetectedLevel(void);
+// Instruction set in use; at most the detected level
+SimdLevel simdLevel(void);
+// Restricts the instruction set in use, e.g. for benchmarks; returns the level in use
+SimdLevel simdSetLevel(SimdLevel level);
+const char *simdLevelName(SimdLevel level);
+
+// One level of binomial tree backward induction:
+// p[i] = max(p0 * p[i + 1] + p1 * p[i], exercise[i]) for i = 0 .. n - 1
+void simdRollbackLevel(double *p, const double *exercise, int n, double p0, double p1);
+
+// Elementwise y[i] = f(x[i]) for i = 0 .. n - 1; y may be x.
+// simdExp and simdLog agree with libm to within about 1 ulp, simdNormalCdf
+// (standard normal cumulative distribution) to about 1e-16 absolute
+void simdExp(const double *x, double *y, size_t n);
+void simdLog(const double *x, double *y, size_t n);
+void simdNormalCdf(const double *x, double *y, size_t n);
+
+#endif // _ON_SIMD_H
@@ -29,6 +29,9 @@ typedef struct thingToRemember
 struct command;
 typedef struct command Command;
 
+struct volSurface;
+typedef struct volSurface VolSurface;
+
 typedef struct userInputState
 {
     char *prompt;
@@ -61,6 +64,9 @@ typedef struct screenState
 
     UserInputState *userInput;
 
+    // Built by vol_surface for pricing with V:s
+    VolSurface *volSurface;
+
 } ScreenState;
 
 #endif // _ON_STATE_H
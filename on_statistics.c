@@ -16,50 +16,509 @@
 
 #include "on_statistics.h"
 #include "on_optionstiming.h"
+#include "on_simd.h"
+#include "on_status.h"
 
-#include <stdlib.h>
 #include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
-// From ChatGPT 15 January 2023
+// Sample standard deviation (n - 1 denominator), one pass (Welford)
 double calculate_stddev(double *data, int n)
 {
-    if (data == NULL || n <= 0)
+    if (data == NULL || n < 2)
+        return nan("");
+
+    double mean = 0.0;
+    double m2 = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        double delta = data[i] - mean;
+        mean += delta / (double)(i + 1);
+        m2 += delta * (data[i] - mean);
+    }
+
+    return sqrt(m2 / (double)(n - 1));
+}
+
+// Annualized standard deviation of daily log returns
+double calculate_volatility(double *closes, int nCloses)
+{
+    if (closes == NULL || nCloses < 3)
         return nan("");
 
-    double mean = 0;
-    double sum = 0;
-    double stddev = 0;
-    int i;
+    VolatilityEstimator estimator = {0};
+    volatilityEstimatorInit(&estimator, OPTIONS_TRADING_DAYS_PER_YEAR);
+    for (int i = 0; i < nCloses; i++)
+        volatilityEstimatorAddClose(&estimator, closes[i]);
+
+    return volatilityEstimate(&estimator, VOLATILITY_CLOSE_TO_CLOSE);
+}
+
+// Online estimators
+
+void volatilityEstimatorInit(VolatilityEstimator *estimator, double periodsPerYear)
+{
+    if (estimator == NULL)
+        return;
+
+    memset(estimator, 0, sizeof *estimator);
+    estimator->periodsPerYear = periodsPerYear;
+
+    return;
+}
+
+static void welfordAdd(long n, double *mean, double *m2, double x)
+{
+    double delta = x - *mean;
+    *mean += delta / (double)n;
+    *m2 += delta * (x - *mean);
+
+    return;
+}
+
+void volatilityEstimatorAddClose(VolatilityEstimator *estimator, double close)
+{
+    if (estimator == NULL || !(close > 0.0))
+        return;
+
+    if (estimator->lastClose > 0.0)
+    {
+        estimator->nReturns++;
+        welfordAdd(estimator->nReturns, &estimator->returnMean, &estimator->returnM2, log(close / estimator->lastClose));
+    }
+    estimator->lastClose = close;
+
+    return;
+}
+
+// Range terms per bar, with o, h, l and c the log prices relative to the open:
+// Parkinson (h - l)^2 / (4 ln 2)
+// Garman-Klass (h - l)^2 / 2 - (2 ln 2 - 1) c^2
+// Rogers-Satchell h (h - c) + l (l - c)
+void volatilityEstimatorAddBar(VolatilityEstimator *estimator, double open, double high, double low, double close)
+{
+    if (estimator == NULL || !(open > 0.0 && high > 0.0 && low > 0.0 && close > 0.0))
+        return;
+
+    double h = log(high / open);
+    double l = log(low / open);
+    double c = log(close / open);
+    double range2 = (h - l) * (h - l);
 
-    // Calculate the mean value
-    for (i = 0; i < n; i++) {
-        mean += data[i];
+    estimator->nBars++;
+    estimator->parkinsonSum += range2 / (4.0 * M_LN2);
+    estimator->garmanKlassSum += 0.5 * range2 - (2.0 * M_LN2 - 1.0) * c * c;
+    estimator->rogersSatchellSum += h * (h - c) + l * (l - c);
+    welfordAdd(estimator->nBars, &estimator->openCloseMean, &estimator->openCloseM2, c);
+
+    // Overnight (or between-bar) jump from the previous close
+    if (estimator->lastClose > 0.0)
+    {
+        estimator->nOvernight++;
+        welfordAdd(estimator->nOvernight, &estimator->overnightMean, &estimator->overnightM2, log(open / estimator->lastClose));
     }
-    mean /= n;
 
-    // Calculate the standard deviation
-    for (i = 0; i < n; i++) {
-        sum += pow(data[i] - mean, 2);
+    volatilityEstimatorAddClose(estimator, close);
+
+    return;
+}
+
+double volatilityEstimate(const VolatilityEstimator *estimator, VolatilityMethod method)
+{
+    if (estimator == NULL)
+        return nan("");
+
+    double variance = nan("");
+    long n = estimator->nBars;
+    switch (method)
+    {
+        case VOLATILITY_CLOSE_TO_CLOSE:
+            if (estimator->nReturns >= 2)
+                variance = estimator->returnM2 / (double)(estimator->nReturns - 1);
+            break;
+
+        case VOLATILITY_PARKINSON:
+            if (n >= 1)
+                variance = estimator->parkinsonSum / (double)n;
+            break;
+
+        case VOLATILITY_GARMAN_KLASS:
+            if (n >= 1)
+                variance = estimator->garmanKlassSum / (double)n;
+            break;
+
+        case VOLATILITY_ROGERS_SATCHELL:
+            if (n >= 1)
+                variance = estimator->rogersSatchellSum / (double)n;
+            break;
+
+        // Overnight variance + k open-to-close variance + (1 - k) Rogers-Satchell
+        case VOLATILITY_YANG_ZHANG:
+            if (n >= 2 && estimator->nOvernight >= 2)
+            {
+                double k = 0.34 / (1.34 + (double)(n + 1) / (double)(n - 1));
+                double overnight = estimator->overnightM2 / (double)(estimator->nOvernight - 1);
+                double openClose = estimator->openCloseM2 / (double)(n - 1);
+                variance = overnight + k * openClose + (1.0 - k) * estimator->rogersSatchellSum / (double)n;
+            }
+            break;
     }
-    stddev = sqrt(sum / (n + 1));
 
-    return stddev;
+    if (isnan(variance))
+        return variance;
+    // Rounding can leave a constant series slightly negative
+    if (variance < 0.0)
+        variance = 0.0;
+
+    return sqrt(variance * estimator->periodsPerYear);
 }
 
-double calculate_volatility(double *closes, int nCloses)
+double priceDataVolatility(const PriceData *priceData, VolatilityMethod method)
 {
-    if (closes == NULL || nCloses < 3)
+    if (priceData == NULL || priceData->closes == NULL)
         return nan("");
 
-    // Daily log returns
-    double *logreturns = malloc((nCloses - 1) * sizeof *logreturns);
-    if (logreturns == NULL)
+    bool ohlc = priceData->opens != NULL && priceData->highs != NULL && priceData->lows != NULL;
+    if (!ohlc && method != VOLATILITY_CLOSE_TO_CLOSE)
+        return nan("");
+
+    VolatilityEstimator estimator = {0};
+    volatilityEstimatorInit(&estimator, OPTIONS_TRADING_DAYS_PER_YEAR);
+    for (size_t i = 0; i < priceData->nPrices; i++)
+    {
+        if (ohlc)
+            volatilityEstimatorAddBar(&estimator, priceData->opens[i], priceData->highs[i], priceData->lows[i], priceData->closes[i]);
+        else
+            volatilityEstimatorAddClose(&estimator, priceData->closes[i]);
+    }
+
+    return volatilityEstimate(&estimator, method);
+}
+
+const char *volatilityMethodName(VolatilityMethod method)
+{
+    switch (method)
+    {
+        case VOLATILITY_CLOSE_TO_CLOSE:
+            return "close-to-close";
+        case VOLATILITY_PARKINSON:
+            return "Parkinson";
+        case VOLATILITY_GARMAN_KLASS:
+            return "Garman-Klass";
+        case VOLATILITY_ROGERS_SATCHELL:
+            return "Rogers-Satchell";
+        case VOLATILITY_YANG_ZHANG:
+            return "Yang-Zhang";
+    }
+
+    return "unknown";
+}
+
+// Forecasting
+
+// Demeaned daily log returns of closes; the caller frees *returns
+static int logReturns(const double *closes, int nCloses, double **returns, int *nReturns, double *variance)
+{
+    if (closes == NULL || nCloses - 1 < VOLATILITY_FIT_MIN_RETURNS)
+        return ON_STATISTICS_NOT_ENOUGH_DATA;
+
+    // Returns, then their conditional variances in the second half
+    double *r = malloc(2 * (size_t)(nCloses - 1) * sizeof *r);
+    if (r == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+
+    int n = nCloses - 1;
+    double mean = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        r[i] = log(closes[i + 1] / closes[i]);
+        mean += r[i];
+    }
+    mean /= (double)n;
+    double sum2 = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        r[i] -= mean;
+        sum2 += r[i] * r[i];
+    }
+    if (!(sum2 > 0.0) || !isfinite(sum2))
+    {
+        free(r);
+        return ON_STATISTICS_NOT_ENOUGH_DATA;
+    }
+
+    *returns = r;
+    *nReturns = n;
+    *variance = sum2 / (double)n;
+
+    return ON_OK;
+}
+
+// Gaussian log likelihood, less constants, of returns r with conditional variances
+// sigma2(t) = omega + alpha r^2(t - 1) + beta sigma2(t - 1), sigma2(0) = v.
+// With variance targeting (omega = (1 - alpha - beta) v), sets the gradient with
+// respect to alpha and beta if grad is not NULL. sigma2 holds n doubles.
+static double garchLogLikelihood(const double *r, int n, double omega, double alpha, double beta, double v, bool targeted, double *sigma2, double grad[2], double *next)
+{
+    double s2 = v;
+    double dA = 0.0;
+    double dB = 0.0;
+    double gA = 0.0;
+    double gB = 0.0;
+    double sumRatio = 0.0;
+
+    for (int t = 0; t < n; t++)
+    {
+        if (t > 0)
+        {
+            double r2 = r[t - 1] * r[t - 1];
+            if (targeted)
+            {
+                dA = r2 - v + beta * dA;
+                dB = s2 - v + beta * dB;
+            }
+            s2 = omega + alpha * r2 + beta * s2;
+        }
+        sigma2[t] = s2;
+        double ratio = r[t] * r[t] / s2;
+        sumRatio += ratio;
+        if (grad != NULL)
+        {
+            double w = (1.0 - ratio) / s2;
+            gA += w * dA;
+            gB += w * dB;
+        }
+    }
+    if (next != NULL)
+        *next = omega + alpha * r[n - 1] * r[n - 1] + beta * s2;
+
+    // The logarithms dominate the cost; take them all at once
+    simdLog(sigma2, sigma2, (size_t)n);
+    double sumLog = 0.0;
+    for (int t = 0; t < n; t++)
+        sumLog += sigma2[t];
+
+    if (grad != NULL)
+    {
+        grad[0] = -0.5 * gA;
+        grad[1] = -0.5 * gB;
+    }
+
+    return -0.5 * (sumLog + sumRatio);
+}
+
+int ewmaFit(const double *closes, int nCloses, EwmaModel *model)
+{
+    if (model == NULL)
+        return ON_MISSING_RETURN_POINTER;
+
+    double *r = NULL;
+    int n = 0;
+    double v = 0.0;
+    int status = logReturns(closes, nCloses, &r, &n, &v);
+    if (status != ON_OK)
+        return status;
+    double *sigma2 = r + n;
+
+    // Golden-section search for the most likely lambda
+    const double invPhi = 0.5 * (sqrt(5.0) - 1.0);
+    double a = 0.5;
+    double b = 0.9999;
+    double x1 = b - invPhi * (b - a);
+    double x2 = a + invPhi * (b - a);
+    double f1 = garchLogLikelihood(r, n, 0.0, 1.0 - x1, x1, v, false, sigma2, NULL, NULL);
+    double f2 = garchLogLikelihood(r, n, 0.0, 1.0 - x2, x2, v, false, sigma2, NULL, NULL);
+    while (b - a > 1e-6)
+    {
+        if (f1 > f2)
+        {
+            b = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = b - invPhi * (b - a);
+            f1 = garchLogLikelihood(r, n, 0.0, 1.0 - x1, x1, v, false, sigma2, NULL, NULL);
+        }
+        else
+        {
+            a = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = a + invPhi * (b - a);
+            f2 = garchLogLikelihood(r, n, 0.0, 1.0 - x2, x2, v, false, sigma2, NULL, NULL);
+        }
+    }
+
+    model->lambda = 0.5 * (a + b);
+    model->logLikelihood = garchLogLikelihood(r, n, 0.0, 1.0 - model->lambda, model->lambda, v, false, sigma2, NULL, &model->nextVariance);
+    free(r);
+
+    return ON_OK;
+}
+
+// alpha = p s and beta = p (1 - s) with persistence p and ARCH share s in (0, 1),
+// each the logistic function of an unconstrained parameter
+static void garchParameters(const double x[2], double *alpha, double *beta)
+{
+    double p = 1.0 / (1.0 + exp(-x[0]));
+    double s = 1.0 / (1.0 + exp(-x[1]));
+    *alpha = p * s;
+    *beta = p * (1.0 - s);
+
+    return;
+}
+
+// Negative log likelihood and its gradient in the unconstrained parameters
+static double garchObjective(const double *r, int n, double v, double *sigma2, const double x[2], double g[2])
+{
+    double alpha = 0.0;
+    double beta = 0.0;
+    garchParameters(x, &alpha, &beta);
+    double p = alpha + beta;
+    double s = alpha / p;
+
+    double grad[2] = {0};
+    double f = -garchLogLikelihood(r, n, (1.0 - p) * v, alpha, beta, v, true, sigma2, grad, NULL);
+    double dp = p * (1.0 - p);
+    double ds = s * (1.0 - s);
+    g[0] = -(grad[0] * s * dp + grad[1] * (1.0 - s) * dp);
+    g[1] = -(grad[0] * p * ds - grad[1] * p * ds);
+
+    return f;
+}
+
+int garchFit(const double *closes, int nCloses, GarchModel *model)
+{
+    if (model == NULL)
+        return ON_MISSING_RETURN_POINTER;
+
+    double *r = NULL;
+    int n = 0;
+    double v = 0.0;
+    int status = logReturns(closes, nCloses, &r, &n, &v);
+    if (status != ON_OK)
+        return status;
+    double *sigma2 = r + n;
+
+    // Start at alpha = 0.05, beta = 0.90, typical of daily equity returns
+    double x[2] = {log(0.95 / 0.05), log((0.05 / 0.95) / (1.0 - 0.05 / 0.95))};
+    double g[2] = {0};
+    double f = garchObjective(r, n, v, sigma2, x, g);
+    // Inverse Hessian approximation, scaled to the problem on the first step
+    double H[2][2] = {{1.0, 0.0}, {0.0, 1.0}};
+    bool scaled = false;
+    // Gradients are sums over n returns
+    double gradientTolerance = 1e-6 * (double)n;
+
+    int iteration = 0;
+    for (; iteration < GARCH_MAX_ITERATIONS; iteration++)
+    {
+        if (fabs(g[0]) + fabs(g[1]) < gradientTolerance)
+            break;
+
+        double d[2] = {-(H[0][0] * g[0] + H[0][1] * g[1]), -(H[1][0] * g[0] + H[1][1] * g[1])};
+        double slope = d[0] * g[0] + d[1] * g[1];
+        if (slope >= 0.0)
+        {
+            // Not a descent direction; restart from steepest descent
+            H[0][0] = H[1][1] = 1.0;
+            H[0][1] = H[1][0] = 0.0;
+            d[0] = -g[0];
+            d[1] = -g[1];
+            slope = d[0] * g[0] + d[1] * g[1];
+        }
+        if (!scaled)
+        {
+            // Keep the first step to about one unit in the logistic parameters
+            double norm = sqrt(d[0] * d[0] + d[1] * d[1]);
+            if (norm > 1.0)
+            {
+                d[0] /= norm;
+                d[1] /= norm;
+                slope /= norm;
+            }
+        }
+
+        // Backtracking line search (Armijo)
+        double step = 1.0;
+        double xNew[2] = {0};
+        double gNew[2] = {0};
+        double fNew = 0.0;
+        int backtracks = 0;
+        do
+        {
+            xNew[0] = x[0] + step * d[0];
+            xNew[1] = x[1] + step * d[1];
+            fNew = garchObjective(r, n, v, sigma2, xNew, gNew);
+            if (isfinite(fNew) && fNew <= f + 1e-4 * step * slope)
+                break;
+            step *= 0.5;
+        } while (++backtracks < 30);
+        if (backtracks == 30)
+            break;
+
+        // BFGS update of the inverse Hessian
+        double sx[2] = {xNew[0] - x[0], xNew[1] - x[1]};
+        double y[2] = {gNew[0] - g[0], gNew[1] - g[1]};
+        double sy = sx[0] * y[0] + sx[1] * y[1];
+        if (sy > 1e-12)
+        {
+            if (!scaled)
+            {
+                double scale = sy / (y[0] * y[0] + y[1] * y[1]);
+                H[0][0] = H[1][1] = scale;
+                H[0][1] = H[1][0] = 0.0;
+                scaled = true;
+            }
+            double rho = 1.0 / sy;
+            double Hy[2] = {H[0][0] * y[0] + H[0][1] * y[1], H[1][0] * y[0] + H[1][1] * y[1]};
+            double yHy = y[0] * Hy[0] + y[1] * Hy[1];
+            for (int i = 0; i < 2; i++)
+                for (int j = 0; j < 2; j++)
+                    H[i][j] += (1.0 + rho * yHy) * rho * sx[i] * sx[j] - rho * (Hy[i] * sx[j] + sx[i] * Hy[j]);
+        }
+
+        x[0] = xNew[0];
+        x[1] = xNew[1];
+        g[0] = gNew[0];
+        g[1] = gNew[1];
+        f = fNew;
+    }
+
+    garchParameters(x, &model->alpha, &model->beta);
+    model->longRunVariance = v;
+    model->omega = (1.0 - model->alpha - model->beta) * v;
+    model->logLikelihood = garchLogLikelihood(r, n, model->omega, model->alpha, model->beta, v, false, sigma2, NULL, &model->nextVariance);
+    model->iterations = iteration;
+    free(r);
+
+    return ON_OK;
+}
+
+double ewmaForecastVolatility(const EwmaModel *model, double tradingYears)
+{
+    if (model == NULL)
         return nan("");
+    (void)tradingYears;
 
-    for (int i = 1; i < nCloses; i++)
-        logreturns[i-1] = log(closes[i] / closes[i-1]);
+    // No mean reversion: the forecast is flat
+    return sqrt(model->nextVariance * OPTIONS_TRADING_DAYS_PER_YEAR);
+}
+
+// Mean of the h-day-ahead variances V + (alpha + beta)^(h - 1) (sigma2(1) - V)
+// over the days to expiry
+double garchForecastVolatility(const GarchModel *model, double tradingYears)
+{
+    if (model == NULL)
+        return nan("");
 
-    double stddev = calculate_stddev(logreturns, nCloses - 1);
-    return stddev * sqrt(OPTIONS_TRADING_DAYS_PER_YEAR);
+    double days = tradingYears * OPTIONS_TRADING_DAYS_PER_YEAR;
+    double persistence = model->alpha + model->beta;
+    double V = model->longRunVariance;
+    double variance = model->nextVariance;
+    if (days > 1.0 && persistence < 1.0)
+        variance = V + (model->nextVariance - V) * (1.0 - pow(persistence, days)) / (days * (1.0 - persistence));
 
+    return sqrt(variance * OPTIONS_TRADING_DAYS_PER_YEAR);
 }
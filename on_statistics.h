@@ -17,7 +17,88 @@
 #ifndef _ON_STATISTICS_H
 #define _ON_STATISTICS_H
 
+#include "on_data.h"
+
+typedef enum volatilityMethod
+{
+    VOLATILITY_CLOSE_TO_CLOSE = 0,
+    VOLATILITY_PARKINSON,
+    VOLATILITY_GARMAN_KLASS,
+    VOLATILITY_ROGERS_SATCHELL,
+    VOLATILITY_YANG_ZHANG
+} VolatilityMethod;
+
+// Running sums for realized volatility, updated in O(1) per close or OHLC bar
+typedef struct volatilityEstimator
+{
+    double periodsPerYear;
+    double lastClose;
+    // Close-to-close log returns (Welford)
+    long nReturns;
+    double returnMean;
+    double returnM2;
+    // Range estimators
+    long nBars;
+    double parkinsonSum;
+    double garmanKlassSum;
+    double rogersSatchellSum;
+    // Yang-Zhang open-to-close and previous-close-to-open log returns
+    double openCloseMean;
+    double openCloseM2;
+    long nOvernight;
+    double overnightMean;
+    double overnightM2;
+} VolatilityEstimator;
+
 double calculate_stddev(double *data, int n);
+// Annualized volatility of daily closes
 double calculate_volatility(double *closes, int nCloses);
 
+// periodsPerYear annualizes: OPTIONS_TRADING_DAYS_PER_YEAR for daily bars
+void volatilityEstimatorInit(VolatilityEstimator *estimator, double periodsPerYear);
+void volatilityEstimatorAddClose(VolatilityEstimator *estimator, double close);
+// Adds the bar's range terms and its close
+void volatilityEstimatorAddBar(VolatilityEstimator *estimator, double open, double high, double low, double close);
+// Annualized volatility (fraction), NaN until there are enough data
+double volatilityEstimate(const VolatilityEstimator *estimator, VolatilityMethod method);
+// Daily bars; methods other than close-to-close need the opens, highs and lows
+double priceDataVolatility(const PriceData *priceData, VolatilityMethod method);
+const char *volatilityMethodName(VolatilityMethod method);
+
+// Volatility forecasts fitted by maximum likelihood to daily log returns
+#define EWMA_RISKMETRICS_LAMBDA 0.94
+#define VOLATILITY_FIT_MIN_RETURNS 30
+#define GARCH_MAX_ITERATIONS 100
+
+// sigma^2(t) = lambda sigma^2(t - 1) + (1 - lambda) r^2(t - 1)
+typedef struct ewmaModel
+{
+    double lambda;
+    double nextVariance; // Daily variance for the next day
+    double logLikelihood;
+} EwmaModel;
+
+// sigma^2(t) = omega + alpha r^2(t - 1) + beta sigma^2(t - 1)
+typedef struct garchModel
+{
+    double omega;
+    double alpha;
+    double beta;
+    double longRunVariance; // Daily, omega / (1 - alpha - beta)
+    double nextVariance;
+    double logLikelihood;
+    int iterations;
+} GarchModel;
+
+// Closes are daily, oldest first. Return ON_STATISTICS_NOT_ENOUGH_DATA for
+// fewer than VOLATILITY_FIT_MIN_RETURNS returns
+int ewmaFit(const double *closes, int nCloses, EwmaModel *model);
+// Variance targeting fixes omega from the sample variance; alpha and beta are
+// fitted by BFGS with analytic gradients
+int garchFit(const double *closes, int nCloses, GarchModel *model);
+// Annualized volatility (fraction) expected on average over the next
+// tradingYears, e.g. Option.T
+double ewmaForecastVolatility(const EwmaModel *model, double tradingYears);
+double garchForecastVolatility(const GarchModel *model, double tradingYears);
+
 #endif // _ON_STATISTICS_H
@@ -32,9 +32,12 @@ enum onStatusCodes
     ON_FILE_WRITE_ERROR,
 
     ON_PARSE_INVALID_DATE_STRING,
+    ON_PARSE_INVALID_JSON,
 
     ON_MISSING_RETURN_POINTER,
     ON_OPTIONS_MODELS_MAX_ITERATIONS_REACHED,
+    ON_OPTIONS_MODELS_NO_SOLUTION,
+    ON_STATISTICS_NOT_ENOUGH_DATA,
 
     ON_REST_LIBCURL_ERROR,
     
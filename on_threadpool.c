@@ -0,0 +1,291 @@
+/*
+    Options Numerics: on_threadpool.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_threadpool.h"
+#include "on_status.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define THREADPOOL_MAX_THREADS 256
+
+// Indices begin .. end - 1 of the current loop not yet started by any thread
+typedef struct workRange
+{
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+} WorkRange;
+
+typedef struct workerStart
+{
+    ThreadPool *pool;
+    int slot;
+} WorkerStart;
+
+struct threadPool
+{
+    int nThreads;
+    pthread_t *threads;
+    WorkerStart *starts;
+    // One range per thread; the thread running the loop uses the last one
+    WorkRange *ranges;
+
+    pthread_mutex_t lock;
+    pthread_cond_t loopStarted;
+    pthread_cond_t loopFinished;
+    unsigned long loop;
+    int nWorking;
+    bool shuttingDown;
+    ThreadPoolJob job;
+    void *context;
+
+    pthread_mutex_t loopLock;
+};
+
+static ThreadPool *sharedPool = NULL;
+static pthread_once_t sharedPoolOnce = PTHREAD_ONCE_INIT;
+
+static bool takeNext(WorkRange *range, size_t *index)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&range->lock);
+    if (range->begin < range->end)
+    {
+        *index = range->begin++;
+        found = true;
+    }
+    pthread_mutex_unlock(&range->lock);
+
+    return found;
+}
+
+// Moves the back half of the first non-empty range found after the
+// thief's own into the thief's range
+static bool steal(ThreadPool *pool, int thief)
+{
+    for (int k = 1; k < pool->nThreads; k++)
+    {
+        WorkRange *victim = &pool->ranges[(thief + k) % pool->nThreads];
+        size_t begin = 0;
+        size_t end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->end - victim->begin;
+        if (remaining > 0)
+        {
+            end = victim->end;
+            begin = end - (remaining + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (end > begin)
+        {
+            WorkRange *own = &pool->ranges[thief];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void runLoop(ThreadPool *pool, int slot)
+{
+    size_t index = 0;
+
+    do
+    {
+        while (takeNext(&pool->ranges[slot], &index))
+            pool->job(pool->context, index);
+    } while (steal(pool, slot));
+
+    return;
+}
+
+static void *worker(void *arg)
+{
+    WorkerStart *start = arg;
+    ThreadPool *pool = start->pool;
+    unsigned long loopsSeen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->shuttingDown && pool->loop == loopsSeen)
+            pthread_cond_wait(&pool->loopStarted, &pool->lock);
+        if (pool->shuttingDown)
+            break;
+        loopsSeen = pool->loop;
+        pthread_mutex_unlock(&pool->lock);
+
+        runLoop(pool, start->slot);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->nWorking--;
+        if (pool->nWorking == 0)
+            pthread_cond_signal(&pool->loopFinished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+ThreadPool *threadPoolCreate(int nThreads)
+{
+    if (nThreads <= 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        nThreads = cores > 0 ? (int)cores : 1;
+    }
+    if (nThreads > THREADPOOL_MAX_THREADS)
+        nThreads = THREADPOOL_MAX_THREADS;
+
+    ThreadPool *pool = calloc(1, sizeof *pool);
+    if (pool == NULL)
+        return NULL;
+
+    pool->threads = calloc(nThreads, sizeof *pool->threads);
+    pool->starts = calloc(nThreads, sizeof *pool->starts);
+    pool->ranges = calloc(nThreads, sizeof *pool->ranges);
+    if (pool->threads == NULL || pool->starts == NULL || pool->ranges == NULL)
+    {
+        free(pool->threads);
+        free(pool->starts);
+        free(pool->ranges);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_mutex_init(&pool->loopLock, NULL);
+    pthread_cond_init(&pool->loopStarted, NULL);
+    pthread_cond_init(&pool->loopFinished, NULL);
+    for (int t = 0; t < nThreads; t++)
+        pthread_mutex_init(&pool->ranges[t].lock, NULL);
+
+    // If a thread can't be started the pool just runs with fewer
+    pool->nThreads = 1;
+    for (int t = 0; t < nThreads - 1; t++)
+    {
+        pool->starts[t].pool = pool;
+        pool->starts[t].slot = t;
+        if (pthread_create(&pool->threads[t], NULL, worker, &pool->starts[t]) != 0)
+            break;
+        pool->nThreads++;
+    }
+
+    return pool;
+}
+
+void threadPoolFree(ThreadPool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shuttingDown = true;
+    pthread_cond_broadcast(&pool->loopStarted);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t = 0; t < pool->nThreads - 1; t++)
+        pthread_join(pool->threads[t], NULL);
+
+    for (int t = 0; t < pool->nThreads; t++)
+        pthread_mutex_destroy(&pool->ranges[t].lock);
+    pthread_cond_destroy(&pool->loopFinished);
+    pthread_cond_destroy(&pool->loopStarted);
+    pthread_mutex_destroy(&pool->loopLock);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->threads);
+    free(pool->starts);
+    free(pool->ranges);
+    free(pool);
+
+    return;
+}
+
+int threadPoolSize(const ThreadPool *pool)
+{
+    return pool != NULL ? pool->nThreads : 0;
+}
+
+int threadPoolParallelFor(ThreadPool *pool, size_t n, ThreadPoolJob job, void *context)
+{
+    if (pool == NULL || job == NULL)
+        return ON_MISSING_ARG_POINTER;
+    if (n == 0)
+        return ON_OK;
+
+    pthread_mutex_lock(&pool->loopLock);
+
+    // Contiguous equal shares to start with
+    int nThreads = pool->nThreads;
+    for (int t = 0; t < nThreads; t++)
+    {
+        pool->ranges[t].begin = n * t / nThreads;
+        pool->ranges[t].end = n * (t + 1) / nThreads;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->context = context;
+    pool->nWorking = nThreads - 1;
+    pool->loop++;
+    pthread_cond_broadcast(&pool->loopStarted);
+    pthread_mutex_unlock(&pool->lock);
+
+    runLoop(pool, nThreads - 1);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->nWorking > 0)
+        pthread_cond_wait(&pool->loopFinished, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->loopLock);
+
+    return ON_OK;
+}
+
+static void createSharedPool(void)
+{
+    sharedPool = threadPoolCreate(0);
+
+    return;
+}
+
+ThreadPool *threadPoolShared(void)
+{
+    pthread_once(&sharedPoolOnce, createSharedPool);
+
+    return sharedPool;
+}
+
+void threadPoolFreeShared(void)
+{
+    threadPoolFree(sharedPool);
+    sharedPool = NULL;
+
+    return;
+}
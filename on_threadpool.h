@@ -0,0 +1,47 @@
+/*
+    Options Numerics: on_threadpool.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_THREADPOOL_H
+#define _ON_THREADPOOL_H
+
+#include <stddef.h>
+
+// Called once for each index of a parallel loop, from any thread of the pool.
+// Results should be written to slot index of caller arrays, which keeps
+// them in input order regardless of which thread ran the job.
+typedef void (*ThreadPoolJob)(void *context, size_t index);
+
+typedef struct threadPool ThreadPool;
+
+// nThreads <= 0 sizes the pool to the number of online cores.
+// The thread calling threadPoolParallelFor() takes part in the work,
+// so nThreads - 1 worker threads are started.
+ThreadPool *threadPoolCreate(int nThreads);
+void threadPoolFree(ThreadPool *pool);
+int threadPoolSize(const ThreadPool *pool);
+
+// Runs job(context, i) for i = 0 .. n - 1 and returns when all are done.
+// Each thread works through its own share of the indices and steals half
+// of another thread's remaining share when its own runs out, which
+// balances jobs of uneven cost. Loops are run one at a time per pool, so a
+// job must not start another loop on the same pool.
+int threadPoolParallelFor(ThreadPool *pool, size_t n, ThreadPoolJob job, void *context);
+
+// Process-wide pool sized to the number of cores, created on first use
+ThreadPool *threadPoolShared(void);
+void threadPoolFreeShared(void);
+
+#endif // _ON_THREADPOOL_H
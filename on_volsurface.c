@@ -0,0 +1,535 @@
+/*
+    Options Numerics: on_volsurface.c
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "on_volsurface.h"
+#include "on_optionstiming.h"
+#include "on_threadpool.h"
+#include "on_status.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Work shared by the threads solving quotes; slot i is quotes[indices[i]], or quotes[i] without indices
+typedef struct volSurfaceSolve
+{
+    VolSurfaceQuote *quotes;
+    const size_t *indices;
+} VolSurfaceSolve;
+
+static void volSurfaceSolveJob(void *context, size_t i)
+{
+    VolSurfaceSolve *solve = context;
+    VolSurfaceQuote *quote = &solve->quotes[solve->indices != NULL ? solve->indices[i] : i];
+
+    double impliedVolatility = nan("");
+    if (quote->standard && quote->price > 0.0 && binomial_option_implied_volatility(quote->option, quote->type, quote->price, &impliedVolatility) != ON_OK)
+        impliedVolatility = nan("");
+    quote->option.v = impliedVolatility;
+    quote->changed = false;
+
+    return;
+}
+
+static void solveQuotes(VolSurfaceQuote *quotes, const size_t *indices, size_t n)
+{
+    VolSurfaceSolve solve = {quotes, indices};
+    ThreadPool *pool = threadPoolShared();
+    if (pool != NULL)
+        threadPoolParallelFor(pool, n, volSurfaceSolveJob, &solve);
+    else
+        for (size_t i = 0; i < n; i++)
+            volSurfaceSolveJob(&solve, i);
+
+    return;
+}
+
+static double quotePrice(const OptionsData *contract)
+{
+    return contract->quote.bid > 0.0 && contract->quote.ask > 0.0 ? contract->quote.midpoint : contract->tickerData.close;
+}
+
+// Out-of-the-money standard contracts make the smile: the call at or above
+// the forward and the put below it. A strike with only one of the two listed
+// uses it.
+static int fitSmile(const VolSurface *surface, VolSmile *smile)
+{
+    const VolSurfaceQuote *quotes = surface->quotes + smile->first;
+    smile->nKnots = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < smile->count; i = next)
+    {
+        // Quotes at this strike, calls then puts, each perhaps adjusted too
+        const VolSurfaceQuote *call = NULL;
+        const VolSurfaceQuote *put = NULL;
+        for (next = i; next < smile->count && fabs(quotes[next].option.K - quotes[i].option.K) <= OPTIONS_CHAIN_STRIKE_TOLERANCE; next++)
+        {
+            const VolSurfaceQuote *candidate = &quotes[next];
+            if (!candidate->standard)
+                continue;
+            if (candidate->type == CALL && call == NULL)
+                call = candidate;
+            else if (candidate->type == PUT && put == NULL)
+                put = candidate;
+        }
+        const VolSurfaceQuote *quote = quotes[i].option.K >= smile->forward ? call : put;
+        if (quote == NULL)
+            quote = call != NULL ? call : put;
+        if (quote == NULL || isnan(quote->option.v))
+            continue;
+        smile->k[smile->nKnots] = log(quote->option.K / smile->forward);
+        smile->w[smile->nKnots] = quote->option.v * quote->option.v * smile->T;
+        smile->nKnots++;
+    }
+
+    // Natural spline: zero curvature at both ends
+    size_t n = smile->nKnots;
+    double *k = smile->k;
+    double *w = smile->w;
+    double *w2 = smile->w2;
+    if (n < 3)
+    {
+        for (size_t i = 0; i < n; i++)
+            w2[i] = 0.0;
+        return ON_OK;
+    }
+    double *u = malloc(n * sizeof *u);
+    if (u == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    w2[0] = 0.0;
+    u[0] = 0.0;
+    for (size_t i = 1; i < n - 1; i++)
+    {
+        double sig = (k[i] - k[i - 1]) / (k[i + 1] - k[i - 1]);
+        double p = sig * w2[i - 1] + 2.0;
+        w2[i] = (sig - 1.0) / p;
+        u[i] = (w[i + 1] - w[i]) / (k[i + 1] - k[i]) - (w[i] - w[i - 1]) / (k[i] - k[i - 1]);
+        u[i] = (6.0 * u[i] / (k[i + 1] - k[i - 1]) - sig * u[i - 1]) / p;
+    }
+    w2[n - 1] = 0.0;
+    for (size_t i = n - 1; i-- > 0;)
+        w2[i] = w2[i] * w2[i + 1] + u[i];
+    free(u);
+
+    return ON_OK;
+}
+
+// Flat beyond the outermost strikes. Between knots the spline may not dip
+// below half the lower knot, so noisy quotes cannot produce a negative variance.
+static double smileTotalVariance(const VolSmile *smile, double k)
+{
+    size_t n = smile->nKnots;
+    if (n == 1 || k <= smile->k[0])
+        return smile->w[0];
+    if (k >= smile->k[n - 1])
+        return smile->w[n - 1];
+
+    size_t lo = 0;
+    size_t hi = n - 1;
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (smile->k[mid] > k)
+            hi = mid;
+        else
+            lo = mid;
+    }
+    double h = smile->k[hi] - smile->k[lo];
+    double a = (smile->k[hi] - k) / h;
+    double b = (k - smile->k[lo]) / h;
+    double w = a * smile->w[lo] + b * smile->w[hi] + ((a * a * a - a) * smile->w2[lo] + (b * b * b - b) * smile->w2[hi]) * h * h / 6.0;
+
+    return fmax(w, 0.5 * fmin(smile->w[lo], smile->w[hi]));
+}
+
+// Linear in T between the expiries either side at fixed log-moneyness; the
+// implied volatility of the nearest expiry outside them
+static double surfaceTotalVariance(const VolSurface *surface, double k, double T)
+{
+    const VolSmile *first = &surface->smiles[0];
+    const VolSmile *last = &surface->smiles[surface->nSmiles - 1];
+    if (T <= first->T)
+        return smileTotalVariance(first, k) * T / first->T;
+    if (T >= last->T)
+        return smileTotalVariance(last, k) * T / last->T;
+
+    size_t lo = 0;
+    size_t hi = surface->nSmiles - 1;
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (surface->smiles[mid].T > T)
+            hi = mid;
+        else
+            lo = mid;
+    }
+    const VolSmile *before = &surface->smiles[lo];
+    const VolSmile *after = &surface->smiles[hi];
+    double fraction = (T - before->T) / (after->T - before->T);
+
+    return (1.0 - fraction) * smileTotalVariance(before, k) + fraction * smileTotalVariance(after, k);
+}
+
+static void freeSmiles(VolSurface *surface)
+{
+    for (size_t i = 0; i < surface->nSmiles; i++)
+    {
+        free(surface->smiles[i].k);
+        free(surface->smiles[i].w);
+        free(surface->smiles[i].w2);
+    }
+    free(surface->smiles);
+    surface->smiles = NULL;
+    surface->nSmiles = 0;
+
+    return;
+}
+
+// One smile per expiry with at least one implied volatility, in expiry order
+static int buildSmiles(VolSurface *surface)
+{
+    freeSmiles(surface);
+
+    size_t nExpiries = 0;
+    for (size_t i = 0; i < surface->nQuotes; i++)
+        if (i == 0 || surface->quotes[i].day != surface->quotes[i - 1].day)
+            nExpiries++;
+    if (nExpiries == 0)
+        return ON_OK;
+    surface->smiles = calloc(nExpiries, sizeof *surface->smiles);
+    if (surface->smiles == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+
+    size_t first = 0;
+    while (first < surface->nQuotes)
+    {
+        size_t count = 1;
+        while (first + count < surface->nQuotes && surface->quotes[first + count].day == surface->quotes[first].day)
+            count++;
+        const Option *option = &surface->quotes[first].option;
+        if (option->T > 0.0)
+        {
+            VolSmile *smile = &surface->smiles[surface->nSmiles];
+            smile->day = surface->quotes[first].day;
+            smile->T = option->T;
+            smile->forward = surface->S * exp((surface->r - surface->q) * option->T);
+            smile->first = first;
+            smile->count = count;
+            smile->k = malloc(count * sizeof *smile->k);
+            smile->w = malloc(count * sizeof *smile->w);
+            smile->w2 = malloc(count * sizeof *smile->w2);
+            surface->nSmiles++;
+            if (smile->k == NULL || smile->w == NULL || smile->w2 == NULL || fitSmile(surface, smile) != ON_OK)
+                return ON_HEAP_MEMORY_ERROR;
+            if (smile->nKnots == 0)
+            {
+                free(smile->k);
+                free(smile->w);
+                free(smile->w2);
+                memset(smile, 0, sizeof *smile);
+                surface->nSmiles--;
+            }
+        }
+        first += count;
+    }
+
+    return ON_OK;
+}
+
+static void smilesMoneynessRange(const VolSurface *surface, double *kMin, double *kMax)
+{
+    *kMin = INFINITY;
+    *kMax = -INFINITY;
+    for (size_t i = 0; i < surface->nSmiles; i++)
+    {
+        const VolSmile *smile = &surface->smiles[i];
+        *kMin = fmin(*kMin, smile->k[0]);
+        *kMax = fmax(*kMax, smile->k[smile->nKnots - 1]);
+    }
+    // A single strike still needs a cell
+    if (*kMax - *kMin < 1e-6)
+    {
+        *kMin -= 0.05;
+        *kMax += 0.05;
+    }
+
+    return;
+}
+
+static void fillGridRows(VolSurface *surface, int jFirst, int jLast)
+{
+    for (int j = jFirst; j <= jLast; j++)
+    {
+        double *row = surface->grid + (size_t)j * surface->nK;
+        double T = j * surface->dT;
+        for (int i = 0; i < surface->nK; i++)
+            row[i] = j == 0 ? 0.0 : surfaceTotalVariance(surface, surface->kMin + i * surface->dk, T);
+    }
+
+    return;
+}
+
+static int buildGrid(VolSurface *surface)
+{
+    free(surface->grid);
+    surface->grid = NULL;
+    if (surface->nSmiles == 0)
+        return ON_OK;
+
+    double kMax = 0.0;
+    smilesMoneynessRange(surface, &surface->kMin, &kMax);
+    surface->nK = VOL_SURFACE_GRID_STRIKES;
+    surface->dk = (kMax - surface->kMin) / (surface->nK - 1);
+
+    surface->tMax = surface->smiles[surface->nSmiles - 1].T;
+    surface->dT = 1.0 / ((double)OPTIONS_TRADING_DAYS_PER_YEAR * VOL_SURFACE_GRID_STEPS_PER_DAY);
+    double nT = ceil(surface->tMax / surface->dT) + 1.0;
+    if (nT < 2.0)
+        nT = 2.0;
+    if (nT > VOL_SURFACE_GRID_MAX_EXPIRIES)
+    {
+        nT = VOL_SURFACE_GRID_MAX_EXPIRIES;
+        surface->dT = surface->tMax / (nT - 1.0);
+    }
+    surface->nT = (int)nT;
+
+    surface->grid = malloc((size_t)surface->nK * surface->nT * sizeof *surface->grid);
+    if (surface->grid == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    fillGridRows(surface, 0, surface->nT - 1);
+
+    return ON_OK;
+}
+
+int volSurfaceBuild(VolSurface *surface, const char *ticker, const OptionsChain *chain, double S, double r, double q)
+{
+    if (surface == NULL || chain == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    char *name = ticker != NULL ? strdup(ticker) : NULL;
+    freeVolSurface(surface);
+    surface->ticker = name;
+    surface->S = S;
+    surface->r = r;
+    surface->q = q;
+
+    if (chain->nContracts == 0)
+        return ON_OK;
+    surface->quotes = calloc(chain->nContracts, sizeof *surface->quotes);
+    if (surface->quotes == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    surface->nQuotes = chain->nContracts;
+
+    // Dates are worked out here, the implied volatilities on the thread pool
+    for (size_t i = 0; i < chain->nContracts; i++)
+    {
+        const OptionsData *contract = &chain->contracts[i];
+        VolSurfaceQuote *quote = &surface->quotes[i];
+        quote->day = daysFromCivil(contract->expiry);
+        quote->type = contract->type;
+        quote->standard = optionsContractIsStandard(contract);
+        Option option = {S, contract->strike, r, q, nan(""), tradingYearsToExpiry(contract->expiry)};
+        quote->option = option;
+        quote->price = quotePrice(contract);
+    }
+    solveQuotes(surface->quotes, NULL, surface->nQuotes);
+    surface->nSolved = surface->nQuotes;
+
+    int status = buildSmiles(surface);
+    if (status != ON_OK)
+        return status;
+
+    return buildGrid(surface);
+}
+
+static VolSmile *findSmile(VolSurface *surface, long day)
+{
+    size_t lo = 0;
+    size_t hi = surface->nSmiles;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (surface->smiles[mid].day < day)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == surface->nSmiles || surface->smiles[lo].day != day)
+        return NULL;
+
+    return &surface->smiles[lo];
+}
+
+int volSurfaceUpdate(VolSurface *surface, const OptionsChain *chain, double S, double r, double q)
+{
+    if (surface == NULL || chain == NULL)
+        return ON_MISSING_ARG_POINTER;
+
+    // A new underlying price or rate moves every implied volatility, and new
+    // or expired contracts change the smiles themselves
+    bool rebuild = surface->quotes == NULL || chain->nContracts != surface->nQuotes || S != surface->S || r != surface->r || q != surface->q;
+    for (size_t i = 0; !rebuild && i < chain->nContracts; i++)
+    {
+        const OptionsData *contract = &chain->contracts[i];
+        const VolSurfaceQuote *quote = &surface->quotes[i];
+        rebuild = daysFromCivil(contract->expiry) != quote->day || contract->type != quote->type || fabs(contract->strike - quote->option.K) > OPTIONS_CHAIN_STRIKE_TOLERANCE || optionsContractIsStandard(contract) != quote->standard;
+    }
+    if (rebuild)
+        return volSurfaceBuild(surface, surface->ticker, chain, S, r, q);
+
+    size_t *changed = malloc(surface->nQuotes * sizeof *changed);
+    if (changed == NULL)
+        return ON_HEAP_MEMORY_ERROR;
+    // Time to expiry only runs while the market is open, so outside trading
+    // hours just the quotes with new prices are solved again
+    size_t nChanged = 0;
+    bool timeMoved = false;
+    for (size_t i = 0; i < surface->nQuotes; i++)
+    {
+        const OptionsData *contract = &chain->contracts[i];
+        VolSurfaceQuote *quote = &surface->quotes[i];
+        double price = quotePrice(contract);
+        double T = tradingYearsToExpiry(contract->expiry);
+        if (price != quote->price || T != quote->option.T)
+        {
+            timeMoved = timeMoved || T != quote->option.T;
+            quote->price = price;
+            quote->option.T = T;
+            quote->changed = true;
+            changed[nChanged++] = i;
+        }
+    }
+    surface->nSolved = nChanged;
+    if (nChanged == 0)
+    {
+        free(changed);
+        return ON_OK;
+    }
+    solveQuotes(surface->quotes, changed, nChanged);
+
+    // Refit the expiries that changed. An expiry gaining its first implied
+    // volatility or losing its last one adds or removes a smile, and a new
+    // time to expiry moves the smiles and the grid's expiries: start over.
+    int status = ON_OK;
+    bool restructure = timeMoved;
+    int jFirst = surface->nT;
+    int jLast = -1;
+    long lastDay = 0;
+    for (size_t c = 0; c < nChanged && !restructure; c++)
+    {
+        const VolSurfaceQuote *quote = &surface->quotes[changed[c]];
+        if (c > 0 && quote->day == lastDay)
+            continue;
+        lastDay = quote->day;
+        VolSmile *smile = findSmile(surface, quote->day);
+        if (smile == NULL)
+        {
+            restructure = quote->option.T > 0.0 && !isnan(quote->option.v);
+            continue;
+        }
+        status = fitSmile(surface, smile);
+        if (status != ON_OK)
+            break;
+        if (smile->nKnots == 0)
+        {
+            restructure = true;
+            break;
+        }
+        // Grid rows between the neighbouring expiries depend on this smile
+        size_t s = (size_t)(smile - surface->smiles);
+        double tFrom = s > 0 ? surface->smiles[s - 1].T : 0.0;
+        double tTo = s + 1 < surface->nSmiles ? surface->smiles[s + 1].T : INFINITY;
+        int from = (int)floor(tFrom / surface->dT);
+        int to = isinf(tTo) ? surface->nT - 1 : (int)ceil(tTo / surface->dT);
+        if (from < jFirst)
+            jFirst = from;
+        if (to > jLast)
+            jLast = to;
+    }
+    free(changed);
+    if (status != ON_OK)
+        return status;
+
+    if (restructure)
+    {
+        status = buildSmiles(surface);
+        if (status != ON_OK)
+            return status;
+        return buildGrid(surface);
+    }
+
+    // Refitting an outermost strike can move the grid's moneyness range
+    double kMin = 0.0;
+    double kMax = 0.0;
+    smilesMoneynessRange(surface, &kMin, &kMax);
+    if (kMin != surface->kMin || fabs(kMin + (surface->nK - 1) * surface->dk - kMax) > 1e-12)
+        return buildGrid(surface);
+
+    if (jFirst < 0)
+        jFirst = 0;
+    if (jLast > surface->nT - 1)
+        jLast = surface->nT - 1;
+    if (jFirst <= jLast)
+        fillGridRows(surface, jFirst, jLast);
+
+    return ON_OK;
+}
+
+// Bilinear in the grid cell; beyond the last expiry the implied volatility stays that of the last expiry
+double volSurfaceVolatility(const VolSurface *surface, double K, double T)
+{
+    if (surface == NULL || surface->grid == NULL || !(K > 0.0) || !(T > 0.0))
+        return nan("");
+
+    double forward = surface->S * exp((surface->r - surface->q) * T);
+    double x = (log(K / forward) - surface->kMin) / surface->dk;
+    if (x < 0.0)
+        x = 0.0;
+    if (x > surface->nK - 1)
+        x = surface->nK - 1;
+    int i = (int)x;
+    if (i > surface->nK - 2)
+        i = surface->nK - 2;
+    double fx = x - i;
+
+    double y = fmin(T, surface->tMax) / surface->dT;
+    int j = (int)y;
+    if (j > surface->nT - 2)
+        j = surface->nT - 2;
+    double fy = y - j;
+
+    const double *row = surface->grid + (size_t)j * surface->nK + i;
+    const double *next = row + surface->nK;
+    double w = (1.0 - fy) * ((1.0 - fx) * row[0] + fx * row[1]) + fy * ((1.0 - fx) * next[0] + fx * next[1]);
+    if (T > surface->tMax)
+        w *= T / surface->tMax;
+
+    return sqrt(w / T);
+}
+
+void freeVolSurface(VolSurface *surface)
+{
+    if (surface == NULL)
+        return;
+
+    freeSmiles(surface);
+    free(surface->quotes);
+    free(surface->grid);
+    free(surface->ticker);
+    memset(surface, 0, sizeof *surface);
+
+    return;
+}
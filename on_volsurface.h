@@ -0,0 +1,94 @@
+/*
+    Options Numerics: on_volsurface.h
+
+    Copyright (C) 2023  Johnathan K Burchill
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ON_VOLSURFACE_H
+#define _ON_VOLSURFACE_H
+
+#include "on_optionschain.h"
+#include "on_optionsmodels.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lookup grid: log-moneyness nodes, and expiry nodes every half trading day
+#define VOL_SURFACE_GRID_STRIKES 101
+#define VOL_SURFACE_GRID_STEPS_PER_DAY 2
+#define VOL_SURFACE_GRID_MAX_EXPIRIES 4096
+
+// One contract's quote and the implied volatility solved from it
+typedef struct volSurfaceQuote
+{
+    long day; // daysFromCivil(expiry)
+    OptionType type;
+    Option option; // option.v is the implied volatility, NaN if there is none
+    double price;
+    bool standard; // Adjusted contracts are neither solved nor in the smiles
+    bool changed;
+} VolSurfaceQuote;
+
+// Natural cubic spline of total variance w = v^2 T in log-moneyness k = ln(K / F)
+typedef struct volSmile
+{
+    long day;
+    double T;
+    double forward;
+    size_t first; // quotes[first] through [first + count - 1]
+    size_t count;
+    size_t nKnots;
+    double *k;
+    double *w;
+    double *w2; // Second derivatives
+} VolSmile;
+
+// Implied volatility surface of a snapshot of an options chain. Smiles are
+// interpolated linearly in total variance across expiries at fixed
+// log-moneyness, and tabulated on a grid for constant time lookups.
+typedef struct volSurface
+{
+    char *ticker;
+    double S;
+    double r;
+    double q;
+
+    VolSurfaceQuote *quotes; // In chain order
+    size_t nQuotes;
+    size_t nSolved; // Implied volatilities solved by the last build or update
+
+    VolSmile *smiles; // Expiries with at least one implied volatility
+    size_t nSmiles;
+
+    // Total variance at log-moneyness kMin + i dk and T = j dT is grid[j * nK + i]
+    double *grid;
+    int nK;
+    int nT;
+    double kMin;
+    double dk;
+    double dT;
+    double tMax;
+} VolSurface;
+
+// Solves every quoted contract of the chain on the shared thread pool, fits
+// the smiles and fills the grid. S, r and q are as in Option.
+int volSurfaceBuild(VolSurface *surface, const char *ticker, const OptionsChain *chain, double S, double r, double q);
+// Re-solves only the contracts whose prices or times to expiry changed since
+// the last build or update and refits their expiries; anything else different
+// means a rebuild
+int volSurfaceUpdate(VolSurface *surface, const OptionsChain *chain, double S, double r, double q);
+// Implied volatility (fraction) for strike K and T trading years, NaN if the surface is empty
+double volSurfaceVolatility(const VolSurface *surface, double K, double T);
+void freeVolSurface(VolSurface *surface);
+
+#endif // _ON_VOLSURFACE_H
@@ -22,6 +22,7 @@
 #include "on_api.h"
 #include "on_remote.h"
 
+#include <math.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -84,15 +85,9 @@ static size_t polygonIoWssCallback(char *data, size_t size, size_t nmemb, void *
     size_t realsize = size *nmemb;
     WssData *wssData = (WssData *)userdata;
 
-    char *ptr = realloc(wssData->frame, wssData->size + realsize + 1);
-    if (ptr == NULL)
+    if (curlDataAppend(&wssData->frame, data, realsize) != ON_OK)
         return ON_OK;
 
-    wssData->frame = ptr;
-    memcpy(&(wssData->frame[wssData->size]), data, realsize);
-    wssData->size += realsize;
-    wssData->frame[wssData->size] = 0;
-
     struct curl_ws_frame *frameInfo = curl_ws_meta(wssData->curl);
 
     if ((frameInfo->flags & CURLWS_CONT) == 0)
@@ -100,9 +95,8 @@ static size_t polygonIoWssCallback(char *data, size_t size, size_t nmemb, void *
         if (frameInfo->flags & CURLWS_TEXT)
             polygonIoParseWssFrame(wssData);
 
-        free(wssData->frame);
-        wssData->frame = NULL;
-        wssData->size = 0;
+        // The memory is kept for the next frame
+        curlDataClear(&wssData->frame);
     }
 
     return realsize;
@@ -118,9 +112,9 @@ int polygonIoParseWssFrame(WssData *wssData)
 
     int status = 0;
     json_error_t error = {0};
-    if (wssData->frame == NULL)
+    if (wssData->frame.response == NULL)
         return ON_PIO_WSS_NO_JSON_ROOT;
-    json_t *root = json_loads(wssData->frame, 0, &error);
+    json_t *root = json_loads(wssData->frame.response, 0, &error);
     if (!root)
     {
         status = ON_PIO_WSS_NO_JSON_ROOT;
@@ -201,6 +195,11 @@ int polygonIoParseWssFrame(WssData *wssData)
                     resetPromptPosition(wssData->screen, false);
                 }
                 snprintf(wssData->subscriptions[subscribeCount].channel, PIO_CHANNEL_LENGTH, "%s", msg + 15);
+                // Realized volatility of the aggregates: A.* per second, AM.* per minute
+                double barsPerYear = (double)OPTIONS_TRADING_DAYS_PER_YEAR * MARKET_SESSION_MINUTES;
+                if (strncmp(msg + 15, "A.", 2) == 0)
+                    barsPerYear *= 60.0;
+                volatilityEstimatorInit(&wssData->subscriptions[subscribeCount].realizedVolatility, barsPerYear);
                 // TODO ? Pause timer
                 char *p = msg;
                 while (p && *p != '.')
@@ -246,6 +245,7 @@ int polygonIoParseWssFrame(WssData *wssData)
                                 s->aggChange = s->aggClose - s->aggOpen;
                                 s->dayChange = s->aggClose - s->previousClose;
                                 s->dayPercentChange = s->dayChange / s->previousClose * 100.0;
+                                volatilityEstimatorAddBar(&s->realizedVolatility, s->aggOpen, s->aggHigh, s->aggLow, s->aggClose);
                                 break;
                             }
                         }
@@ -352,20 +352,10 @@ int polygonIoStreamAuthenticate(WssData *wssData)
         return ON_PIO_WSS_NO_DATA;
 
     char authenticate[512] = {0};
-    char *token = loadApiToken("PIO.apitoken");
+    const char *token = providerApiToken(wssData->screen, "PIO.apitoken", PIO_TOKEN_PROMPT);
     if (token == NULL)
-    {
-        token = readInput(wssData->screen, wssData->screen->mainWindow, "  Polygon.IO (PIO) personal API token: ", ON_READINPUT_HIDDEN);
-        if (token == NULL || strlen(token) == 0)
-        {
-            free(token);
-            return ON_INVALID_TOKEN;
-        }
-        saveApiToken("PIO.apitoken", token);
-    }
+        return ON_INVALID_TOKEN;
     sprintf(authenticate, "{\"action\":\"auth\",\"params\":\"%s\"}", token);
-    bzero(token, strlen(token));
-    free(token);
 
     size_t responseLength = strlen(authenticate) + 1;
     size_t sent = 0;
@@ -532,6 +522,9 @@ void updateWssStreamContent(void)
         if (s->reportedTimeSecs > 0)
         {
             mvwprintw(data.screen->streamWindow, i, 0, "%25s: $%.2lf (%+.2lf, %+.2lf%%) %.0lf (%+.0lf) ", s->channel, s->aggClose, s->dayChange, s->dayPercentChange, s->dayVolume, s->aggVolume);
+            double realized = volatilityEstimate(&s->realizedVolatility, VOLATILITY_YANG_ZHANG);
+            if (!isnan(realized))
+                wprintw(data.screen->streamWindow, "vol %.1lf%% ", realized * 100.0);
             getyx(data.screen->streamWindow, y, x);
             if (x > longestLine)
                 longestLine = x;
@@ -590,9 +583,7 @@ void clearWssStreamStatusLine(void)
 void wssCleanup(void)
 {
     curl_easy_cleanup(data.curl);
-    free(data.frame);
-    data.frame = NULL;
-    data.size = 0;
+    curlDataFree(&data.frame);
     return;
 }
 